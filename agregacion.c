@@ -0,0 +1,321 @@
+#include "agregacion.h"
+#include "hash.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+// Definicion de constantes
+
+#define AGREGACION_LOTE 1024
+#define AGREGACION_MAX_HILOS 16
+#define AGREGACION_MINIMO 16384 // filas por hilo a partir de las que conviene otro hilo
+
+// Funcion de hash de la tabla, definida en hash.c
+unsigned long f_hash(const char* str);
+
+// Definicion de las estructuras. Cada particion guarda en su tabla el
+// numero de grupo + 1 de cada clave (para distinguirlo de NULL); como la
+// tabla recorre las claves en orden de insercion, la k-esima clave del
+// iterador es la del grupo k.
+
+typedef struct particion {
+    hash_t* grupos;
+    agregado_t* estados;
+    size_t cantidad;
+    size_t capacidad;
+} particion_t;
+
+struct agregacion {
+    particion_t* particiones;
+    size_t cantidad_particiones;
+    size_t* inicios; // cantidad_particiones + 1, para repartir un lote
+};
+
+typedef struct tramo_agregacion {
+    agregacion_t* agregacion;
+    agregacion_t** locales;
+    size_t cantidad_locales;
+    const char** claves;
+    const int64_t* valores;
+    size_t cantidad;
+    size_t hilo;
+    size_t hilos;
+    bool ok;
+} tramo_agregacion_t;
+
+static const agregado_t AGREGADO_NEUTRO = { 0, 0, INT64_MAX, INT64_MIN };
+
+// Funciones auxiliares
+
+size_t agregacion_particion(const agregacion_t* agregacion, const char* clave) {
+    if ( agregacion->cantidad_particiones == 1 )
+        return 0;
+    // Los bits altos del producto mezclan todos los del hash
+    uint64_t h = ((uint64_t)f_hash(clave) * 0x9e3779b97f4a7c15ULL) >> 32;
+    return (size_t)((h * agregacion->cantidad_particiones) >> 32);
+}
+
+bool particion_reservar(particion_t* particion, size_t cantidad) {
+    if ( cantidad <= particion->capacidad )
+        return true;
+    size_t capacidad = particion->capacidad ? particion->capacidad : AGREGACION_LOTE;
+    while ( capacidad < cantidad )
+        capacidad *= 2;
+    agregado_t* estados = realloc(particion->estados, capacidad * sizeof(agregado_t));
+    if ( !estados )
+        return false;
+    particion->estados = estados;
+    particion->capacidad = capacidad;
+    return true;
+}
+
+// Deja en ids el grupo de cada clave, creando los nuevos con los
+// acumuladores neutros. Devuelve cuantas claves resolvio.
+// Pre: cantidad <= AGREGACION_LOTE.
+size_t particion_resolver(particion_t* particion, const char** claves, size_t cantidad, size_t* ids) {
+    void** datos[AGREGACION_LOTE];
+    bool insertados[AGREGACION_LOTE];
+    if ( !particion_reservar(particion, particion->cantidad + cantidad) )
+        return 0;
+    size_t resueltos = hash_obtener_o_insertar_lote(particion->grupos, claves, cantidad, datos, insertados);
+    for (size_t i = 0; i < resueltos; i++) {
+        // Una clave repetida en el lote ya tiene su grupo de la primera vez
+        if ( insertados[i] ) {
+            particion->estados[particion->cantidad] = AGREGADO_NEUTRO;
+            *datos[i] = (void*)(uintptr_t)++particion->cantidad;
+        }
+        ids[i] = (uintptr_t)*datos[i] - 1;
+    }
+    return resueltos;
+}
+
+bool particion_agregar(particion_t* particion, const char** claves, const int64_t* valores, size_t cantidad) {
+    size_t ids[AGREGACION_LOTE];
+    for (size_t inicio = 0; inicio < cantidad; inicio += AGREGACION_LOTE) {
+        size_t largo = cantidad - inicio < AGREGACION_LOTE ? cantidad - inicio : AGREGACION_LOTE;
+        size_t resueltos = particion_resolver(particion, claves + inicio, largo, ids);
+        agregado_t* estados = particion->estados;
+        for (size_t i = 0; i < resueltos; i++) {
+            agregado_t* estado = &estados[ids[i]];
+            int64_t valor = valores[inicio + i];
+            estado->suma += valor;
+            estado->cuenta++;
+            if ( valor < estado->minimo )
+                estado->minimo = valor;
+            if ( valor > estado->maximo )
+                estado->maximo = valor;
+        }
+        if ( resueltos < largo )
+            return false;
+    }
+    return true;
+}
+
+// Suma a destino los grupos de origen, tomando sus claves de a lotes
+bool particion_combinar(particion_t* destino, const particion_t* origen) {
+    const char* claves[AGREGACION_LOTE];
+    size_t ids[AGREGACION_LOTE];
+    hash_iter_t* iter = hash_iter_crear(origen->grupos);
+    if ( !iter )
+        return false;
+    bool ok = true;
+    size_t grupo = 0;
+    while ( ok && grupo < origen->cantidad ) {
+        size_t largo = 0;
+        for (; largo < AGREGACION_LOTE && !hash_iter_al_final(iter); hash_iter_avanzar(iter))
+            claves[largo++] = hash_iter_ver_actual(iter);
+        if ( !largo )
+            break;
+        size_t resueltos = particion_resolver(destino, claves, largo, ids);
+        for (size_t i = 0; i < resueltos; i++) {
+            agregado_t* estado = &destino->estados[ids[i]];
+            const agregado_t* sumado = &origen->estados[grupo + i];
+            estado->suma += sumado->suma;
+            estado->cuenta += sumado->cuenta;
+            if ( sumado->minimo < estado->minimo )
+                estado->minimo = sumado->minimo;
+            if ( sumado->maximo > estado->maximo )
+                estado->maximo = sumado->maximo;
+        }
+        ok = resueltos == largo;
+        grupo += largo;
+    }
+    hash_iter_destruir(iter);
+    return ok;
+}
+
+void* tramo_agregar(void* extra) {
+    tramo_agregacion_t* tramo = extra;
+    tramo->ok = agregacion_agregar(tramo->agregacion, tramo->claves, tramo->valores, tramo->cantidad);
+    return NULL;
+}
+
+// Cada hilo combina las particiones que le tocan: ningun otro las escribe
+void* tramo_combinar(void* extra) {
+    tramo_agregacion_t* tramo = extra;
+    agregacion_t* agregacion = tramo->agregacion;
+    tramo->ok = true;
+    for (size_t p = tramo->hilo; p < agregacion->cantidad_particiones; p += tramo->hilos) {
+        for (size_t l = 0; l < tramo->cantidad_locales && tramo->ok; l++)
+            tramo->ok = particion_combinar(&agregacion->particiones[p], &tramo->locales[l]->particiones[p]);
+    }
+    return NULL;
+}
+
+// Corre trabajo sobre cada tramo, el primero en el hilo que llama. Si no se
+// puede crear un hilo, su tramo tambien se procesa aca.
+bool tramos_agregacion_procesar(void* trabajo(void*), tramo_agregacion_t* tramos, size_t hilos) {
+    pthread_t ids[AGREGACION_MAX_HILOS];
+    bool lanzado[AGREGACION_MAX_HILOS];
+    for (size_t t = 0; t < hilos; t++)
+        lanzado[t] = t > 0 && pthread_create(&ids[t], NULL, trabajo, &tramos[t]) == 0;
+    for (size_t t = 0; t < hilos; t++) {
+        if ( !lanzado[t] )
+            trabajo(&tramos[t]);
+    }
+    bool ok = true;
+    for (size_t t = 0; t < hilos; t++) {
+        if ( lanzado[t] )
+            pthread_join(ids[t], NULL);
+        ok = ok && tramos[t].ok;
+    }
+    return ok;
+}
+
+// Primitivas de la agregacion
+
+agregacion_t* agregacion_crear(size_t particiones) {
+    if ( !particiones )
+        particiones = 1;
+    agregacion_t* agregacion = malloc(sizeof(agregacion_t));
+    if ( !agregacion )
+        return NULL;
+    agregacion->particiones = calloc(particiones, sizeof(particion_t));
+    agregacion->inicios = malloc((particiones + 1) * sizeof(size_t));
+    agregacion->cantidad_particiones = particiones;
+    bool ok = agregacion->particiones && agregacion->inicios;
+    for (size_t p = 0; p < particiones && ok; p++) {
+        agregacion->particiones[p].grupos = hash_crear(NULL);
+        ok = agregacion->particiones[p].grupos;
+    }
+    if ( !ok ) {
+        agregacion_destruir(agregacion);
+        return NULL;
+    }
+    return agregacion;
+}
+
+bool agregacion_agregar(agregacion_t* agregacion, const char** claves, const int64_t* valores, size_t cantidad) {
+    if ( agregacion->cantidad_particiones == 1 )
+        return particion_agregar(&agregacion->particiones[0], claves, valores, cantidad);
+
+    // Reparte cada lote por particion, contando y despues ubicando las filas
+    size_t particiones = agregacion->cantidad_particiones;
+    size_t* inicios = agregacion->inicios;
+    const char* claves_lote[AGREGACION_LOTE];
+    int64_t valores_lote[AGREGACION_LOTE];
+    size_t destinos[AGREGACION_LOTE];
+    for (size_t inicio = 0; inicio < cantidad; inicio += AGREGACION_LOTE) {
+        size_t largo = cantidad - inicio < AGREGACION_LOTE ? cantidad - inicio : AGREGACION_LOTE;
+        for (size_t p = 0; p <= particiones; p++)
+            inicios[p] = 0;
+        for (size_t i = 0; i < largo; i++) {
+            destinos[i] = agregacion_particion(agregacion, claves[inicio + i]);
+            inicios[destinos[i] + 1]++;
+        }
+        for (size_t p = 0; p < particiones; p++)
+            inicios[p + 1] += inicios[p];
+        for (size_t i = 0; i < largo; i++) {
+            size_t j = inicios[destinos[i]]++;
+            claves_lote[j] = claves[inicio + i];
+            valores_lote[j] = valores[inicio + i];
+        }
+        // Cada inicio quedo en el final de su particion
+        for (size_t p = 0, desde = 0; p < particiones; desde = inicios[p++]) {
+            if ( !particion_agregar(&agregacion->particiones[p], claves_lote + desde, valores_lote + desde, inicios[p] - desde) )
+                return false;
+        }
+    }
+    return true;
+}
+
+bool agregacion_agregar_paralelo(agregacion_t* agregacion, const char** claves, const int64_t* valores, size_t cantidad, size_t hilos) {
+    if ( hilos > cantidad / AGREGACION_MINIMO + 1 )
+        hilos = cantidad / AGREGACION_MINIMO + 1;
+    if ( hilos > AGREGACION_MAX_HILOS )
+        hilos = AGREGACION_MAX_HILOS;
+    if ( hilos <= 1 )
+        return agregacion_agregar(agregacion, claves, valores, cantidad);
+
+    // El primer tramo se agrega directo en el resultado
+    agregacion_t* locales[AGREGACION_MAX_HILOS];
+    locales[0] = agregacion;
+    bool ok = true;
+    for (size_t t = 1; t < hilos; t++) {
+        locales[t] = ok ? agregacion_crear(agregacion->cantidad_particiones) : NULL;
+        ok = ok && locales[t];
+    }
+
+    tramo_agregacion_t tramos[AGREGACION_MAX_HILOS];
+    for (size_t t = 0; t < hilos && ok; t++) {
+        size_t desde = cantidad * t / hilos;
+        tramos[t].agregacion = locales[t];
+        tramos[t].claves = claves + desde;
+        tramos[t].valores = valores + desde;
+        tramos[t].cantidad = cantidad * (t + 1) / hilos - desde;
+    }
+    ok = ok && tramos_agregacion_procesar(tramo_agregar, tramos, hilos);
+
+    for (size_t t = 0; t < hilos && ok; t++) {
+        tramos[t].agregacion = agregacion;
+        tramos[t].locales = locales + 1;
+        tramos[t].cantidad_locales = hilos - 1;
+        tramos[t].hilo = t;
+        tramos[t].hilos = hilos;
+    }
+    ok = ok && tramos_agregacion_procesar(tramo_combinar, tramos, hilos);
+
+    for (size_t t = 1; t < hilos; t++) {
+        if ( locales[t] )
+            agregacion_destruir(locales[t]);
+    }
+    return ok;
+}
+
+size_t agregacion_grupos(const agregacion_t* agregacion) {
+    size_t grupos = 0;
+    for (size_t p = 0; p < agregacion->cantidad_particiones; p++)
+        grupos += agregacion->particiones[p].cantidad;
+    return grupos;
+}
+
+const agregado_t* agregacion_buscar(const agregacion_t* agregacion, const char* clave) {
+    const particion_t* particion = &agregacion->particiones[agregacion_particion(agregacion, clave)];
+    uintptr_t grupo = (uintptr_t)hash_obtener(particion->grupos, clave);
+    return grupo ? &particion->estados[grupo - 1] : NULL;
+}
+
+void agregacion_iterar(const agregacion_t* agregacion, bool visitar(const char* clave, const agregado_t* agregado, void* extra), void* extra) {
+    for (size_t p = 0; p < agregacion->cantidad_particiones; p++) {
+        const particion_t* particion = &agregacion->particiones[p];
+        hash_iter_t* iter = hash_iter_crear(particion->grupos);
+        if ( !iter )
+            return;
+        bool seguir = true;
+        for (size_t grupo = 0; seguir && !hash_iter_al_final(iter); grupo++, hash_iter_avanzar(iter))
+            seguir = visitar(hash_iter_ver_actual(iter), &particion->estados[grupo], extra);
+        hash_iter_destruir(iter);
+        if ( !seguir )
+            return;
+    }
+}
+
+void agregacion_destruir(agregacion_t* agregacion) {
+    for (size_t p = 0; agregacion->particiones && p < agregacion->cantidad_particiones; p++) {
+        if ( agregacion->particiones[p].grupos )
+            hash_destruir(agregacion->particiones[p].grupos);
+        free(agregacion->particiones[p].estados);
+    }
+    free(agregacion->particiones);
+    free(agregacion->inicios);
+    free(agregacion);
+}
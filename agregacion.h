@@ -0,0 +1,67 @@
+#ifndef AGREGACION_H
+#define AGREGACION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ******************************************************************
+ *                DEFINICION DE LOS TIPOS DE DATOS
+ * ******************************************************************/
+
+// Acumuladores de un grupo. Un grupo siempre tiene cuenta > 0.
+typedef struct agregado {
+    int64_t suma;
+    size_t cuenta;
+    int64_t minimo;
+    int64_t maximo;
+} agregado_t;
+
+// Agregacion por clave (GROUP BY) sobre columnas: cada fila es un par
+// (claves[i], valores[i]). Las claves se resuelven de a lotes en tablas
+// hash_t que guardan el numero de grupo, y los acumuladores de todos los
+// grupos se guardan contiguos en un arreglo por particion.
+typedef struct agregacion agregacion_t;
+
+/* ******************************************************************
+ *                    PRIMITIVAS DE LA AGREGACION
+ * ******************************************************************/
+
+// Crea una agregacion vacia con la cantidad de particiones indicada (al
+// menos 1). Cada clave va siempre a la misma particion, y las particiones
+// se combinan en paralelo al agregar con varios hilos.
+// Post: devuelve la agregacion, o NULL si no hay memoria.
+agregacion_t* agregacion_crear(size_t particiones);
+
+// Agrega las filas a sus grupos, creando los que no existian. Las claves
+// se copian. Devuelve false si no hubo memoria; en ese caso parte de las
+// filas pudo quedar agregada.
+// Pre: la agregacion fue creada.
+bool agregacion_agregar(agregacion_t* agregacion, const char** claves, const int64_t* valores, size_t cantidad);
+
+// Como agregacion_agregar, repartiendo las filas entre hasta hilos hilos.
+// Cada hilo agrega su tramo en una agregacion propia, y despues cada
+// particion del resultado combina las de todos los hilos en paralelo.
+// Conviene que haya al menos tantas particiones como hilos.
+// Pre: la agregacion fue creada.
+bool agregacion_agregar_paralelo(agregacion_t* agregacion, const char** claves, const int64_t* valores, size_t cantidad, size_t hilos);
+
+// Devuelve la cantidad de grupos.
+// Pre: la agregacion fue creada.
+size_t agregacion_grupos(const agregacion_t* agregacion);
+
+// Devuelve los acumuladores del grupo de la clave, o NULL si no existe. El
+// puntero vale hasta la proxima modificacion de la agregacion.
+// Pre: la agregacion fue creada.
+const agregado_t* agregacion_buscar(const agregacion_t* agregacion, const char* clave);
+
+// Llama a visitar con cada grupo mientras devuelva true, particion por
+// particion y en el orden en que aparecieron sus claves.
+// Pre: la agregacion fue creada.
+void agregacion_iterar(const agregacion_t* agregacion, bool visitar(const char* clave, const agregado_t* agregado, void* extra), void* extra);
+
+// Libera la agregacion y sus claves.
+// Pre: la agregacion fue creada.
+void agregacion_destruir(agregacion_t* agregacion);
+
+#endif // AGREGACION_H
@@ -0,0 +1,23 @@
+#include "allocador.h"
+#include <stdlib.h>
+
+// Primitivas del allocador
+
+void* allocador_pedir(const allocador_t* allocador, size_t tamanio) {
+    if ( allocador->pedir )
+        return allocador->pedir(allocador->contexto, tamanio);
+    return malloc(tamanio);
+}
+
+void* allocador_redimensionar(const allocador_t* allocador, void* ptr, size_t tamanio) {
+    if ( allocador->redimensionar )
+        return allocador->redimensionar(allocador->contexto, ptr, tamanio);
+    return realloc(ptr, tamanio);
+}
+
+void allocador_liberar(const allocador_t* allocador, void* ptr) {
+    if ( allocador->liberar )
+        allocador->liberar(allocador->contexto, ptr);
+    else
+        free(ptr);
+}
@@ -0,0 +1,38 @@
+#ifndef ALLOCADOR_H
+#define ALLOCADOR_H
+
+#include <stddef.h>
+
+/* ******************************************************************
+ *                DEFINICION DE LOS TIPOS DE DATOS
+ * ******************************************************************/
+
+// Funciones de memoria provistas por el usuario. Reciben el contexto que se
+// paso al crear la estructura (una arena, un presupuesto, etc.).
+typedef void* (*allocador_pedir_t)(void* contexto, size_t tamanio);
+typedef void* (*allocador_redimensionar_t)(void* contexto, void* ptr, size_t tamanio);
+typedef void (*allocador_liberar_t)(void* contexto, void* ptr);
+
+// Las funciones en NULL usan malloc, realloc y free.
+typedef struct allocador {
+    allocador_pedir_t pedir;
+    allocador_redimensionar_t redimensionar;
+    allocador_liberar_t liberar;
+    void* contexto;
+} allocador_t;
+
+/* ******************************************************************
+ *                    PRIMITIVAS DEL ALLOCADOR
+ * ******************************************************************/
+
+// Pide tamanio bytes. Devuelve NULL si no hay memoria.
+void* allocador_pedir(const allocador_t* allocador, size_t tamanio);
+
+// Cambia el tamanio del bloque como realloc. Si falla devuelve NULL y el
+// bloque original sigue valido.
+void* allocador_redimensionar(const allocador_t* allocador, void* ptr, size_t tamanio);
+
+// Libera un bloque pedido con el mismo allocador.
+void allocador_liberar(const allocador_t* allocador, void* ptr);
+
+#endif // ALLOCADOR_H
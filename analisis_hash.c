@@ -0,0 +1,358 @@
+/*
+ * analisis_hash.c
+ * Analiza la calidad de funciones de hash candidatas sobre un corpus real
+ * de claves (una por linea; si la linea tiene un tab, la clave es lo que
+ * esta antes). Para cada funcion y cada capacidad de la secuencia por la
+ * que pasa la tabla, arma el indice como lo hace la tabla (hash_mezclar y
+ * "% capacidad", sondeo lineal, hasta la carga en la que se redimensiona)
+ * e informa el largo de los sondeos y la distribucion en baldes. La
+ * distribucion de la funcion sin mezclar queda como ultima columna. El
+ * reporte es texto estable para poder compararlo con diff entre corpus y
+ * compilaciones.
+ *
+ * Compilar: gcc -std=c99 -O2 -pthread analisis_hash.c hash.c lista.c registro.c allocador.c traza.c congelado.c -lm
+ * Uso: ./analisis_hash corpus.txt
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CAPACIDAD_INICIAL 31
+#define CARGA_MAXIMA_NUMERADOR 2
+#define CARGA_MAXIMA_DENOMINADOR 3
+#define FACTOR_REDIMENSION 2
+#define MUESTRA_AVALANCHA 10000
+#define SEGUNDOS_RENDIMIENTO 0.2
+#define BITS_HASH (sizeof(unsigned long) * 8)
+
+// Funcion de hash de la tabla y mezcla del indice, definidas en hash.c
+unsigned long f_hash(const char *str);
+uint64_t hash_mezclar(unsigned long h);
+
+/* ******************************************************************
+ *                    FUNCIONES CANDIDATAS
+ * *****************************************************************/
+
+static unsigned long hash_fnv1a(const char *str)
+{
+    uint64_t h = 14695981039346656037ULL;
+    while (*str) {
+        h ^= (unsigned char) *str++;
+        h *= 1099511628211ULL;
+    }
+    return (unsigned long) h;
+}
+
+static unsigned long hash_sdbm(const char *str)
+{
+    unsigned long h = 0;
+    int c;
+    while ((c = *str++))
+        h = (unsigned long) c + (h << 6) + (h << 16) - h;
+    return h;
+}
+
+// Procesa 8 bytes por paso y termina con el finalizador de MurmurHash3
+static unsigned long hash_mezcla64(const char *str)
+{
+    size_t largo = strlen(str);
+    uint64_t h = largo * 0x9e3779b97f4a7c15ULL;
+    uint64_t bloque;
+    while (largo >= sizeof(bloque)) {
+        memcpy(&bloque, str, sizeof(bloque));
+        h = (h ^ bloque) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+        str += sizeof(bloque);
+        largo -= sizeof(bloque);
+    }
+    bloque = 0;
+    memcpy(&bloque, str, largo);
+    h ^= bloque;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (unsigned long) h;
+}
+
+typedef struct candidata {
+    const char *nombre;
+    unsigned long (*funcion)(const char *);
+} candidata_t;
+
+static const candidata_t CANDIDATAS[] = {
+    { "f_hash", f_hash },
+    { "fnv1a", hash_fnv1a },
+    { "sdbm", hash_sdbm },
+    { "mezcla64", hash_mezcla64 },
+};
+
+/* ******************************************************************
+ *                          CORPUS
+ * *****************************************************************/
+
+typedef struct corpus {
+    char *texto;
+    char **claves;
+    size_t cantidad;
+    size_t bytes;
+} corpus_t;
+
+// Carga el archivo completo y corta las claves en el lugar
+static bool corpus_cargar(corpus_t *corpus, const char *ruta)
+{
+    FILE *archivo = fopen(ruta, "rb");
+    if (!archivo) return false;
+    fseek(archivo, 0, SEEK_END);
+    long largo = ftell(archivo);
+    fseek(archivo, 0, SEEK_SET);
+    if (largo < 0) {
+        fclose(archivo);
+        return false;
+    }
+
+    corpus->texto = malloc((size_t) largo + 1);
+    if (!corpus->texto || fread(corpus->texto, 1, (size_t) largo, archivo) != (size_t) largo) {
+        fclose(archivo);
+        return false;
+    }
+    fclose(archivo);
+    corpus->texto[largo] = '\0';
+
+    size_t lineas = 1;
+    for (long i = 0; i < largo; i++)
+        lineas += corpus->texto[i] == '\n';
+    corpus->claves = malloc(lineas * sizeof(char *));
+    if (!corpus->claves) return false;
+
+    corpus->cantidad = 0;
+    corpus->bytes = 0;
+    char *linea = corpus->texto;
+    while (*linea) {
+        char *fin = strchr(linea, '\n');
+        if (fin) *fin = '\0';
+        char *tab = strchr(linea, '\t');
+        if (tab) *tab = '\0';
+        corpus->claves[corpus->cantidad++] = linea;
+        corpus->bytes += strlen(linea);
+        if (!fin) break;
+        linea = fin + 1;
+    }
+    return true;
+}
+
+/* ******************************************************************
+ *                         MEDICIONES
+ * *****************************************************************/
+
+// Maximo esperado de la cadena mas larga si las claves fueran uniformes:
+// el menor k tal que capacidad * P(Poisson(n / capacidad) > k) < 1/2.
+// La probabilidad se calcula en escala logaritmica para cargas altas.
+static double poisson_cola(double lambda, size_t k)
+{
+    double cola = 0;
+    for (size_t j = k + 1; ; j++) {
+        double termino = exp(-lambda + (double) j * log(lambda) - lgamma((double) j + 1));
+        cola += termino;
+        if ((double) j > lambda && termino < cola * 1e-12) break;
+    }
+    return cola;
+}
+
+static size_t cadena_maxima_esperada(size_t cantidad, size_t capacidad)
+{
+    double lambda = (double) cantidad / (double) capacidad;
+    size_t k = (size_t) lambda;
+    while (k < cantidad && (double) capacidad * poisson_cola(lambda, k) >= 0.5)
+        k++;
+    return k;
+}
+
+// Chi cuadrado de la ocupacion de los baldes contra una distribucion
+// uniforme, dividido por los grados de libertad
+static double chi2_por_libertad(const size_t *baldes, size_t capacidad, size_t cantidad, size_t *maxima, size_t *vacios)
+{
+    double esperado = (double) cantidad / (double) capacidad;
+    double chi2 = 0;
+    *maxima = 0;
+    *vacios = 0;
+    for (size_t i = 0; i < capacidad; i++) {
+        double diferencia = (double) baldes[i] - esperado;
+        chi2 += diferencia * diferencia / esperado;
+        if (baldes[i] > *maxima) *maxima = baldes[i];
+        *vacios += !baldes[i];
+    }
+    return chi2 / (double) (capacidad - 1);
+}
+
+static void medir_distribucion(const unsigned long *hashes, size_t cantidad, size_t capacidad)
+{
+    size_t *baldes = calloc(capacidad, sizeof(size_t));
+    size_t *crudos = calloc(capacidad, sizeof(size_t));
+    bool *ocupadas = calloc(capacidad, sizeof(bool));
+    if (!baldes || !crudos || !ocupadas) {
+        free(baldes);
+        free(crudos);
+        free(ocupadas);
+        return;
+    }
+
+    // Al superar esta carga la tabla pasa a la capacidad siguiente
+    size_t maximas = capacidad * CARGA_MAXIMA_NUMERADOR / CARGA_MAXIMA_DENOMINADOR;
+    size_t claves = cantidad < maximas ? cantidad : maximas;
+    size_t sondeos = 0, desplazamiento_max = 0;
+    for (size_t i = 0; i < claves; i++) {
+        size_t inicio = (size_t) (hash_mezclar(hashes[i]) % capacidad);
+        baldes[inicio]++;
+        crudos[hashes[i] % capacidad]++;
+        size_t j = inicio, desplazamiento = 0;
+        while (ocupadas[j]) {
+            j = (j + 1) % capacidad;
+            desplazamiento++;
+        }
+        ocupadas[j] = true;
+        sondeos += desplazamiento + 1;
+        if (desplazamiento > desplazamiento_max) desplazamiento_max = desplazamiento;
+    }
+
+    size_t maxima, vacios, maxima_cruda, vacios_crudos;
+    double chi2 = chi2_por_libertad(baldes, capacidad, claves, &maxima, &vacios);
+    double chi2_crudo = chi2_por_libertad(crudos, capacidad, claves, &maxima_cruda, &vacios_crudos);
+    // Para distribucion uniforme chi2 / gl ronda 1 y z ronda 0
+    double libertad = (double) (capacidad - 1);
+    double z = (chi2 - 1) * libertad / sqrt(2 * libertad);
+    // Knuth: una busqueda exitosa con sondeo lineal mira en promedio
+    // (1 + 1 / (1 - carga)) / 2 posiciones
+    double carga = (double) claves / (double) capacidad;
+    double sondeo_esperado = (1 + 1 / (1 - carga)) / 2;
+
+    printf("  capacidad %10zu  claves %10zu  carga %5.3f  sondeo_medio %6.3f  esperado %6.3f  "
+           "desplazamiento_max %5zu  chi2/gl %8.3f  z %9.2f  vacios %10zu  cadena_max %4zu  "
+           "esperada %4zu  crudo_chi2/gl %8.3f\n",
+           capacidad, claves, carga, (double) sondeos / (double) claves, sondeo_esperado,
+           desplazamiento_max, chi2, z, vacios, maxima,
+           cadena_maxima_esperada(claves, capacidad), chi2_crudo);
+    free(baldes);
+    free(crudos);
+    free(ocupadas);
+}
+
+// Sesgo: que tan lejos de 1/2 esta la frecuencia de cada bit de salida.
+// Avalancha: al invertir un bit de entrada, cada bit de salida deberia
+// cambiar con probabilidad 1/2.
+static void medir_bits(const candidata_t *candidata, const corpus_t *corpus, const unsigned long *hashes)
+{
+    size_t unos[BITS_HASH] = {0};
+    size_t cambios[BITS_HASH] = {0};
+    size_t inversiones = 0;
+    size_t muestra = corpus->cantidad < MUESTRA_AVALANCHA ? corpus->cantidad : MUESTRA_AVALANCHA;
+    size_t paso = corpus->cantidad / (muestra ? muestra : 1);
+    char clave[256];
+
+    for (size_t m = 0; m < muestra; m++) {
+        size_t i = m * paso;
+        for (size_t b = 0; b < BITS_HASH; b++)
+            unos[b] += (hashes[i] >> b) & 1;
+
+        size_t largo = strlen(corpus->claves[i]);
+        if (largo >= sizeof(clave)) continue;
+        memcpy(clave, corpus->claves[i], largo + 1);
+        for (size_t byte = 0; byte < largo; byte++) {
+            for (int bit = 0; bit < 8; bit++) {
+                clave[byte] = (char) (clave[byte] ^ (1 << bit));
+                // Un '\0' acortaria la clave: no es una inversion de un bit
+                if (clave[byte]) {
+                    unsigned long diferencia = hashes[i] ^ candidata->funcion(clave);
+                    for (size_t b = 0; b < BITS_HASH; b++)
+                        cambios[b] += (diferencia >> b) & 1;
+                    inversiones++;
+                }
+                clave[byte] = (char) (clave[byte] ^ (1 << bit));
+            }
+        }
+    }
+
+    double sesgo_maximo = 0, avalancha_maxima = 0, avalancha_media = 0;
+    for (size_t b = 0; b < BITS_HASH; b++) {
+        double sesgo = fabs((double) unos[b] / (double) (muestra ? muestra : 1) - 0.5);
+        double avalancha = fabs((double) cambios[b] / (double) (inversiones ? inversiones : 1) - 0.5);
+        if (sesgo > sesgo_maximo) sesgo_maximo = sesgo;
+        if (avalancha > avalancha_maxima) avalancha_maxima = avalancha;
+        avalancha_media += avalancha / (double) BITS_HASH;
+    }
+    printf("  sesgo_bits_max %.4f  avalancha_desvio_medio %.4f  avalancha_desvio_max %.4f\n",
+           sesgo_maximo, avalancha_media, avalancha_maxima);
+}
+
+static double segundos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void medir_rendimiento(const candidata_t *candidata, const corpus_t *corpus)
+{
+    volatile unsigned long sumidero = 0;
+    size_t vueltas = 0;
+    double inicio = segundos(), transcurrido;
+    do {
+        unsigned long acumulado = 0;
+        for (size_t i = 0; i < corpus->cantidad; i++)
+            acumulado += candidata->funcion(corpus->claves[i]);
+        sumidero += acumulado;
+        vueltas++;
+        transcurrido = segundos() - inicio;
+    } while (transcurrido < SEGUNDOS_RENDIMIENTO);
+
+    double bytes = (double) corpus->bytes * (double) vueltas;
+    double claves = (double) corpus->cantidad * (double) vueltas;
+    printf("  rendimiento %.3f GB/s  %.1f Mclaves/s\n", bytes / transcurrido / 1e9, claves / transcurrido / 1e6);
+}
+
+/* ******************************************************************
+ *                     PROGRAMA PRINCIPAL
+ * *****************************************************************/
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Uso: %s corpus.txt\n", argv[0]);
+        return 1;
+    }
+
+    corpus_t corpus = {0};
+    if (!corpus_cargar(&corpus, argv[1]) || !corpus.cantidad) {
+        fprintf(stderr, "%s: no se pudo cargar el corpus\n", argv[1]);
+        return 1;
+    }
+
+    unsigned long *hashes = malloc(corpus.cantidad * sizeof(unsigned long));
+    if (!hashes) return 1;
+
+    printf("corpus %s: %zu claves, %zu bytes\n", argv[1], corpus.cantidad, corpus.bytes);
+    for (size_t c = 0; c < sizeof(CANDIDATAS) / sizeof(CANDIDATAS[0]); c++) {
+        const candidata_t *candidata = &CANDIDATAS[c];
+        for (size_t i = 0; i < corpus.cantidad; i++)
+            hashes[i] = candidata->funcion(corpus.claves[i]);
+
+        printf("\n%s\n", candidata->nombre);
+        // La misma secuencia de capacidades que recorre la tabla al crecer
+        for (size_t capacidad = CAPACIDAD_INICIAL; capacidad <= 4 * corpus.cantidad; capacidad *= FACTOR_REDIMENSION)
+            medir_distribucion(hashes, corpus.cantidad, capacidad);
+        medir_bits(candidata, &corpus, hashes);
+        medir_rendimiento(candidata, &corpus);
+    }
+
+    free(hashes);
+    free(corpus.claves);
+    free(corpus.texto);
+    return 0;
+}
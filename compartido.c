@@ -0,0 +1,236 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // MADV_HUGEPAGE
+#include "compartido.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Definicion de constantes
+
+#define MAGIA_COMPARTIDO 0x3130504d4f434853ULL // "SHCOMP01"
+#define RANURA_VACIA 0
+#define RANURA_BORRADA 1 // ningun registro empieza antes del encabezado
+#define ALINEACION_REGISTRO 8
+#define LARGO_MAXIMO UINT32_MAX
+
+// Funciones de hash de la tabla, definidas en hash.c
+unsigned long f_hash(const char* str);
+uint64_t hash_mezclar(unsigned long h);
+
+// Definicion de la region: el encabezado, las ranuras (sondeo lineal sobre
+// una potencia de 2) y el area de registros, que solo crece. Los campos
+// que lee un lector mientras el escritor trabaja se leen y escriben de
+// forma atomica.
+
+typedef struct encabezado_compartido {
+    uint64_t magia;     // se publica al terminar de crear la region
+    uint64_t tamanio;   // bytes de la region
+    uint64_t ranuras;
+    uint64_t maximo;    // ranuras que se pueden ocupar, para que el sondeo corte
+    uint64_t ocupadas;  // con una clave o borradas; solo las usa el escritor
+    uint64_t cantidad;
+    uint64_t registros; // desplazamiento del area de registros
+    uint64_t usado;     // desplazamiento del proximo registro; solo lo usa el escritor
+} encabezado_compartido_t;
+
+typedef struct ranura {
+    uint64_t hash;
+    uint64_t registro; // desplazamiento del registro, RANURA_VACIA o RANURA_BORRADA
+} ranura_t;
+
+typedef struct registro_compartido {
+    uint32_t largo_clave;
+    uint32_t largo_valor;
+    char datos[]; // la clave, su 0 y el valor, alineado a ALINEACION_REGISTRO
+} registro_compartido_t;
+
+struct compartido {
+    char* base;
+    size_t tamanio;
+    bool escritor;
+};
+
+// Funciones auxiliares
+
+size_t compartido_alinear(size_t bytes) {
+    return (bytes + ALINEACION_REGISTRO - 1) / ALINEACION_REGISTRO * ALINEACION_REGISTRO;
+}
+
+// Desplazamiento del valor dentro de los datos del registro
+size_t compartido_valor(size_t largo_clave) {
+    return compartido_alinear(sizeof(registro_compartido_t) + largo_clave + 1) - sizeof(registro_compartido_t);
+}
+
+encabezado_compartido_t* compartido_encabezado(const compartido_t* compartido) {
+    return (encabezado_compartido_t*)compartido->base;
+}
+
+ranura_t* compartido_ranuras(const compartido_t* compartido) {
+    return (ranura_t*)(compartido->base + sizeof(encabezado_compartido_t));
+}
+
+// Devuelve el registro de la clave, o NULL si no esta. En ranura deja la de
+// la clave o, si no esta, la vacia donde termino el sondeo. Las ranuras
+// borradas no se reusan: su registro puede seguir en manos de un lector.
+const registro_compartido_t* compartido_sondear(const compartido_t* compartido, const char* clave, uint64_t h, ranura_t** ranura) {
+    const encabezado_compartido_t* encabezado = compartido_encabezado(compartido);
+    ranura_t* ranuras = compartido_ranuras(compartido);
+    size_t mascara = (size_t)encabezado->ranuras - 1;
+    size_t largo = strlen(clave);
+    for (size_t i = (size_t)h & mascara; ; i = (i + 1) & mascara) {
+        uint64_t desplazamiento = __atomic_load_n(&ranuras[i].registro, __ATOMIC_ACQUIRE);
+        *ranura = &ranuras[i];
+        if ( desplazamiento == RANURA_VACIA )
+            return NULL;
+        // El hash se escribe antes de publicar la ranura y no cambia
+        if ( desplazamiento == RANURA_BORRADA || ranuras[i].hash != h )
+            continue;
+        const registro_compartido_t* registro = (const void*)(compartido->base + desplazamiento);
+        if ( registro->largo_clave == largo && memcmp(registro->datos, clave, largo) == 0 )
+            return registro;
+    }
+}
+
+// Mapea la region y cierra el descriptor, que ya no hace falta
+compartido_t* compartido_mapear(int fd, size_t tamanio, bool escritor) {
+    compartido_t* compartido = malloc(sizeof(compartido_t));
+    void* base = compartido ? mmap(NULL, tamanio, escritor ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if ( base == MAP_FAILED ) {
+        free(compartido);
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    // Solo tiene efecto si el sistema habilita paginas grandes en shmem
+    madvise(base, tamanio, MADV_HUGEPAGE);
+#endif
+    compartido->base = base;
+    compartido->tamanio = tamanio;
+    compartido->escritor = escritor;
+    return compartido;
+}
+
+// Primitivas del compartido
+
+compartido_t* compartido_crear(const char* nombre, size_t capacidad, size_t bytes) {
+    uint64_t ranuras = 1;
+    while ( ranuras < capacidad + capacidad / 2 + 1 )
+        ranuras *= 2;
+    size_t registros = sizeof(encabezado_compartido_t) + (size_t)ranuras * sizeof(ranura_t);
+    size_t tamanio = registros + bytes;
+
+    int fd = shm_open(nombre, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if ( fd < 0 )
+        return NULL;
+    // La region nueva esta en cero: todas las ranuras vacias
+    if ( ftruncate(fd, (off_t)tamanio) != 0 ) {
+        close(fd);
+        shm_unlink(nombre);
+        return NULL;
+    }
+    compartido_t* compartido = compartido_mapear(fd, tamanio, true);
+    if ( !compartido ) {
+        shm_unlink(nombre);
+        return NULL;
+    }
+    encabezado_compartido_t* encabezado = compartido_encabezado(compartido);
+    encabezado->tamanio = tamanio;
+    encabezado->ranuras = ranuras;
+    encabezado->maximo = capacidad;
+    encabezado->registros = registros;
+    encabezado->usado = registros;
+    __atomic_store_n(&encabezado->magia, MAGIA_COMPARTIDO, __ATOMIC_RELEASE);
+    return compartido;
+}
+
+compartido_t* compartido_abrir(const char* nombre) {
+    int fd = shm_open(nombre, O_RDONLY, 0);
+    if ( fd < 0 )
+        return NULL;
+    struct stat estado;
+    if ( fstat(fd, &estado) != 0 || (size_t)estado.st_size < sizeof(encabezado_compartido_t) ) {
+        close(fd);
+        return NULL;
+    }
+    compartido_t* compartido = compartido_mapear(fd, (size_t)estado.st_size, false);
+    if ( !compartido )
+        return NULL;
+    const encabezado_compartido_t* encabezado = compartido_encabezado(compartido);
+    if ( __atomic_load_n(&encabezado->magia, __ATOMIC_ACQUIRE) != MAGIA_COMPARTIDO || encabezado->tamanio != compartido->tamanio ) {
+        compartido_cerrar(compartido);
+        return NULL;
+    }
+    return compartido;
+}
+
+bool compartido_guardar(compartido_t* compartido, const char* clave, const void* valor, size_t largo) {
+    size_t largo_clave = strlen(clave);
+    if ( !compartido->escritor || largo_clave >= LARGO_MAXIMO || largo >= LARGO_MAXIMO )
+        return false;
+    encabezado_compartido_t* encabezado = compartido_encabezado(compartido);
+    size_t tamanio = compartido_alinear(sizeof(registro_compartido_t) + compartido_valor(largo_clave) + largo);
+    if ( encabezado->usado + tamanio > encabezado->tamanio )
+        return false;
+
+    uint64_t h = hash_mezclar(f_hash(clave));
+    ranura_t* ranura;
+    bool existia = compartido_sondear(compartido, clave, h, &ranura);
+    if ( !existia && encabezado->ocupadas >= encabezado->maximo )
+        return false;
+
+    // El registro queda completo antes de que un lector pueda llegar a el
+    uint64_t desplazamiento = encabezado->usado;
+    registro_compartido_t* registro = (void*)(compartido->base + desplazamiento);
+    registro->largo_clave = (uint32_t)largo_clave;
+    registro->largo_valor = (uint32_t)largo;
+    memcpy(registro->datos, clave, largo_clave + 1);
+    if ( largo )
+        memcpy(registro->datos + compartido_valor(largo_clave), valor, largo);
+    encabezado->usado += tamanio;
+
+    if ( !existia ) {
+        ranura->hash = h;
+        encabezado->ocupadas++;
+        __atomic_store_n(&encabezado->cantidad, encabezado->cantidad + 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&ranura->registro, desplazamiento, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool compartido_borrar(compartido_t* compartido, const char* clave) {
+    if ( !compartido->escritor )
+        return false;
+    ranura_t* ranura;
+    if ( !compartido_sondear(compartido, clave, hash_mezclar(f_hash(clave)), &ranura) )
+        return false;
+    encabezado_compartido_t* encabezado = compartido_encabezado(compartido);
+    __atomic_store_n(&ranura->registro, RANURA_BORRADA, __ATOMIC_RELEASE);
+    __atomic_store_n(&encabezado->cantidad, encabezado->cantidad - 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+const void* compartido_obtener(const compartido_t* compartido, const char* clave, size_t* largo) {
+    ranura_t* ranura;
+    const registro_compartido_t* registro = compartido_sondear(compartido, clave, hash_mezclar(f_hash(clave)), &ranura);
+    if ( !registro )
+        return NULL;
+    *largo = registro->largo_valor;
+    return registro->datos + compartido_valor(registro->largo_clave);
+}
+
+size_t compartido_cantidad(const compartido_t* compartido) {
+    return (size_t)__atomic_load_n(&compartido_encabezado(compartido)->cantidad, __ATOMIC_RELAXED);
+}
+
+void compartido_cerrar(compartido_t* compartido) {
+    munmap(compartido->base, compartido->tamanio);
+    free(compartido);
+}
+
+bool compartido_eliminar(const char* nombre) {
+    return shm_unlink(nombre) == 0;
+}
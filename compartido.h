@@ -0,0 +1,68 @@
+#ifndef COMPARTIDO_H
+#define COMPARTIDO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* ******************************************************************
+ *                DEFINICION DE LOS TIPOS DE DATOS
+ * ******************************************************************/
+
+// Diccionario de claves a valores de bytes dentro de una region de memoria
+// compartida POSIX (shm_open + mmap), para que varios procesos usen una sola
+// copia. Adentro no hay punteros: las ranuras y los registros se ubican por
+// su desplazamiento desde el comienzo de la region, que cada proceso mapea
+// en una direccion distinta.
+//
+// Hay un solo escritor, el proceso que la crea, y cualquier cantidad de
+// lectores que se adjuntan por nombre sin bloqueos. Cada registro (clave y
+// valor) se escribe completo antes de publicarlo en su ranura, y nunca se
+// modifica ni se libera: reemplazar o borrar solo cambia la ranura, de modo
+// que un lector ve el valor anterior o el nuevo, siempre entero.
+typedef struct compartido compartido_t;
+
+/* ******************************************************************
+ *                    PRIMITIVAS DEL COMPARTIDO
+ * ******************************************************************/
+
+// Crea la region nombre (que empieza con '/') con lugar para capacidad
+// claves y bytes bytes de registros, y la abre como escritor. La region
+// tiene tamanio fijo: los reemplazos y borrados no devuelven sus bytes.
+// Post: devuelve el diccionario, o NULL si la region ya existe o no se pudo
+// crear.
+compartido_t* compartido_crear(const char* nombre, size_t capacidad, size_t bytes);
+
+// Se adjunta como lector a una region creada con compartido_crear. No
+// copia nada: las paginas se comparten con los demas procesos.
+// Post: devuelve el diccionario, o NULL si la region no existe o todavia
+// no termino de crearse.
+compartido_t* compartido_abrir(const char* nombre);
+
+// Guarda una copia del valor, reemplazando el anterior si la clave estaba.
+// Devuelve false si no hay lugar, o si el diccionario se abrio como lector.
+// Pre: el diccionario fue creado.
+bool compartido_guardar(compartido_t* compartido, const char* clave, const void* valor, size_t largo);
+
+// Quita la clave. Devuelve false si no estaba o si el diccionario se abrio
+// como lector.
+// Pre: el diccionario fue creado.
+bool compartido_borrar(compartido_t* compartido, const char* clave);
+
+// Devuelve el valor de la clave y su largo, o NULL si no esta. El valor
+// esta alineado a 8 bytes y vale mientras el diccionario este abierto.
+// Pre: el diccionario fue creado o abierto.
+const void* compartido_obtener(const compartido_t* compartido, const char* clave, size_t* largo);
+
+// Devuelve la cantidad de claves.
+// Pre: el diccionario fue creado o abierto.
+size_t compartido_cantidad(const compartido_t* compartido);
+
+// Desmapea la region. Sigue existiendo para los demas procesos.
+// Pre: el diccionario fue creado o abierto.
+void compartido_cerrar(compartido_t* compartido);
+
+// Borra la region nombre; los procesos que la tienen abierta la siguen
+// usando hasta cerrarla. Devuelve false si no existia.
+bool compartido_eliminar(const char* nombre);
+
+#endif // COMPARTIDO_H
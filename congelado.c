@@ -0,0 +1,305 @@
+#include "congelado.h"
+#include <stdint.h>
+#include <string.h>
+
+// Definicion de constantes
+
+#define CLAVES_POR_BALDE 5
+#define MAX_PILOTO (1 << 20)
+#define MAX_SEMILLAS 16
+#define BITS_PALABRA 64
+
+// Definicion de la estructura congelado
+
+struct congelado {
+    allocador_t allocador;
+    size_t cantidad;
+    size_t posiciones;      // algo mas que cantidad, para que los pilotos se encuentren rapido
+    size_t cantidad_baldes;
+    uint64_t semilla;
+    uint32_t* pilotos;
+    size_t* libres;         // a que posicion de [0, cantidad) va cada posicion >= cantidad
+    size_t* desplazamientos; // inicio de cada clave en claves; hay cantidad + 1
+    char* claves;
+    void** datos;
+    size_t memoria;
+};
+
+// Funciones auxiliares
+
+// Finalizador de MurmurHash3
+uint64_t congelado_mezclar(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Hash de 64 bits con semilla, de a 8 bytes
+uint64_t congelado_hash(const char* clave, size_t largo, uint64_t semilla) {
+    uint64_t h = semilla ^ (largo * 0x9e3779b97f4a7c15ULL);
+    uint64_t bloque;
+    while ( largo >= sizeof(bloque) ) {
+        memcpy(&bloque, clave, sizeof(bloque));
+        h = (h ^ congelado_mezclar(bloque)) * 0x9e3779b97f4a7c15ULL;
+        clave += sizeof(bloque);
+        largo -= sizeof(bloque);
+    }
+    bloque = 0;
+    memcpy(&bloque, clave, largo);
+    return congelado_mezclar(h ^ bloque);
+}
+
+size_t congelado_posicion(const congelado_t* congelado, uint64_t h, uint32_t piloto) {
+    return (size_t)(congelado_mezclar(h ^ congelado_mezclar((uint64_t)piloto + 1)) % congelado->posiciones);
+}
+
+void* congelado_pedir(congelado_t* congelado, size_t tamanio) {
+    void* ptr = allocador_pedir(&congelado->allocador, tamanio ? tamanio : 1);
+    if ( ptr )
+        congelado->memoria += tamanio;
+    return ptr;
+}
+
+// Memoria temporal de la construccion
+typedef struct construccion {
+    uint64_t* hashes;    // por clave
+    size_t* orden;       // claves agrupadas por balde
+    size_t* inicios;     // inicio de cada balde en orden, hay cantidad_baldes + 1
+    size_t* baldes;      // baldes de mayor a menor
+    uint64_t* ocupadas;  // mapa de bits de las posiciones
+    size_t* ubicadas;    // posicion final de cada clave
+} construccion_t;
+
+bool construccion_pedir(const congelado_t* congelado, construccion_t* construccion) {
+    const allocador_t* allocador = &congelado->allocador;
+    size_t palabras = congelado->posiciones / BITS_PALABRA + 1;
+    construccion->hashes = allocador_pedir(allocador, congelado->cantidad * sizeof(uint64_t) + 1);
+    construccion->orden = allocador_pedir(allocador, congelado->cantidad * sizeof(size_t) + 1);
+    construccion->inicios = allocador_pedir(allocador, (congelado->cantidad_baldes + 1) * sizeof(size_t));
+    construccion->baldes = allocador_pedir(allocador, congelado->cantidad_baldes * sizeof(size_t));
+    construccion->ocupadas = allocador_pedir(allocador, palabras * sizeof(uint64_t));
+    construccion->ubicadas = allocador_pedir(allocador, congelado->cantidad * sizeof(size_t) + 1);
+    return construccion->hashes && construccion->orden && construccion->inicios &&
+           construccion->baldes && construccion->ocupadas && construccion->ubicadas;
+}
+
+void construccion_liberar(const congelado_t* congelado, construccion_t* construccion) {
+    const allocador_t* allocador = &congelado->allocador;
+    void* bloques[] = {
+        construccion->hashes, construccion->orden, construccion->inicios,
+        construccion->baldes, construccion->ocupadas, construccion->ubicadas
+    };
+    for (size_t i = 0; i < sizeof(bloques) / sizeof(bloques[0]); i++) {
+        if ( bloques[i] )
+            allocador_liberar(allocador, bloques[i]);
+    }
+}
+
+// Agrupa las claves por balde y ordena los baldes de mayor a menor, ambos
+// por conteo: los baldes grandes son los dificiles y van primero
+void construccion_agrupar(const congelado_t* congelado, construccion_t* construccion) {
+    size_t cantidad_baldes = congelado->cantidad_baldes;
+    size_t* inicios = construccion->inicios;
+    memset(inicios, 0, (cantidad_baldes + 1) * sizeof(size_t));
+    for (size_t i = 0; i < congelado->cantidad; i++)
+        inicios[construccion->hashes[i] % cantidad_baldes + 1]++;
+    size_t mayor = 0;
+    for (size_t b = 0; b < cantidad_baldes; b++) {
+        if ( inicios[b + 1] > mayor )
+            mayor = inicios[b + 1];
+        inicios[b + 1] += inicios[b];
+    }
+    for (size_t i = 0; i < congelado->cantidad; i++) {
+        size_t b = construccion->hashes[i] % cantidad_baldes;
+        // inicios[b] avanza mientras se llena el balde; se restaura abajo
+        construccion->orden[inicios[b]++] = i;
+    }
+    for (size_t b = cantidad_baldes; b > 0; b--)
+        inicios[b] = inicios[b - 1];
+    inicios[0] = 0;
+
+    size_t n = 0;
+    for (size_t tamanio = mayor; tamanio > 0; tamanio--) {
+        for (size_t b = 0; b < cantidad_baldes; b++) {
+            if ( inicios[b + 1] - inicios[b] == tamanio )
+                construccion->baldes[n++] = b;
+        }
+    }
+    for (size_t b = 0; b < cantidad_baldes && n < cantidad_baldes; b++) {
+        if ( inicios[b + 1] == inicios[b] )
+            construccion->baldes[n++] = b;
+    }
+}
+
+bool posicion_ocupada(const uint64_t* ocupadas, size_t posicion) {
+    return ocupadas[posicion / BITS_PALABRA] >> (posicion % BITS_PALABRA) & 1;
+}
+
+// Busca un piloto para cada balde. Devuelve false si algun balde no tiene
+// piloto, por ejemplo porque dos claves comparten el hash de 64 bits.
+bool construccion_ubicar(congelado_t* congelado, construccion_t* construccion) {
+    size_t palabras = congelado->posiciones / BITS_PALABRA + 1;
+    memset(construccion->ocupadas, 0, palabras * sizeof(uint64_t));
+    for (size_t n = 0; n < congelado->cantidad_baldes; n++) {
+        size_t b = construccion->baldes[n];
+        size_t inicio = construccion->inicios[b];
+        size_t fin = construccion->inicios[b + 1];
+        congelado->pilotos[b] = 0;
+        if ( inicio == fin )
+            continue;
+
+        bool ubicado = false;
+        for (uint32_t piloto = 0; piloto < MAX_PILOTO && !ubicado; piloto++) {
+            ubicado = true;
+            for (size_t k = inicio; k < fin && ubicado; k++) {
+                size_t clave = construccion->orden[k];
+                size_t posicion = congelado_posicion(congelado, construccion->hashes[clave], piloto);
+                ubicado = !posicion_ocupada(construccion->ocupadas, posicion);
+                for (size_t j = inicio; j < k && ubicado; j++)
+                    ubicado = construccion->ubicadas[construccion->orden[j]] != posicion;
+                construccion->ubicadas[clave] = posicion;
+            }
+            if ( ubicado )
+                congelado->pilotos[b] = piloto;
+        }
+        if ( !ubicado )
+            return false;
+        for (size_t k = inicio; k < fin; k++) {
+            size_t posicion = construccion->ubicadas[construccion->orden[k]];
+            construccion->ocupadas[posicion / BITS_PALABRA] |= (uint64_t)1 << (posicion % BITS_PALABRA);
+        }
+    }
+    return true;
+}
+
+// Las posiciones ocupadas fuera de [0, cantidad) se llevan a los huecos que
+// quedaron adentro, asi la funcion es minima
+void construccion_completar(congelado_t* congelado, construccion_t* construccion) {
+    size_t hueco = 0;
+    for (size_t posicion = congelado->cantidad; posicion < congelado->posiciones; posicion++) {
+        if ( !posicion_ocupada(construccion->ocupadas, posicion) )
+            continue;
+        while ( posicion_ocupada(construccion->ocupadas, hueco) )
+            hueco++;
+        congelado->libres[posicion - congelado->cantidad] = hueco++;
+    }
+    for (size_t i = 0; i < congelado->cantidad; i++) {
+        size_t posicion = construccion->ubicadas[i];
+        if ( posicion >= congelado->cantidad )
+            construccion->ubicadas[i] = congelado->libres[posicion - congelado->cantidad];
+    }
+}
+
+// Copia claves y datos en el orden de sus posiciones
+void construccion_empaquetar(congelado_t* congelado, construccion_t* construccion, const char** claves, void** datos) {
+    size_t* desplazamientos = congelado->desplazamientos;
+    for (size_t i = 0; i < congelado->cantidad; i++)
+        desplazamientos[construccion->ubicadas[i] + 1] = strlen(claves[i]) + 1;
+    desplazamientos[0] = 0;
+    for (size_t p = 0; p < congelado->cantidad; p++)
+        desplazamientos[p + 1] += desplazamientos[p];
+    for (size_t i = 0; i < congelado->cantidad; i++) {
+        size_t p = construccion->ubicadas[i];
+        memcpy(congelado->claves + desplazamientos[p], claves[i], desplazamientos[p + 1] - desplazamientos[p]);
+        congelado->datos[p] = datos[i];
+    }
+}
+
+// Primitivas del congelado
+
+congelado_t* congelado_crear(const char** claves, void** datos, size_t cantidad, const allocador_t* allocador) {
+    congelado_t* congelado = allocador_pedir(allocador, sizeof(congelado_t));
+    if ( !congelado )
+        return NULL;
+    memset(congelado, 0, sizeof(congelado_t));
+    congelado->allocador = *allocador;
+    congelado->memoria = sizeof(congelado_t);
+    congelado->cantidad = cantidad;
+    congelado->posiciones = cantidad + cantidad / 100 + 1;
+    congelado->cantidad_baldes = cantidad / CLAVES_POR_BALDE + 1;
+
+    size_t bytes_claves = 0;
+    for (size_t i = 0; i < cantidad; i++)
+        bytes_claves += strlen(claves[i]) + 1;
+    congelado->pilotos = congelado_pedir(congelado, congelado->cantidad_baldes * sizeof(uint32_t));
+    congelado->libres = congelado_pedir(congelado, (congelado->posiciones - cantidad) * sizeof(size_t));
+    congelado->desplazamientos = congelado_pedir(congelado, (cantidad + 1) * sizeof(size_t));
+    congelado->claves = congelado_pedir(congelado, bytes_claves);
+    congelado->datos = congelado_pedir(congelado, cantidad * sizeof(void*));
+
+    // En cero, para liberar lo que se haya pedido si construccion_pedir falla
+    // a mitad de camino
+    construccion_t construccion;
+    memset(&construccion, 0, sizeof(construccion_t));
+    bool ok = congelado->pilotos && congelado->libres && congelado->desplazamientos &&
+              congelado->claves && congelado->datos && construccion_pedir(congelado, &construccion);
+    bool ubicado = false;
+    for (size_t intento = 0; ok && !ubicado && intento < MAX_SEMILLAS; intento++) {
+        congelado->semilla = congelado_mezclar(intento + 0x5851f42d4c957f2dULL);
+        for (size_t i = 0; i < cantidad; i++)
+            construccion.hashes[i] = congelado_hash(claves[i], strlen(claves[i]), congelado->semilla);
+        construccion_agrupar(congelado, &construccion);
+        ubicado = construccion_ubicar(congelado, &construccion);
+    }
+    if ( ok && ubicado ) {
+        construccion_completar(congelado, &construccion);
+        construccion_empaquetar(congelado, &construccion, claves, datos);
+    }
+    construccion_liberar(congelado, &construccion);
+    if ( !ok || !ubicado ) {
+        congelado_destruir(congelado, NULL);
+        return NULL;
+    }
+    return congelado;
+}
+
+size_t congelado_buscar(const congelado_t* congelado, const char* clave) {
+    if ( !congelado->cantidad )
+        return 0;
+    size_t largo = strlen(clave);
+    uint64_t h = congelado_hash(clave, largo, congelado->semilla);
+    size_t posicion = congelado_posicion(congelado, h, congelado->pilotos[h % congelado->cantidad_baldes]);
+    if ( posicion >= congelado->cantidad )
+        posicion = congelado->libres[posicion - congelado->cantidad];
+
+    size_t inicio = congelado->desplazamientos[posicion];
+    size_t largo_guardado = congelado->desplazamientos[posicion + 1] - inicio - 1;
+    if ( largo_guardado != largo || memcmp(congelado->claves + inicio, clave, largo) != 0 )
+        return congelado->cantidad;
+    return posicion;
+}
+
+size_t congelado_cantidad(const congelado_t* congelado) {
+    return congelado->cantidad;
+}
+
+const char* congelado_clave(const congelado_t* congelado, size_t posicion) {
+    return congelado->claves + congelado->desplazamientos[posicion];
+}
+
+void* congelado_dato(const congelado_t* congelado, size_t posicion) {
+    return congelado->datos[posicion];
+}
+
+size_t congelado_memoria(const congelado_t* congelado) {
+    return congelado->memoria;
+}
+
+void congelado_destruir(congelado_t* congelado, void destruir_dato(void*)) {
+    if ( destruir_dato && congelado->datos ) {
+        for (size_t i = 0; i < congelado->cantidad; i++)
+            destruir_dato(congelado->datos[i]);
+    }
+    void* bloques[] = {
+        congelado->pilotos, congelado->libres, congelado->desplazamientos,
+        congelado->claves, congelado->datos
+    };
+    for (size_t i = 0; i < sizeof(bloques) / sizeof(bloques[0]); i++) {
+        if ( bloques[i] )
+            allocador_liberar(&congelado->allocador, bloques[i]);
+    }
+    allocador_liberar(&congelado->allocador, congelado);
+}
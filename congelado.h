@@ -0,0 +1,48 @@
+#ifndef CONGELADO_H
+#define CONGELADO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "allocador.h"
+
+/* ******************************************************************
+ *                DEFINICION DE LOS TIPOS DE DATOS
+ * ******************************************************************/
+
+// Diccionario inmutable sobre una funcion de hash perfecta minima (estilo
+// PTHash): cada clave va a un balde, y un piloto por balde la desplaza a
+// una posicion unica de [0, cantidad). Las claves y los datos se guardan
+// empaquetados en el orden de esas posiciones.
+typedef struct congelado congelado_t;
+
+/* ******************************************************************
+ *                    PRIMITIVAS DEL CONGELADO
+ * ******************************************************************/
+
+// Construye el diccionario con los pares recibidos, copiando las claves.
+// Pre: las claves son distintas entre si.
+// Post: devuelve el diccionario, o NULL si no hay memoria.
+congelado_t* congelado_crear(const char** claves, void** datos, size_t cantidad, const allocador_t* allocador);
+
+// Devuelve la posicion de la clave, o cantidad si no esta. Calcula un hash,
+// un balde y una posicion, y compara una sola clave.
+// Pre: el diccionario fue creado.
+size_t congelado_buscar(const congelado_t* congelado, const char* clave);
+
+// Pre: el diccionario fue creado.
+size_t congelado_cantidad(const congelado_t* congelado);
+
+// Devuelve la clave o el dato de la posicion.
+// Pre: el diccionario fue creado y posicion < cantidad.
+const char* congelado_clave(const congelado_t* congelado, size_t posicion);
+void* congelado_dato(const congelado_t* congelado, size_t posicion);
+
+// Devuelve los bytes pedidos por el diccionario.
+// Pre: el diccionario fue creado.
+size_t congelado_memoria(const congelado_t* congelado);
+
+// Libera el diccionario, llamando a destruir_dato con cada dato si no es NULL.
+// Pre: el diccionario fue creado.
+void congelado_destruir(congelado_t* congelado, void destruir_dato(void*));
+
+#endif // CONGELADO_H
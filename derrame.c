@@ -0,0 +1,770 @@
+#define _POSIX_C_SOURCE 200809L
+#include "derrame.h"
+#include "hash.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Definicion de constantes
+
+#define DERRAME_BUFFER (64 * 1024) // por archivo: lecturas y escrituras secuenciales grandes
+#define DERRAME_LOTE 1024
+#define DERRAME_VENTANA 1024 // usos entre cada vez que las frecuencias bajan a la mitad
+#define DERRAME_CALIENTE 8 // usos recientes desde los que vale cargar una particion
+#define DERRAME_COMPACTAR (64 * 1024) // los archivos mas chicos no se compactan
+#define DERRAME_RECORRER 64 // un lote con mas de 1/64 de las claves recorre el archivo
+#define INDICE_CAPACIDAD_INICIAL 64
+#define LARGO_BORRADO UINT32_MAX
+#define DIRECTORIO_TEMPORAL "/tmp"
+
+// Funciones de hash de la tabla, definidas en hash.c
+unsigned long f_hash(const char* str);
+uint64_t hash_mezclar(unsigned long h);
+
+// Definicion de las estructuras. Los archivos son un registro de
+// escrituras: cada una es un encabezado, la clave y el valor, y la ultima
+// escritura de una clave es la que vale. Una particion residente tiene el
+// archivo vacio. Una en disco tiene ademas un indice de direccionamiento
+// abierto con la posicion de la ultima escritura de cada clave viva, para
+// leerla sin recorrer el archivo.
+
+typedef struct valor {
+    size_t largo;
+    char bytes[];
+} valor_t;
+
+typedef struct encabezado {
+    uint32_t largo_clave;
+    uint32_t largo_valor; // LARGO_BORRADO si la clave se borro
+} encabezado_t;
+
+typedef struct ubicacion {
+    uint64_t hash;
+    uint64_t desplazamiento; // del registro mas uno; 0 si la ranura esta libre
+} ubicacion_t;
+
+typedef struct particion_derrame {
+    hash_t* tabla; // NULL si la particion esta en disco
+    size_t bytes_valores;
+    FILE* archivo; // NULL hasta la primera vez que se escribe
+    size_t bytes_archivo;
+    size_t bytes_volcados; // del archivo que ya llegaron al descriptor
+    ubicacion_t* indice; // NULL si la particion esta en memoria
+    size_t capacidad_indice; // potencia de 2
+    size_t claves_en_disco;
+    size_t bytes_vivos; // de los registros a los que apunta el indice
+    size_t memoria_derramada; // con bytes_derramados, estima lo que ocuparia cargada
+    size_t bytes_derramados;
+    uint64_t acceso; // instante logico del ultimo uso
+    uint64_t frecuencia; // usos recientes
+} particion_derrame_t;
+
+struct derrame {
+    particion_derrame_t* particiones;
+    size_t cantidad_particiones;
+    size_t presupuesto;
+    size_t memoria;
+    uint64_t reloj;
+    char* directorio;
+    valor_t* leido; // el ultimo valor que se leyo de disco sin cargar su particion
+    char* clave_leida; // encabezado y clave leidos para compararla con la buscada
+    size_t capacidad_clave;
+    size_t* inicios; // cantidad_particiones + 1, para agrupar un lote
+};
+
+// Recibe cada registro de un archivo, en orden, con la clave terminada en 0
+typedef bool (*registro_visitar_t)(const encabezado_t* encabezado, const char* clave, const char* valor, void* extra);
+
+typedef struct reproduccion {
+    hash_t* tabla;
+    size_t* bytes_valores;
+    const hash_t* buscadas;
+} reproduccion_t;
+
+typedef struct compactacion {
+    const particion_derrame_t* particion;
+    size_t leidos; // del archivo anterior: donde empieza el registro que se visita
+    FILE* archivo;
+    size_t bytes_archivo;
+    uint64_t* desplazamientos; // los nuevos, por ranura del indice
+} compactacion_t;
+
+// Funciones auxiliares
+
+size_t derrame_particion(const derrame_t* derrame, const char* clave) {
+    // Los bits altos del producto mezclan todos los del hash
+    uint64_t h = ((uint64_t)f_hash(clave) * 0x9e3779b97f4a7c15ULL) >> 32;
+    return (size_t)((h * derrame->cantidad_particiones) >> 32);
+}
+
+size_t particion_memoria(const particion_derrame_t* particion) {
+    return particion->tabla ? hash_memoria(particion->tabla) + particion->bytes_valores : 0;
+}
+
+// Cada DERRAME_VENTANA usos las frecuencias bajan a la mitad, de modo que
+// miden los usos recientes
+particion_derrame_t* derrame_usar(derrame_t* derrame, size_t p) {
+    if ( ++derrame->reloj % DERRAME_VENTANA == 0 ) {
+        for (size_t q = 0; q < derrame->cantidad_particiones; q++)
+            derrame->particiones[q].frecuencia /= 2;
+    }
+    particion_derrame_t* particion = &derrame->particiones[p];
+    particion->acceso = derrame->reloj;
+    particion->frecuencia++;
+    return particion;
+}
+
+size_t largo_registro(const encabezado_t* encabezado) {
+    size_t largo_valor = encabezado->largo_valor == LARGO_BORRADO ? 0 : encabezado->largo_valor;
+    return sizeof(encabezado_t) + encabezado->largo_clave + largo_valor;
+}
+
+// Guarda una copia del valor en la tabla, liberando el anterior
+bool tabla_poner(hash_t* tabla, size_t* bytes_valores, const char* clave, const void* bytes, size_t largo) {
+    valor_t* valor = malloc(sizeof(valor_t) + largo);
+    if ( !valor )
+        return false;
+    valor->largo = largo;
+    if ( largo )
+        memcpy(valor->bytes, bytes, largo);
+    bool insertado;
+    void** dato = hash_obtener_o_insertar(tabla, clave, &insertado);
+    if ( !dato ) {
+        free(valor);
+        return false;
+    }
+    if ( !insertado ) {
+        valor_t* anterior = *dato;
+        *bytes_valores -= sizeof(valor_t) + anterior->largo;
+        free(anterior);
+    }
+    *dato = valor;
+    *bytes_valores += sizeof(valor_t) + largo;
+    return true;
+}
+
+void tabla_quitar(hash_t* tabla, size_t* bytes_valores, const char* clave) {
+    valor_t* valor = hash_borrar(tabla, clave);
+    if ( !valor )
+        return;
+    *bytes_valores -= sizeof(valor_t) + valor->largo;
+    free(valor);
+}
+
+// El archivo se borra apenas se crea: queda accesible solo por el FILE*
+FILE* derrame_archivo_temporal(const derrame_t* derrame) {
+    size_t largo = strlen(derrame->directorio) + sizeof("/derrameXXXXXX");
+    char* nombre = malloc(largo);
+    if ( !nombre )
+        return NULL;
+    snprintf(nombre, largo, "%s/derrameXXXXXX", derrame->directorio);
+    int fd = mkstemp(nombre);
+    if ( fd >= 0 )
+        unlink(nombre);
+    free(nombre);
+    if ( fd < 0 )
+        return NULL;
+    FILE* archivo = fdopen(fd, "w+");
+    if ( !archivo ) {
+        close(fd);
+        return NULL;
+    }
+    setvbuf(archivo, NULL, _IOFBF, DERRAME_BUFFER);
+    return archivo;
+}
+
+bool particion_abrir(const derrame_t* derrame, particion_derrame_t* particion) {
+    if ( !particion->archivo )
+        particion->archivo = derrame_archivo_temporal(derrame);
+    return particion->archivo;
+}
+
+// Agrega una escritura al final del archivo. largo es LARGO_BORRADO para
+// anotar un borrado.
+bool particion_escribir(const derrame_t* derrame, particion_derrame_t* particion, const char* clave, const void* bytes, uint32_t largo) {
+    size_t largo_clave = strlen(clave);
+    if ( largo_clave >= LARGO_BORRADO || !particion_abrir(derrame, particion) )
+        return false;
+    encabezado_t encabezado = { (uint32_t)largo_clave, largo };
+    size_t largo_valor = largo == LARGO_BORRADO ? 0 : largo;
+    bool ok = fwrite(&encabezado, sizeof(encabezado), 1, particion->archivo) == 1
+              && fwrite(clave, 1, largo_clave, particion->archivo) == largo_clave
+              && (!largo_valor || fwrite(bytes, 1, largo_valor, particion->archivo) == largo_valor);
+    if ( ok ) {
+        particion->bytes_archivo += sizeof(encabezado) + largo_clave + largo_valor;
+        return true;
+    }
+    // Una escritura a medias dejaria un registro cortado en el medio del
+    // archivo: se descarta volviendo al largo anterior
+    off_t largo_anterior = (off_t)particion->bytes_archivo;
+    if ( fflush(particion->archivo) == 0 && ftruncate(fileno(particion->archivo), largo_anterior) == 0 )
+        fseeko(particion->archivo, largo_anterior, SEEK_SET);
+    clearerr(particion->archivo);
+    return false;
+}
+
+// Lee del archivo sin mover la posicion de escritura y devuelve cuantos
+// bytes leyo (menos al llegar al final), o -1 si fallo. Antes vuelca el
+// buffer si lo pedido todavia no llego al descriptor.
+ssize_t particion_leer(particion_derrame_t* particion, size_t desplazamiento, void* destino, size_t largo) {
+    if ( desplazamiento + largo > particion->bytes_volcados ) {
+        if ( fflush(particion->archivo) != 0 )
+            return -1;
+        particion->bytes_volcados = particion->bytes_archivo;
+    }
+    return pread(fileno(particion->archivo), destino, largo, (off_t)desplazamiento);
+}
+
+// Deja el archivo vacio, como el de una particion residente
+bool particion_vaciar_archivo(particion_derrame_t* particion) {
+    if ( particion->archivo ) {
+        if ( fflush(particion->archivo) != 0 || ftruncate(fileno(particion->archivo), 0) != 0 )
+            return false;
+        rewind(particion->archivo);
+    }
+    particion->bytes_archivo = 0;
+    particion->bytes_volcados = 0;
+    return true;
+}
+
+// Funciones auxiliares del indice
+
+uint64_t indice_hash(const char* clave) {
+    return hash_mezclar(f_hash(clave));
+}
+
+void indice_vaciar(particion_derrame_t* particion) {
+    free(particion->indice);
+    particion->indice = NULL;
+    particion->capacidad_indice = 0;
+    particion->claves_en_disco = 0;
+    particion->bytes_vivos = 0;
+}
+
+// Agranda el indice para que entren claves sin pasar 2/3 de carga. Las
+// posiciones se reubican por su hash, sin leer el archivo.
+bool indice_reservar(particion_derrame_t* particion, size_t claves) {
+    size_t capacidad = particion->capacidad_indice ? particion->capacidad_indice : INDICE_CAPACIDAD_INICIAL;
+    while ( claves * 3 > capacidad * 2 )
+        capacidad *= 2;
+    if ( capacidad == particion->capacidad_indice )
+        return true;
+    ubicacion_t* indice = calloc(capacidad, sizeof(ubicacion_t));
+    if ( !indice )
+        return false;
+    for (size_t i = 0; i < particion->capacidad_indice; i++) {
+        const ubicacion_t* ubicacion = &particion->indice[i];
+        if ( !ubicacion->desplazamiento )
+            continue;
+        size_t j = ubicacion->hash & (capacidad - 1);
+        while ( indice[j].desplazamiento )
+            j = (j + 1) & (capacidad - 1);
+        indice[j] = *ubicacion;
+    }
+    free(particion->indice);
+    particion->indice = indice;
+    particion->capacidad_indice = capacidad;
+    return true;
+}
+
+// Busca la clave en el indice. Si esta, *ranura es la suya y *encabezado
+// el de su registro; si no, *ranura es la libre donde iria. Solo se lee el
+// archivo cuando coincide el hash, y de una lectura: el encabezado y tantos
+// bytes como la clave buscada. Devuelve false si fallo una lectura.
+bool indice_buscar(derrame_t* derrame, particion_derrame_t* particion, const char* clave, size_t* ranura, encabezado_t* encabezado, bool* encontrada) {
+    *encontrada = false;
+    if ( !particion->capacidad_indice )
+        return true;
+    uint64_t hash = indice_hash(clave);
+    size_t largo_clave = strlen(clave);
+    size_t mascara = particion->capacidad_indice - 1;
+    size_t largo = sizeof(encabezado_t) + largo_clave;
+    for (size_t i = hash & mascara; particion->indice[i].desplazamiento; i = (i + 1) & mascara) {
+        const ubicacion_t* ubicacion = &particion->indice[i];
+        if ( ubicacion->hash != hash )
+            continue;
+        if ( largo > derrame->capacidad_clave ) {
+            char* clave_leida = realloc(derrame->clave_leida, largo);
+            if ( !clave_leida )
+                return false;
+            derrame->clave_leida = clave_leida;
+            derrame->capacidad_clave = largo;
+        }
+        // Un registro de clave mas corta al final del archivo se lee a medias
+        ssize_t leidos = particion_leer(particion, ubicacion->desplazamiento - 1, derrame->clave_leida, largo);
+        if ( leidos < (ssize_t)sizeof(encabezado_t) )
+            return false;
+        memcpy(encabezado, derrame->clave_leida, sizeof(encabezado_t));
+        if ( encabezado->largo_clave != largo_clave )
+            continue;
+        if ( leidos != (ssize_t)largo )
+            return false;
+        if ( memcmp(derrame->clave_leida + sizeof(encabezado_t), clave, largo_clave) == 0 ) {
+            *ranura = i;
+            *encontrada = true;
+            return true;
+        }
+    }
+    for (*ranura = hash & mascara; particion->indice[*ranura].desplazamiento; *ranura = (*ranura + 1) & mascara)
+        ;
+    return true;
+}
+
+// Libera la ranura corriendo hacia atras las que la siguen, de modo que
+// ninguna quede antes de su posicion ideal
+void indice_quitar(particion_derrame_t* particion, size_t ranura) {
+    size_t mascara = particion->capacidad_indice - 1;
+    size_t libre = ranura;
+    for (size_t i = (ranura + 1) & mascara; particion->indice[i].desplazamiento; i = (i + 1) & mascara) {
+        size_t ideal = particion->indice[i].hash & mascara;
+        if ( ((i - ideal) & mascara) >= ((i - libre) & mascara) ) {
+            particion->indice[libre] = particion->indice[i];
+            libre = i;
+        }
+    }
+    particion->indice[libre].desplazamiento = 0;
+    particion->claves_en_disco--;
+}
+
+// Lee el valor de la clave por el indice, sin cargar la particion. *valor
+// queda en NULL si la clave no esta. Devuelve false si fallo una lectura.
+bool particion_leer_valor(derrame_t* derrame, particion_derrame_t* particion, const char* clave, const valor_t** valor) {
+    size_t ranura;
+    encabezado_t encabezado;
+    bool encontrada;
+    *valor = NULL;
+    if ( !indice_buscar(derrame, particion, clave, &ranura, &encabezado, &encontrada) )
+        return false;
+    if ( !encontrada )
+        return true;
+    valor_t* leido = realloc(derrame->leido, sizeof(valor_t) + encabezado.largo_valor);
+    if ( !leido )
+        return false;
+    derrame->leido = leido;
+    leido->largo = encabezado.largo_valor;
+    size_t desplazamiento = particion->indice[ranura].desplazamiento - 1 + sizeof(encabezado) + encabezado.largo_clave;
+    if ( particion_leer(particion, desplazamiento, leido->bytes, leido->largo) != (ssize_t)leido->largo )
+        return false;
+    *valor = leido;
+    return true;
+}
+
+// Pasa por visitar cada registro del archivo, de un recorrido secuencial
+bool particion_recorrer(particion_derrame_t* particion, registro_visitar_t visitar, void* extra) {
+    FILE* archivo = particion->archivo;
+    if ( !archivo )
+        return true;
+    if ( fflush(archivo) != 0 )
+        return false;
+    particion->bytes_volcados = particion->bytes_archivo;
+    rewind(archivo);
+    char* buffer = NULL;
+    size_t capacidad = 0;
+    bool ok = true;
+    encabezado_t encabezado;
+    while ( ok && fread(&encabezado, sizeof(encabezado), 1, archivo) == 1 ) {
+        size_t largo_valor = encabezado.largo_valor == LARGO_BORRADO ? 0 : encabezado.largo_valor;
+        size_t largo = (size_t)encabezado.largo_clave + 1 + largo_valor;
+        if ( largo > capacidad ) {
+            char* nuevo = realloc(buffer, largo);
+            ok = nuevo;
+            if ( !ok )
+                break;
+            buffer = nuevo;
+            capacidad = largo;
+        }
+        // La clave queda terminada en 0 y el valor a continuacion
+        char* clave = buffer;
+        char* valor = buffer + encabezado.largo_clave + 1;
+        ok = fread(clave, 1, encabezado.largo_clave, archivo) == encabezado.largo_clave
+             && fread(valor, 1, largo_valor, archivo) == largo_valor;
+        clave[encabezado.largo_clave] = '\0';
+        ok = ok && visitar(&encabezado, clave, valor, extra);
+    }
+    free(buffer);
+    ok = ok && !ferror(archivo);
+    // Las escrituras siguientes van al final
+    return fseek(archivo, 0, SEEK_END) == 0 && ok;
+}
+
+bool registro_aplicar(const encabezado_t* encabezado, const char* clave, const char* valor, void* extra) {
+    reproduccion_t* reproduccion = extra;
+    if ( reproduccion->buscadas && !hash_pertenece(reproduccion->buscadas, clave) )
+        return true;
+    if ( encabezado->largo_valor == LARGO_BORRADO ) {
+        tabla_quitar(reproduccion->tabla, reproduccion->bytes_valores, clave);
+        return true;
+    }
+    return tabla_poner(reproduccion->tabla, reproduccion->bytes_valores, clave, valor, encabezado->largo_valor);
+}
+
+// Copia el registro al archivo nuevo si el indice apunta a el
+bool registro_conservar(const encabezado_t* encabezado, const char* clave, const char* valor, void* extra) {
+    compactacion_t* compactacion = extra;
+    const particion_derrame_t* particion = compactacion->particion;
+    size_t desplazamiento = compactacion->leidos;
+    compactacion->leidos += largo_registro(encabezado);
+    if ( encabezado->largo_valor == LARGO_BORRADO || !particion->capacidad_indice )
+        return true;
+    size_t mascara = particion->capacidad_indice - 1;
+    for (size_t i = indice_hash(clave) & mascara; particion->indice[i].desplazamiento; i = (i + 1) & mascara) {
+        if ( particion->indice[i].desplazamiento != desplazamiento + 1 )
+            continue;
+        compactacion->desplazamientos[i] = compactacion->bytes_archivo + 1;
+        compactacion->bytes_archivo += largo_registro(encabezado);
+        return fwrite(encabezado, sizeof(encabezado_t), 1, compactacion->archivo) == 1
+               && fwrite(clave, 1, encabezado->largo_clave, compactacion->archivo) == encabezado->largo_clave
+               && fwrite(valor, 1, encabezado->largo_valor, compactacion->archivo) == encabezado->largo_valor;
+    }
+    return true;
+}
+
+// Aplica las escrituras del archivo sobre tabla, en orden. Con buscadas,
+// solo las de esas claves.
+bool particion_reproducir(particion_derrame_t* particion, hash_t* tabla, size_t* bytes_valores, const hash_t* buscadas) {
+    reproduccion_t reproduccion = { tabla, bytes_valores, buscadas };
+    return particion_recorrer(particion, registro_aplicar, &reproduccion);
+}
+
+// Reescribe el archivo con solo los registros vivos, en un archivo nuevo
+// que reemplaza al anterior. Si algo falla queda el anterior, que sigue
+// siendo valido.
+void particion_compactar(derrame_t* derrame, particion_derrame_t* particion) {
+    compactacion_t compactacion = { particion, 0, derrame_archivo_temporal(derrame), 0, NULL };
+    compactacion.desplazamientos = calloc(particion->capacidad_indice, sizeof(uint64_t));
+    bool ok = compactacion.archivo && compactacion.desplazamientos
+              && particion_recorrer(particion, registro_conservar, &compactacion)
+              && fflush(compactacion.archivo) == 0
+              && compactacion.bytes_archivo == particion->bytes_vivos;
+    if ( ok ) {
+        for (size_t i = 0; i < particion->capacidad_indice; i++) {
+            if ( particion->indice[i].desplazamiento )
+                particion->indice[i].desplazamiento = compactacion.desplazamientos[i];
+        }
+        fclose(particion->archivo);
+        particion->archivo = compactacion.archivo;
+        particion->bytes_archivo = compactacion.bytes_archivo;
+        particion->bytes_volcados = compactacion.bytes_archivo;
+    } else if ( compactacion.archivo ) {
+        fclose(compactacion.archivo);
+    }
+    free(compactacion.desplazamientos);
+}
+
+// Escribe en el archivo de una particion en disco y anota la posicion en
+// el indice. El indice se agranda antes de escribir, asi despues no puede
+// fallar. Borrar una clave que no esta no escribe nada. Cuando la mitad
+// del archivo son escrituras reemplazadas, se compacta.
+bool particion_anotar(derrame_t* derrame, particion_derrame_t* particion, const char* clave, const void* bytes, uint32_t largo) {
+    size_t ranura;
+    encabezado_t anterior;
+    bool encontrada;
+    if ( !indice_reservar(particion, particion->claves_en_disco + 1)
+         || !indice_buscar(derrame, particion, clave, &ranura, &anterior, &encontrada) )
+        return false;
+    if ( !encontrada && largo == LARGO_BORRADO )
+        return true;
+    size_t desplazamiento = particion->bytes_archivo;
+    if ( !particion_escribir(derrame, particion, clave, bytes, largo) )
+        return false;
+    if ( encontrada )
+        particion->bytes_vivos -= largo_registro(&anterior);
+    if ( largo == LARGO_BORRADO ) {
+        indice_quitar(particion, ranura);
+    } else {
+        if ( !encontrada ) {
+            particion->indice[ranura].hash = indice_hash(clave);
+            particion->claves_en_disco++;
+        }
+        particion->indice[ranura].desplazamiento = desplazamiento + 1;
+        particion->bytes_vivos += particion->bytes_archivo - desplazamiento;
+    }
+    if ( particion->bytes_archivo > DERRAME_COMPACTAR && particion->bytes_archivo > 2 * particion->bytes_vivos )
+        particion_compactar(derrame, particion);
+    return true;
+}
+
+// Escribe toda la tabla en el archivo, de corrido, y la libera
+bool particion_derramar(derrame_t* derrame, particion_derrame_t* particion) {
+    hash_iter_t* iter = indice_reservar(particion, hash_cantidad(particion->tabla)) ? hash_iter_crear(particion->tabla) : NULL;
+    bool ok = iter;
+    for (; ok && !hash_iter_al_final(iter); hash_iter_avanzar(iter)) {
+        const char* clave = hash_iter_ver_actual(iter);
+        const valor_t* valor = hash_obtener(particion->tabla, clave);
+        ok = valor->largo < LARGO_BORRADO && particion_anotar(derrame, particion, clave, valor->bytes, (uint32_t)valor->largo);
+    }
+    if ( iter )
+        hash_iter_destruir(iter);
+    if ( ok && particion->archivo )
+        ok = fflush(particion->archivo) == 0;
+    if ( !ok ) {
+        // La particion sigue residente: el archivo vuelve a quedar vacio
+        particion_vaciar_archivo(particion);
+        particion->bytes_archivo = 0;
+        particion->bytes_volcados = 0;
+        indice_vaciar(particion);
+        return false;
+    }
+    particion->bytes_volcados = particion->bytes_archivo;
+    particion->memoria_derramada = particion_memoria(particion);
+    particion->bytes_derramados = particion->bytes_vivos;
+    derrame->memoria -= particion_memoria(particion);
+    hash_destruir(particion->tabla);
+    particion->tabla = NULL;
+    particion->bytes_valores = 0;
+    return true;
+}
+
+// La particion residente usada hace mas tiempo, salvo en_uso
+particion_derrame_t* derrame_victima(derrame_t* derrame, const particion_derrame_t* en_uso) {
+    particion_derrame_t* victima = NULL;
+    for (size_t p = 0; p < derrame->cantidad_particiones; p++) {
+        particion_derrame_t* particion = &derrame->particiones[p];
+        if ( particion->tabla && particion != en_uso && (!victima || particion->acceso < victima->acceso) )
+            victima = particion;
+    }
+    return victima;
+}
+
+// Derrama las particiones residentes usadas hace mas tiempo hasta volver
+// al presupuesto. La particion en uso se derrama solo si es la ultima.
+bool derrame_ajustar(derrame_t* derrame, const particion_derrame_t* en_uso) {
+    while ( derrame->memoria > derrame->presupuesto ) {
+        particion_derrame_t* victima = derrame_victima(derrame, en_uso);
+        if ( !victima )
+            victima = (particion_derrame_t*)en_uso;
+        if ( !victima || !victima->tabla || !particion_derramar(derrame, victima) )
+            return false;
+    }
+    return true;
+}
+
+// Vuelve a cargar una particion en disco si sus registros vivos entran
+// holgados en el presupuesto (la tabla ocupa mas que los registros) y si
+// vale la pena: entra sin derramar otra, o se usa bastante mas que la que
+// se derramaria. Asi las lecturas al azar no cargan y derraman particiones
+// en cada llamada. Despues derrama otras.
+bool particion_cargar(derrame_t* derrame, particion_derrame_t* particion) {
+    if ( particion->bytes_vivos > derrame->presupuesto / 2 )
+        return false;
+    // La proporcion se redondea hacia arriba: sobreestimar solo demora la carga
+    size_t estimada = particion->bytes_derramados ? (particion->memoria_derramada / particion->bytes_derramados + 1) * particion->bytes_vivos : 0;
+    if ( derrame->memoria + estimada > derrame->presupuesto ) {
+        const particion_derrame_t* victima = derrame_victima(derrame, particion);
+        if ( particion->frecuencia < DERRAME_CALIENTE || (victima && particion->frecuencia <= 2 * victima->frecuencia) )
+            return false;
+    }
+    hash_t* tabla = hash_crear(free);
+    if ( !tabla )
+        return false;
+    size_t bytes_valores = 0;
+    if ( !particion_reproducir(particion, tabla, &bytes_valores, NULL) || !particion_vaciar_archivo(particion) ) {
+        hash_destruir(tabla);
+        return false;
+    }
+    indice_vaciar(particion);
+    particion->tabla = tabla;
+    particion->bytes_valores = bytes_valores;
+    derrame->memoria += particion_memoria(particion);
+    // Si aun asi no entra, vuelve a disco ya compactada
+    derrame_ajustar(derrame, particion);
+    return particion->tabla;
+}
+
+// Busca en el archivo solo las claves pedidas, sin cargar la particion
+hash_t* particion_buscar_en_disco(particion_derrame_t* particion, const char** claves, size_t cantidad) {
+    hash_t* buscadas = hash_crear(NULL);
+    hash_t* encontradas = hash_crear(free);
+    bool ok = buscadas && encontradas;
+    for (size_t i = 0; i < cantidad && ok; i++)
+        ok = hash_guardar(buscadas, claves[i], NULL);
+    size_t bytes_valores = 0;
+    ok = ok && particion_reproducir(particion, encontradas, &bytes_valores, buscadas);
+    if ( buscadas )
+        hash_destruir(buscadas);
+    if ( !ok && encontradas ) {
+        hash_destruir(encontradas);
+        return NULL;
+    }
+    return encontradas;
+}
+
+bool derrame_guardar_en(derrame_t* derrame, size_t p, const char* clave, const void* valor, size_t largo) {
+    particion_derrame_t* particion = derrame_usar(derrame, p);
+    if ( !particion->tabla )
+        return largo < LARGO_BORRADO && particion_anotar(derrame, particion, clave, valor, (uint32_t)largo);
+    size_t antes = particion_memoria(particion);
+    bool ok = tabla_poner(particion->tabla, &particion->bytes_valores, clave, valor, largo);
+    derrame->memoria = derrame->memoria - antes + particion_memoria(particion);
+    return ok && derrame_ajustar(derrame, particion);
+}
+
+// Ordena los indices de un lote por particion. Al volver, las filas de la
+// particion p son orden[inicios[p - 1]] .. orden[inicios[p] - 1] (con
+// inicios[-1] = 0).
+void derrame_agrupar(derrame_t* derrame, const char** claves, size_t cantidad, size_t* particiones, size_t* orden) {
+    size_t* inicios = derrame->inicios;
+    for (size_t p = 0; p <= derrame->cantidad_particiones; p++)
+        inicios[p] = 0;
+    for (size_t i = 0; i < cantidad; i++) {
+        particiones[i] = derrame_particion(derrame, claves[i]);
+        inicios[particiones[i] + 1]++;
+    }
+    for (size_t p = 0; p < derrame->cantidad_particiones; p++)
+        inicios[p + 1] += inicios[p];
+    for (size_t i = 0; i < cantidad; i++)
+        orden[inicios[particiones[i]]++] = i;
+}
+
+// Primitivas del derrame
+
+derrame_t* derrame_crear(const char* directorio, size_t presupuesto, size_t particiones) {
+    if ( !particiones )
+        return NULL;
+    if ( !directorio )
+        directorio = getenv("TMPDIR") ? getenv("TMPDIR") : DIRECTORIO_TEMPORAL;
+    derrame_t* derrame = calloc(1, sizeof(derrame_t));
+    if ( !derrame )
+        return NULL;
+    derrame->particiones = calloc(particiones, sizeof(particion_derrame_t));
+    derrame->inicios = malloc((particiones + 1) * sizeof(size_t));
+    derrame->directorio = malloc(strlen(directorio) + 1);
+    derrame->cantidad_particiones = particiones;
+    derrame->presupuesto = presupuesto;
+    bool ok = derrame->particiones && derrame->inicios && derrame->directorio;
+    if ( ok )
+        strcpy(derrame->directorio, directorio);
+    for (size_t p = 0; p < particiones && ok; p++) {
+        derrame->particiones[p].tabla = hash_crear(free);
+        ok = derrame->particiones[p].tabla;
+        if ( ok )
+            derrame->memoria += particion_memoria(&derrame->particiones[p]);
+    }
+    if ( !ok ) {
+        derrame_destruir(derrame);
+        return NULL;
+    }
+    derrame_ajustar(derrame, NULL);
+    return derrame;
+}
+
+bool derrame_guardar(derrame_t* derrame, const char* clave, const void* valor, size_t largo) {
+    return derrame_guardar_en(derrame, derrame_particion(derrame, clave), clave, valor, largo);
+}
+
+bool derrame_guardar_lote(derrame_t* derrame, const char** claves, const void** valores, const size_t* largos, size_t cantidad) {
+    size_t particiones[DERRAME_LOTE];
+    size_t orden[DERRAME_LOTE];
+    for (size_t inicio = 0; inicio < cantidad; inicio += DERRAME_LOTE) {
+        size_t largo = cantidad - inicio < DERRAME_LOTE ? cantidad - inicio : DERRAME_LOTE;
+        derrame_agrupar(derrame, claves + inicio, largo, particiones, orden);
+        for (size_t j = 0; j < largo; j++) {
+            size_t i = inicio + orden[j];
+            if ( !derrame_guardar_en(derrame, particiones[orden[j]], claves[i], valores[i], largos[i]) )
+                return false;
+        }
+    }
+    return true;
+}
+
+bool derrame_borrar(derrame_t* derrame, const char* clave) {
+    particion_derrame_t* particion = derrame_usar(derrame, derrame_particion(derrame, clave));
+    if ( !particion->tabla )
+        return particion_anotar(derrame, particion, clave, NULL, LARGO_BORRADO);
+    size_t antes = particion_memoria(particion);
+    tabla_quitar(particion->tabla, &particion->bytes_valores, clave);
+    derrame->memoria = derrame->memoria - antes + particion_memoria(particion);
+    return true;
+}
+
+const void* derrame_obtener(derrame_t* derrame, const char* clave, size_t* largo) {
+    particion_derrame_t* particion = derrame_usar(derrame, derrame_particion(derrame, clave));
+    const valor_t* valor = NULL;
+    if ( particion->tabla || particion_cargar(derrame, particion) ) {
+        valor = hash_obtener(particion->tabla, clave);
+    } else {
+        particion_leer_valor(derrame, particion, clave, &valor);
+    }
+    if ( !valor )
+        return NULL;
+    *largo = valor->largo;
+    return valor->bytes;
+}
+
+// Agrupa todas las claves de una vez, no de a lotes: asi cada particion en
+// disco se carga o se recorre una sola vez por llamada. Si el lote trae
+// pocas claves de la particion, se leen por el indice sin recorrerla.
+bool derrame_obtener_lote(derrame_t* derrame, const char** claves, size_t cantidad, derrame_visitar_t visitar, void* extra) {
+    size_t* particiones = malloc(cantidad * sizeof(size_t));
+    size_t* orden = malloc(cantidad * sizeof(size_t));
+    const char** claves_particion = malloc(cantidad * sizeof(char*));
+    bool ok = particiones && orden && claves_particion;
+    if ( ok )
+        derrame_agrupar(derrame, claves, cantidad, particiones, orden);
+    // Cada inicio quedo en el final de su particion
+    for (size_t p = 0, desde = 0; ok && p < derrame->cantidad_particiones; desde = derrame->inicios[p++]) {
+        size_t hasta = derrame->inicios[p];
+        if ( desde == hasta )
+            continue;
+        particion_derrame_t* particion = derrame_usar(derrame, p);
+        hash_t* encontradas = NULL;
+        bool en_disco = !particion->tabla && !particion_cargar(derrame, particion);
+        if ( en_disco && (hasta - desde) * DERRAME_RECORRER < particion->claves_en_disco ) {
+            for (size_t j = desde; ok && j < hasta; j++) {
+                const valor_t* valor;
+                ok = particion_leer_valor(derrame, particion, claves[orden[j]], &valor);
+                if ( ok )
+                    visitar(claves[orden[j]], valor ? valor->bytes : NULL, valor ? valor->largo : 0, extra);
+            }
+            continue;
+        }
+        if ( en_disco ) {
+            for (size_t j = desde; j < hasta; j++)
+                claves_particion[j - desde] = claves[orden[j]];
+            encontradas = particion_buscar_en_disco(particion, claves_particion, hasta - desde);
+            ok = encontradas;
+            if ( !ok )
+                break;
+        }
+        hash_t* tabla = encontradas ? encontradas : particion->tabla;
+        for (size_t j = desde; j < hasta; j++) {
+            const valor_t* valor = hash_obtener(tabla, claves[orden[j]]);
+            visitar(claves[orden[j]], valor ? valor->bytes : NULL, valor ? valor->largo : 0, extra);
+        }
+        if ( encontradas )
+            hash_destruir(encontradas);
+    }
+    free(particiones);
+    free(orden);
+    free(claves_particion);
+    return ok;
+}
+
+size_t derrame_memoria(const derrame_t* derrame) {
+    return derrame->memoria;
+}
+
+size_t derrame_particiones_en_disco(const derrame_t* derrame) {
+    size_t en_disco = 0;
+    for (size_t p = 0; p < derrame->cantidad_particiones; p++)
+        en_disco += !derrame->particiones[p].tabla;
+    return en_disco;
+}
+
+void derrame_destruir(derrame_t* derrame) {
+    for (size_t p = 0; derrame->particiones && p < derrame->cantidad_particiones; p++) {
+        if ( derrame->particiones[p].tabla )
+            hash_destruir(derrame->particiones[p].tabla);
+        if ( derrame->particiones[p].archivo )
+            fclose(derrame->particiones[p].archivo);
+        free(derrame->particiones[p].indice);
+    }
+    free(derrame->particiones);
+    free(derrame->inicios);
+    free(derrame->directorio);
+    free(derrame->leido);
+    free(derrame->clave_leida);
+    free(derrame);
+}
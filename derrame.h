@@ -0,0 +1,79 @@
+#ifndef DERRAME_H
+#define DERRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* ******************************************************************
+ *                DEFINICION DE LOS TIPOS DE DATOS
+ * ******************************************************************/
+
+// Diccionario de claves a valores de bytes con un presupuesto de memoria.
+// Las claves se reparten en particiones segun los bits altos de su hash.
+// Cada particion esta en memoria (una tabla hash_t) o en disco (un archivo
+// con un registro de escrituras). Al pasar el presupuesto, la particion
+// residente usada hace mas tiempo se escribe entera a disco. Las escrituras
+// en una particion en disco se agregan al final de su archivo, que se
+// compacta cuando la mitad son escrituras reemplazadas. Cada particion en
+// disco lleva un indice con la posicion de cada clave (16 bytes por clave,
+// fuera del presupuesto), de modo que una lectura suelta lee solo su
+// registro. Una particion se vuelve a cargar, de un solo recorrido, si
+// entra en el presupuesto sin derramar otra o si se usa bastante mas que la
+// que se derramaria.
+typedef struct derrame derrame_t;
+
+// Recibe el valor de una clave, o NULL si no esta. valor vale solo durante
+// la llamada.
+typedef void (*derrame_visitar_t)(const char* clave, const void* valor, size_t largo, void* extra);
+
+/* ******************************************************************
+ *                    PRIMITIVAS DEL DERRAME
+ * ******************************************************************/
+
+// Crea un diccionario vacio que guarda sus particiones en archivos
+// temporales dentro de directorio (NULL usa TMPDIR o /tmp). Los archivos
+// se borran al crearlos, de modo que no quedan aunque el proceso termine
+// mal. presupuesto es el maximo de bytes de las particiones residentes.
+// Post: devuelve el diccionario, o NULL si no hay memoria o particiones es 0.
+derrame_t* derrame_crear(const char* directorio, size_t presupuesto, size_t particiones);
+
+// Guarda una copia del valor, reemplazando el anterior si la clave estaba.
+// Devuelve false si no hubo memoria o fallo la escritura.
+// Pre: el diccionario fue creado.
+bool derrame_guardar(derrame_t* derrame, const char* clave, const void* valor, size_t largo);
+
+// Guarda cantidad pares, agrupados por particion: cada particion en disco
+// recibe sus registros de una sola escritura secuencial. Devuelve false si
+// algun par no se pudo guardar; los anteriores pueden haberse guardado.
+// Pre: el diccionario fue creado.
+bool derrame_guardar_lote(derrame_t* derrame, const char** claves, const void** valores, const size_t* largos, size_t cantidad);
+
+// Quita la clave si estaba. Devuelve false si no hubo memoria o fallo la
+// escritura.
+// Pre: el diccionario fue creado.
+bool derrame_borrar(derrame_t* derrame, const char* clave);
+
+// Devuelve el valor de la clave y su largo, o NULL si no esta. El puntero
+// vale hasta la proxima operacion sobre el diccionario.
+// Pre: el diccionario fue creado.
+const void* derrame_obtener(derrame_t* derrame, const char* clave, size_t* largo);
+
+// Busca cantidad claves agrupandolas por particion, de modo que cada
+// particion en disco se lee una sola vez (o, si el lote trae pocas de sus
+// claves, solo sus registros), y llama a visitar con cada una en ese orden. Devuelve false si no hubo memoria o fallo una lectura.
+// Pre: el diccionario fue creado.
+bool derrame_obtener_lote(derrame_t* derrame, const char** claves, size_t cantidad, derrame_visitar_t visitar, void* extra);
+
+// Devuelve los bytes de las particiones residentes.
+// Pre: el diccionario fue creado.
+size_t derrame_memoria(const derrame_t* derrame);
+
+// Devuelve cuantas particiones estan en disco.
+// Pre: el diccionario fue creado.
+size_t derrame_particiones_en_disco(const derrame_t* derrame);
+
+// Libera el diccionario y cierra (y con eso borra) sus archivos.
+// Pre: el diccionario fue creado.
+void derrame_destruir(derrame_t* derrame);
+
+#endif // DERRAME_H
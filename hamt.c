@@ -0,0 +1,547 @@
+#include "hamt.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Definicion de constantes
+
+#define BITS_NIVEL 5
+#define RAMAS (1 << BITS_NIVEL)
+
+// Funcion de hash de la tabla, definida en hash.c
+unsigned long f_hash(const char* str);
+
+// Definicion de los nodos. Todos llevan un contador de referencias: la
+// cantidad de padres (o versiones, para la raiz) que apuntan al nodo.
+
+typedef enum {
+    NODO_INTERNO,
+    NODO_HOJA,
+    NODO_COLISION
+} tipo_nodo_t;
+
+typedef struct nodo {
+    tipo_nodo_t tipo;
+    size_t referencias;
+} nodo_t;
+
+typedef struct hoja {
+    nodo_t base;
+    uint64_t hash;
+    void* dato;
+    char clave[];
+} hoja_t;
+
+// Los hijos presentes estan compactados en el orden de los bits de mapa
+typedef struct interno {
+    nodo_t base;
+    uint32_t mapa;
+    nodo_t* hijos[];
+} interno_t;
+
+// Claves distintas con el mismo hash de 64 bits
+typedef struct colision {
+    nodo_t base;
+    uint64_t hash;
+    size_t cantidad;
+    hoja_t* hojas[];
+} colision_t;
+
+// Definicion de la estructura hamt: una version
+
+struct hamt {
+    interno_t* raiz;
+    size_t cantidad;
+    hash_destruir_dato_t destruir_dato;
+};
+
+typedef struct resultado {
+    bool agregado;
+    bool encontrado;
+    bool error;
+} resultado_t;
+
+// Funciones auxiliares
+
+uint64_t hamt_hash(const char* clave) {
+    uint64_t x = f_hash(clave);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+uint32_t hamt_bit(uint64_t hash, size_t nivel) {
+    return (uint32_t)1 << ((hash >> (nivel * BITS_NIVEL)) & (RAMAS - 1));
+}
+
+size_t hamt_posicion(uint32_t mapa, uint32_t bit) {
+    return (size_t)__builtin_popcount(mapa & (bit - 1));
+}
+
+size_t interno_largo(const interno_t* interno) {
+    return (size_t)__builtin_popcount(interno->mapa);
+}
+
+nodo_t* nodo_tomar(nodo_t* nodo) {
+    __atomic_add_fetch(&nodo->referencias, 1, __ATOMIC_RELAXED);
+    return nodo;
+}
+
+// Un nodo se puede modificar en el lugar si el y todos sus ancestros
+// tienen una sola referencia: ninguna otra version llega a el
+bool nodo_exclusivo(nodo_t* nodo) {
+    return __atomic_load_n(&nodo->referencias, __ATOMIC_ACQUIRE) == 1;
+}
+
+uint64_t nodo_hash(const nodo_t* nodo) {
+    if ( nodo->tipo == NODO_HOJA )
+        return ((const hoja_t*)nodo)->hash;
+    return ((const colision_t*)nodo)->hash;
+}
+
+void nodo_soltar(nodo_t* nodo, hash_destruir_dato_t destruir_dato) {
+    if ( __atomic_sub_fetch(&nodo->referencias, 1, __ATOMIC_ACQ_REL) )
+        return;
+
+    if ( nodo->tipo == NODO_HOJA ) {
+        if ( destruir_dato )
+            destruir_dato(((hoja_t*)nodo)->dato);
+    } else if ( nodo->tipo == NODO_INTERNO ) {
+        interno_t* interno = (interno_t*)nodo;
+        for (size_t i = 0; i < interno_largo(interno); i++)
+            nodo_soltar(interno->hijos[i], destruir_dato);
+    } else {
+        colision_t* colision = (colision_t*)nodo;
+        for (size_t i = 0; i < colision->cantidad; i++)
+            nodo_soltar(&colision->hojas[i]->base, destruir_dato);
+    }
+    free(nodo);
+}
+
+// Suelta una referencia a la hoja sin destruir su dato
+void hoja_soltar_sin_dato(hoja_t* hoja) {
+    nodo_soltar(&hoja->base, NULL);
+}
+
+hoja_t* hoja_crear(const char* clave, uint64_t hash, void* dato) {
+    size_t largo = strlen(clave) + 1;
+    hoja_t* hoja = malloc(sizeof(hoja_t) + largo);
+    if ( !hoja )
+        return NULL;
+    hoja->base.tipo = NODO_HOJA;
+    hoja->base.referencias = 1;
+    hoja->hash = hash;
+    hoja->dato = dato;
+    memcpy(hoja->clave, clave, largo);
+    return hoja;
+}
+
+interno_t* interno_crear(uint32_t mapa) {
+    interno_t* interno = malloc(sizeof(interno_t) + (size_t)__builtin_popcount(mapa) * sizeof(nodo_t*));
+    if ( !interno )
+        return NULL;
+    interno->base.tipo = NODO_INTERNO;
+    interno->base.referencias = 1;
+    interno->mapa = mapa;
+    return interno;
+}
+
+colision_t* colision_crear(uint64_t hash, size_t cantidad) {
+    colision_t* colision = malloc(sizeof(colision_t) + cantidad * sizeof(hoja_t*));
+    if ( !colision )
+        return NULL;
+    colision->base.tipo = NODO_COLISION;
+    colision->base.referencias = 1;
+    colision->hash = hash;
+    colision->cantidad = cantidad;
+    return colision;
+}
+
+// Copia el interno con el mapa dado, tomando una referencia a cada hijo
+// que conserva. La posicion de bit_omitido queda en NULL para que la
+// complete quien llama.
+interno_t* interno_copiar(const interno_t* interno, uint32_t mapa, uint32_t bit_omitido) {
+    interno_t* copia = interno_crear(mapa);
+    if ( !copia )
+        return NULL;
+    size_t i = 0, j = 0;
+    for (uint32_t bit = 1; bit; bit <<= 1) {
+        bool estaba = interno->mapa & bit;
+        if ( mapa & bit )
+            copia->hijos[j++] = estaba && bit != bit_omitido ? nodo_tomar(interno->hijos[i]) : NULL;
+        if ( estaba )
+            i++;
+    }
+    return copia;
+}
+
+// Crea el subarbol que separa dos nodos con hashes distintos a partir
+// del nivel dado. Toma posesion de las referencias de a y b, y si falla
+// las suelta.
+nodo_t* hamt_dividir(nodo_t* a, nodo_t* b, size_t nivel) {
+    uint32_t bit_a = hamt_bit(nodo_hash(a), nivel);
+    uint32_t bit_b = hamt_bit(nodo_hash(b), nivel);
+    interno_t* interno = interno_crear(bit_a | bit_b);
+    if ( !interno ) {
+        nodo_soltar(a, NULL);
+        nodo_soltar(b, NULL);
+        return NULL;
+    }
+
+    if ( bit_a == bit_b ) {
+        nodo_t* hijo = hamt_dividir(a, b, nivel + 1);
+        if ( !hijo ) {
+            free(interno);
+            return NULL;
+        }
+        interno->hijos[0] = hijo;
+    } else {
+        interno->hijos[bit_a < bit_b ? 0 : 1] = a;
+        interno->hijos[bit_a < bit_b ? 1 : 0] = b;
+    }
+    return &interno->base;
+}
+
+// Asociar y disociar devuelven el nodo que reemplaza a nodo. Si es el
+// mismo, se modifico en el lugar (o no hubo cambios); si es otro, trae una
+// referencia para quien llama, que debe soltar la suya al nodo viejo si a
+// su vez lo modifica en el lugar. Asociar toma la referencia de quien
+// llama a la hoja: la deja en el arbol o, si hay un error, la suelta.
+
+nodo_t* hamt_asociar(nodo_t* nodo, bool exclusivo, size_t nivel, hoja_t* hoja, resultado_t* resultado, hash_destruir_dato_t destruir_dato);
+
+nodo_t* interno_asociar(interno_t* interno, bool exclusivo, size_t nivel, hoja_t* hoja, resultado_t* resultado, hash_destruir_dato_t destruir_dato) {
+    uint32_t bit = hamt_bit(hoja->hash, nivel);
+    size_t pos = hamt_posicion(interno->mapa, bit);
+
+    // Un hijo nuevo cambia el tamanio del nodo: siempre se copia, y si era
+    // exclusivo lo libera quien llama
+    if ( !(interno->mapa & bit) ) {
+        interno_t* nuevo = interno_copiar(interno, interno->mapa | bit, bit);
+        if ( !nuevo ) {
+            hoja_soltar_sin_dato(hoja);
+            resultado->error = true;
+            return &interno->base;
+        }
+        nuevo->hijos[pos] = &hoja->base;
+        resultado->agregado = true;
+        return &nuevo->base;
+    }
+
+    nodo_t* hijo = interno->hijos[pos];
+    nodo_t* nuevo_hijo = hamt_asociar(hijo, exclusivo && nodo_exclusivo(hijo), nivel + 1, hoja, resultado, destruir_dato);
+    if ( resultado->error || nuevo_hijo == hijo )
+        return &interno->base;
+
+    if ( exclusivo ) {
+        interno->hijos[pos] = nuevo_hijo;
+        nodo_soltar(hijo, destruir_dato);
+        return &interno->base;
+    }
+    interno_t* copia = interno_copiar(interno, interno->mapa, bit);
+    if ( !copia ) {
+        nodo_soltar(nuevo_hijo, destruir_dato);
+        resultado->error = true;
+        return &interno->base;
+    }
+    copia->hijos[pos] = nuevo_hijo;
+    return &copia->base;
+}
+
+nodo_t* colision_asociar(colision_t* colision, bool exclusivo, hoja_t* hoja, resultado_t* resultado, hash_destruir_dato_t destruir_dato) {
+    size_t i = 0;
+    while ( i < colision->cantidad && strcmp(colision->hojas[i]->clave, hoja->clave) != 0 )
+        i++;
+    bool reemplazo = i < colision->cantidad;
+    resultado->agregado = !reemplazo;
+
+    if ( exclusivo && reemplazo ) {
+        hoja_t* vieja = colision->hojas[i];
+        colision->hojas[i] = hoja;
+        nodo_soltar(&vieja->base, destruir_dato);
+        return &colision->base;
+    }
+
+    size_t cantidad = colision->cantidad + (reemplazo ? 0 : 1);
+    colision_t* nueva = colision_crear(colision->hash, cantidad);
+    if ( !nueva ) {
+        hoja_soltar_sin_dato(hoja);
+        resultado->error = true;
+        return &colision->base;
+    }
+    for (size_t j = 0; j < colision->cantidad; j++)
+        nueva->hojas[j] = j == i ? hoja : (hoja_t*)nodo_tomar(&colision->hojas[j]->base);
+    if ( !reemplazo )
+        nueva->hojas[i] = hoja;
+    return &nueva->base;
+}
+
+nodo_t* hamt_asociar(nodo_t* nodo, bool exclusivo, size_t nivel, hoja_t* hoja, resultado_t* resultado, hash_destruir_dato_t destruir_dato) {
+    if ( nodo->tipo == NODO_INTERNO )
+        return interno_asociar((interno_t*)nodo, exclusivo, nivel, hoja, resultado, destruir_dato);
+
+    if ( nodo_hash(nodo) == hoja->hash ) {
+        if ( nodo->tipo == NODO_COLISION )
+            return colision_asociar((colision_t*)nodo, exclusivo, hoja, resultado, destruir_dato);
+
+        hoja_t* existente = (hoja_t*)nodo;
+        if ( strcmp(existente->clave, hoja->clave) == 0 ) {
+            resultado->agregado = false;
+            return &hoja->base;
+        }
+        colision_t* colision = colision_crear(hoja->hash, 2);
+        if ( !colision ) {
+            hoja_soltar_sin_dato(hoja);
+            resultado->error = true;
+            return nodo;
+        }
+        colision->hojas[0] = (hoja_t*)nodo_tomar(nodo);
+        colision->hojas[1] = hoja;
+        resultado->agregado = true;
+        return &colision->base;
+    }
+
+    // Dos hashes distintos en la misma rama: se separan mas abajo
+    nodo_t* rama = hamt_dividir(nodo_tomar(nodo), &hoja->base, nivel);
+    if ( !rama ) {
+        resultado->error = true;
+        return nodo;
+    }
+    resultado->agregado = true;
+    return rama;
+}
+
+// Si un interno que no es raiz quedo con un solo hijo que no es interno,
+// ese hijo ocupa su lugar. Si es una copia recien creada, se libera.
+nodo_t* interno_colapsar(interno_t* interno, size_t nivel, bool es_copia) {
+    if ( !nivel || interno_largo(interno) != 1 || interno->hijos[0]->tipo == NODO_INTERNO )
+        return &interno->base;
+    nodo_t* hijo = nodo_tomar(interno->hijos[0]);
+    if ( es_copia )
+        nodo_soltar(&interno->base, NULL);
+    return hijo;
+}
+
+nodo_t* hamt_disociar(nodo_t* nodo, bool exclusivo, size_t nivel, uint64_t hash, const char* clave, resultado_t* resultado, hash_destruir_dato_t destruir_dato);
+
+nodo_t* interno_disociar(interno_t* interno, bool exclusivo, size_t nivel, uint64_t hash, const char* clave, resultado_t* resultado, hash_destruir_dato_t destruir_dato) {
+    uint32_t bit = hamt_bit(hash, nivel);
+    if ( !(interno->mapa & bit) )
+        return &interno->base;
+    size_t pos = hamt_posicion(interno->mapa, bit);
+    nodo_t* hijo = interno->hijos[pos];
+
+    nodo_t* nuevo_hijo;
+    if ( hijo->tipo == NODO_HOJA ) {
+        hoja_t* hoja = (hoja_t*)hijo;
+        if ( hoja->hash != hash || strcmp(hoja->clave, clave) != 0 )
+            return &interno->base;
+        resultado->encontrado = true;
+        nuevo_hijo = NULL;
+    } else {
+        nuevo_hijo = hamt_disociar(hijo, exclusivo && nodo_exclusivo(hijo), nivel + 1, hash, clave, resultado, destruir_dato);
+        if ( !resultado->encontrado || resultado->error || nuevo_hijo == hijo )
+            return &interno->base;
+    }
+
+    if ( exclusivo ) {
+        if ( nuevo_hijo ) {
+            interno->hijos[pos] = nuevo_hijo;
+        } else {
+            size_t largo = interno_largo(interno);
+            memmove(&interno->hijos[pos], &interno->hijos[pos + 1], (largo - pos - 1) * sizeof(nodo_t*));
+            interno->mapa &= ~bit;
+        }
+        nodo_soltar(hijo, destruir_dato);
+        if ( nivel && !interno->mapa )
+            return NULL;
+        return interno_colapsar(interno, nivel, false);
+    }
+
+    uint32_t mapa = nuevo_hijo ? interno->mapa : interno->mapa & ~bit;
+    if ( nivel && !mapa )
+        return NULL;
+    interno_t* copia = interno_copiar(interno, mapa, bit);
+    if ( !copia ) {
+        if ( nuevo_hijo )
+            nodo_soltar(nuevo_hijo, destruir_dato);
+        resultado->error = true;
+        return &interno->base;
+    }
+    if ( nuevo_hijo )
+        copia->hijos[pos] = nuevo_hijo;
+    return interno_colapsar(copia, nivel, true);
+}
+
+nodo_t* colision_disociar(colision_t* colision, bool exclusivo, const char* clave, resultado_t* resultado, hash_destruir_dato_t destruir_dato) {
+    size_t i = 0;
+    while ( i < colision->cantidad && strcmp(colision->hojas[i]->clave, clave) != 0 )
+        i++;
+    if ( i == colision->cantidad )
+        return &colision->base;
+    resultado->encontrado = true;
+
+    if ( exclusivo ) {
+        hoja_t* hoja = colision->hojas[i];
+        colision->hojas[i] = colision->hojas[--colision->cantidad];
+        nodo_soltar(&hoja->base, destruir_dato);
+        if ( colision->cantidad == 1 )
+            return nodo_tomar(&colision->hojas[0]->base);
+        return &colision->base;
+    }
+
+    if ( colision->cantidad == 2 )
+        return nodo_tomar(&colision->hojas[1 - i]->base);
+    colision_t* nueva = colision_crear(colision->hash, colision->cantidad - 1);
+    if ( !nueva ) {
+        resultado->error = true;
+        return &colision->base;
+    }
+    for (size_t j = 0, k = 0; j < colision->cantidad; j++) {
+        if ( j != i )
+            nueva->hojas[k++] = (hoja_t*)nodo_tomar(&colision->hojas[j]->base);
+    }
+    return &nueva->base;
+}
+
+nodo_t* hamt_disociar(nodo_t* nodo, bool exclusivo, size_t nivel, uint64_t hash, const char* clave, resultado_t* resultado, hash_destruir_dato_t destruir_dato) {
+    if ( nodo->tipo == NODO_INTERNO )
+        return interno_disociar((interno_t*)nodo, exclusivo, nivel, hash, clave, resultado, destruir_dato);
+    if ( nodo->tipo == NODO_COLISION && ((colision_t*)nodo)->hash == hash )
+        return colision_disociar((colision_t*)nodo, exclusivo, clave, resultado, destruir_dato);
+    return nodo;
+}
+
+hoja_t* hamt_buscar(const hamt_t* hamt, const char* clave) {
+    uint64_t hash = hamt_hash(clave);
+    const nodo_t* nodo = &hamt->raiz->base;
+    for (size_t nivel = 0; nodo->tipo == NODO_INTERNO; nivel++) {
+        const interno_t* interno = (const interno_t*)nodo;
+        uint32_t bit = hamt_bit(hash, nivel);
+        if ( !(interno->mapa & bit) )
+            return NULL;
+        nodo = interno->hijos[hamt_posicion(interno->mapa, bit)];
+    }
+
+    if ( nodo->tipo == NODO_HOJA ) {
+        hoja_t* hoja = (hoja_t*)nodo;
+        return hoja->hash == hash && strcmp(hoja->clave, clave) == 0 ? hoja : NULL;
+    }
+    const colision_t* colision = (const colision_t*)nodo;
+    if ( colision->hash != hash )
+        return NULL;
+    for (size_t i = 0; i < colision->cantidad; i++) {
+        if ( strcmp(colision->hojas[i]->clave, clave) == 0 )
+            return colision->hojas[i];
+    }
+    return NULL;
+}
+
+bool nodo_iterar(const nodo_t* nodo, bool visitar(const char*, void*, void*), void* extra) {
+    if ( nodo->tipo == NODO_HOJA ) {
+        const hoja_t* hoja = (const hoja_t*)nodo;
+        return visitar(hoja->clave, hoja->dato, extra);
+    }
+    if ( nodo->tipo == NODO_COLISION ) {
+        const colision_t* colision = (const colision_t*)nodo;
+        for (size_t i = 0; i < colision->cantidad; i++) {
+            if ( !visitar(colision->hojas[i]->clave, colision->hojas[i]->dato, extra) )
+                return false;
+        }
+        return true;
+    }
+    const interno_t* interno = (const interno_t*)nodo;
+    for (size_t i = 0; i < interno_largo(interno); i++) {
+        if ( !nodo_iterar(interno->hijos[i], visitar, extra) )
+            return false;
+    }
+    return true;
+}
+
+// Primitivas del hamt
+
+hamt_t* hamt_crear(hash_destruir_dato_t destruir_dato) {
+    hamt_t* hamt = malloc(sizeof(hamt_t));
+    if ( !hamt )
+        return NULL;
+    hamt->raiz = interno_crear(0);
+    if ( !hamt->raiz ) {
+        free(hamt);
+        return NULL;
+    }
+    hamt->cantidad = 0;
+    hamt->destruir_dato = destruir_dato;
+    return hamt;
+}
+
+hamt_t* hamt_instantanea(const hamt_t* hamt) {
+    hamt_t* instantanea = malloc(sizeof(hamt_t));
+    if ( !instantanea )
+        return NULL;
+    instantanea->raiz = (interno_t*)nodo_tomar(&hamt->raiz->base);
+    instantanea->cantidad = hamt->cantidad;
+    instantanea->destruir_dato = hamt->destruir_dato;
+    return instantanea;
+}
+
+bool hamt_guardar(hamt_t* hamt, const char* clave, void* dato) {
+    hoja_t* hoja = hoja_crear(clave, hamt_hash(clave), dato);
+    if ( !hoja )
+        return false;
+
+    // La referencia extra mantiene viva la hoja si falla a mitad de camino:
+    // asociar ya solto la suya y al soltar esta se libera sin el dato
+    nodo_tomar(&hoja->base);
+    resultado_t resultado = { false, false, false };
+    nodo_t* raiz = &hamt->raiz->base;
+    nodo_t* nueva = hamt_asociar(raiz, nodo_exclusivo(raiz), 0, hoja, &resultado, hamt->destruir_dato);
+    hoja_soltar_sin_dato(hoja);
+    if ( resultado.error )
+        return false;
+    if ( nueva != raiz ) {
+        nodo_soltar(raiz, hamt->destruir_dato);
+        hamt->raiz = (interno_t*)nueva;
+    }
+    if ( resultado.agregado )
+        hamt->cantidad++;
+    return true;
+}
+
+bool hamt_borrar(hamt_t* hamt, const char* clave) {
+    resultado_t resultado = { false, false, false };
+    nodo_t* raiz = &hamt->raiz->base;
+    nodo_t* nueva = hamt_disociar(raiz, nodo_exclusivo(raiz), 0, hamt_hash(clave), clave, &resultado, hamt->destruir_dato);
+    if ( !resultado.encontrado || resultado.error )
+        return false;
+    if ( nueva != raiz ) {
+        nodo_soltar(raiz, hamt->destruir_dato);
+        hamt->raiz = (interno_t*)nueva;
+    }
+    hamt->cantidad--;
+    return true;
+}
+
+void* hamt_obtener(const hamt_t* hamt, const char* clave) {
+    hoja_t* hoja = hamt_buscar(hamt, clave);
+    return hoja ? hoja->dato : NULL;
+}
+
+bool hamt_pertenece(const hamt_t* hamt, const char* clave) {
+    return hamt_buscar(hamt, clave);
+}
+
+size_t hamt_cantidad(const hamt_t* hamt) {
+    return hamt->cantidad;
+}
+
+void hamt_iterar(const hamt_t* hamt, bool visitar(const char* clave, void* dato, void* extra), void* extra) {
+    nodo_iterar(&hamt->raiz->base, visitar, extra);
+}
+
+void hamt_destruir(hamt_t* hamt) {
+    nodo_soltar(&hamt->raiz->base, hamt->destruir_dato);
+    free(hamt);
+}
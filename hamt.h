@@ -0,0 +1,65 @@
+#ifndef HAMT_H
+#define HAMT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "hash.h"
+
+/* ******************************************************************
+ *                DEFINICION DE LOS TIPOS DE DATOS
+ * ******************************************************************/
+
+// Diccionario persistente (hash array mapped trie). Cada hamt_t es una
+// version; las versiones comparten los nodos que no cambiaron entre ellas.
+typedef struct hamt hamt_t;
+
+/* ******************************************************************
+ *                    PRIMITIVAS DEL HAMT
+ * ******************************************************************/
+
+// Crea un diccionario vacio.
+// Post: devuelve una version vacia, o NULL si no hay memoria.
+hamt_t* hamt_crear(hash_destruir_dato_t destruir_dato);
+
+// Devuelve en O(1) una version inmutable con el contenido actual. La
+// version original puede seguir modificandose: cada escritura copia solo
+// los nodos del camino que cambia (O(log n)) y los demas se comparten.
+// Una instantanea tambien puede modificarse, sin afectar a las demas.
+// Pre: el hamt fue creado.
+// Post: devuelve la nueva version, que se libera con hamt_destruir.
+hamt_t* hamt_instantanea(const hamt_t* hamt);
+
+// Guarda el par (clave, dato) en esta version, reemplazando el dato si la
+// clave ya estaba. Devuelve false si no hay memoria.
+// Pre: el hamt fue creado.
+bool hamt_guardar(hamt_t* hamt, const char* clave, void* dato);
+
+// Quita la clave de esta version. A diferencia de hash_borrar no devuelve
+// el dato, porque otras versiones pueden seguir usandolo: se destruye
+// cuando ninguna lo contiene. Devuelve false si la clave no estaba o si
+// no hubo memoria para copiar el camino.
+// Pre: el hamt fue creado.
+bool hamt_borrar(hamt_t* hamt, const char* clave);
+
+// Devuelve el dato de la clave en esta version, o NULL si no esta.
+// Pre: el hamt fue creado.
+void* hamt_obtener(const hamt_t* hamt, const char* clave);
+
+// Determina si la clave pertenece a esta version.
+// Pre: el hamt fue creado.
+bool hamt_pertenece(const hamt_t* hamt, const char* clave);
+
+// Devuelve la cantidad de claves de esta version.
+// Pre: el hamt fue creado.
+size_t hamt_cantidad(const hamt_t* hamt);
+
+// Llama a visitar con cada par de esta version mientras devuelva true.
+// Pre: el hamt fue creado.
+void hamt_iterar(const hamt_t* hamt, bool visitar(const char* clave, void* dato, void* extra), void* extra);
+
+// Libera esta version. Los nodos se liberan cuando ninguna version los usa,
+// y destruir_dato se llama una sola vez por dato, al liberar su ultima copia.
+// Pre: el hamt fue creado.
+void hamt_destruir(hamt_t* hamt);
+
+#endif // HAMT_H
@@ -1,36 +1,204 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS y MADV_HUGEPAGE
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "congelado.h"
 #include "hash.h"
-#include "lista.h"
+#include "registro.h"
+#include "traza.h"
 
 // Definicion de constantes
 
 #define CAPACIDAD_INICIAL 31
+// El indice se llena a lo sumo hasta 2/3, contando las entradas borradas
+#define CARGA_MAXIMA_NUMERADOR 2
+#define CARGA_MAXIMA_DENOMINADOR 3
+#define FACTOR_REDIMENSION 2
+#define POSICION_VACIA SIZE_MAX
+#define POSICION_BORRADA (SIZE_MAX - 1)
+#define RUEDA_NIVELES 4
+#define RUEDA_BITS 6
+#define RUEDA_RANURAS (1 << RUEDA_BITS)
+#define FILTRO_PALABRAS 8 // palabras de 64 bits por bloque: una linea de cache
+#define FILTRO_BORRADOS_MINIMO 1024
+#define DIFERIDO_MINIMO 4096 // por debajo, destruir en el momento es mas barato
+#define DIFERIDO_LOTE 1024   // entradas liberadas entre actualizaciones del pendiente
+#define PARALELO_MAX_HILOS 16
+#define PARALELO_MINIMO 16384 // entradas por hilo a partir de las que conviene otro hilo al recorrer
+#define FRANJA_ENTRADAS 65536 // entradas que un hilo mueve de una vez al redimensionar
+#define CUCKOO_VIAS 4
+#define CUCKOO_CAPACIDAD_INICIAL 32 // posiciones: 8 baldes, siempre una potencia de 2
+// Un indice cuckoo de 4 vias admite mas de 95% de carga
+#define CUCKOO_CARGA_NUMERADOR 15
+#define CUCKOO_CARGA_DENOMINADOR 16
+#define CUCKOO_BFS_MAXIMO 128 // baldes explorados al buscar lugar
+#define CUCKOO_INTENTOS 4     // duplicaciones al rearmar antes de rendirse
+#define PAGINA_GRANDE (2 * 1024 * 1024)
+#define PAGINA_CHICA 4096
+#define CLAVE_CORTA 16 // las claves de hasta 15 bytes se guardan dentro del nodo
+#define SONDEO_LARGO 32       // posiciones desde las que un sondeo es largo
+#define COLISIONES_MAXIMAS 8  // claves con el mismo hash que cambian la funcion del indice cuckoo
+#define SONDEOS_LARGOS_MINIMO 8  // sondeos largos a media carga que cambian la funcion de la tabla,
+#define SONDEOS_LARGOS_POR 1024  // mas uno cada tantas claves: al azar hay menos de 1 cada 100000
+#define LOTE_HASHES 1024 // claves que se hashean juntas antes de sondear
+#define LOTE_ADELANTO 8  // claves de distancia entre cada etapa de prebusqueda
 
 // Definicion de la estructura nodo_hash_t
 
 typedef struct nodo_hash {
-    const char* clave;
+    char* clave; // apunta a corta si la clave entra en ella
     void* dato;
+    size_t largo;
+    // Completada con ceros para compararla de a 16 bytes
+    char corta[CLAVE_CORTA];
+    size_t posicion; // en el arreglo de entradas
+    // Metadatos de recencia, solo se usan en modo cache
+    struct nodo_hash* rec_ant;
+    struct nodo_hash* rec_sig;
+    bool referenciado;
+    // Vencimiento y enlaces en la rueda de temporizadores, solo con TTL. Un
+    // nodo retirado ya salio de la rueda: vence guarda la version en que se
+    // borro y ttl_sig enlaza al siguiente retirado.
+    bool con_ttl;
+    uint64_t vence;
+    struct nodo_hash* ttl_ant;
+    struct nodo_hash* ttl_sig;
+    struct nodo_hash** ranura;
 } nodo_hash_t;
 
-// Definicion de la estructura hash abierto
+// Definicion de la estructura cache_t: lista circular de recencia
+
+typedef struct cache {
+    hash_politica_t politica;
+    size_t max_entradas;
+    size_t max_bytes;
+    size_t bytes;
+    // LRU: el mas reciente. CLOCK: la aguja del reloj.
+    nodo_hash_t* primero;
+} cache_t;
+
+// Definicion de la estructura rueda_t: rueda de temporizadores jerarquica.
+// El nivel n tiene ranuras de RUEDA_RANURAS^n ticks; al dar la vuelta un
+// nivel, la ranura correspondiente del nivel superior se baja (cascada).
+
+typedef struct rueda {
+    nodo_hash_t* ranuras[RUEDA_NIVELES][RUEDA_RANURAS];
+    uint64_t actual; // proximo tick a procesar
+    size_t cantidad;
+    uint64_t (*reloj)(void);
+} rueda_t;
+
+// Definicion de la estructura filtro_t: filtro de Bloom por bloques. Cada
+// clave fija un bit en cada palabra de un unico bloque de 64 bytes.
+
+typedef struct filtro {
+    void* memoria; // bloque pedido, sin alinear
+    uint64_t (*bloques)[FILTRO_PALABRAS];
+    size_t cantidad_bloques; // potencia de 2
+    size_t bits_por_clave;
+    size_t borrados; // claves borradas cuyos bits siguen puestos
+    size_t consultas;
+    size_t descartes;
+    size_t falsos_positivos;
+} filtro_t;
+
+// Definicion de la estructura entrada_t. Las entradas se guardan densas y
+// en orden de insercion; el hash se compara sin desreferenciar el nodo.
+
+typedef struct entrada {
+    unsigned long hash;
+    nodo_hash_t* nodo; // NULL si la entrada fue borrada
+} entrada_t;
+
+// Definicion de la estructura balde_cuckoo_t: cuatro posiciones del indice
+// cuckoo con el hash de cada una, en una linea de cache. Cada clave puede
+// estar en uno de dos baldes o, si no entro en ninguno, en el desborde.
+
+typedef struct balde_cuckoo {
+    unsigned long hashes[CUCKOO_VIAS];
+    size_t posiciones[CUCKOO_VIAS]; // POSICION_VACIA si esta libre
+} balde_cuckoo_t;
+
+// Definicion de la estructura cambios_t: registro circular con la version y
+// la clave de las ultimas modificaciones. Lo que paso con la clave se
+// averigua al consultar, buscandola en la tabla.
+
+typedef struct cambio {
+    uint64_t version;
+    char* clave; // copia propia, NULL si la ranura no se uso
+} cambio_t;
+
+typedef struct cambios {
+    cambio_t* registro;
+    size_t capacidad;
+    size_t siguiente; // ranura del proximo cambio
+    uint64_t desde;   // todos los cambios posteriores a esta version estan
+} cambios_t;
+
+// Definicion de la estructura hash compacto: el indice es una tabla de
+// direccionamiento abierto cuyas posiciones apuntan al arreglo de entradas.
+// Cada posicion ocupa 1, 2, 4 u 8 bytes segun cuantas entradas entren. Con
+// cuckoo, el indice es un arreglo de baldes_cuckoo_t seguido del desborde.
 
 struct hash {
-    lista_t** tabla;
+    entrada_t* entradas;
+    size_t usadas; // entradas ocupadas o borradas
+    void* indice;
+    void* bloque_indice; // memoria pedida para el indice, sin alinear
+    size_t ancho_indice;
+    bool cuckoo;
     unsigned long (*funcion_hash)(const char*);
+    size_t sondeos_largos; // desde la ultima redimension, con el indice a lo sumo a medias
     size_t cantidad;
-    size_t capacidad;
+    size_t capacidad; // posiciones del indice
     hash_destruir_dato_t destruir_dato;
+    cache_t* cache;
+    rueda_t* rueda;
+    filtro_t* filtro;
+    registro_t* registro;
+    hash_serializar_dato_t serializar;
+    struct hash* siguiente_diferido;
+    traza_t* traza;
+    allocador_t allocador;
+    size_t memoria;        // bytes pedidos por la tabla
+    size_t limite_memoria; // 0 si no hay limite
+    bool paginas_grandes;  // los bloques de PAGINA_GRANDE o mas se mapean aparte
+    bool prefaultear;      // tocar las paginas de esos bloques al pedirlos
+    uint64_t version;      // cantidad de modificaciones
+    cambios_t* cambios;
+    size_t hilos_redimension; // 0: uno por nucleo
+    size_t redimensiones;
+    size_t redimensiones_paralelas;
+    // Avance de la redimension en paralelo; se leen desde otros hilos
+    bool redimensionando;
+    size_t franjas_movidas;
+    size_t franjas_totales;
+    // Iteradores fijados, del mas viejo al mas nuevo, y nodos borrados
+    // mientras alguno vive, en el orden en que se borraron
+    struct hash_iter* primer_fijado;
+    struct hash_iter* ultimo_fijado;
+    nodo_hash_t* primer_retirado;
+    nodo_hash_t* ultimo_retirado;
+    congelado_t* congelado; // si no es NULL, reemplaza al indice y las entradas
 };
 
 // Definicion de la estructura hash_iter
 
 struct hash_iter {
-    lista_t** tabla;
+    const hash_t* hash;
     size_t pos;
-    lista_t* act;
-    size_t tabla_largo;
+    // Solo los iteradores fijados
+    hash_t* fijado;
+    uint64_t version; // de la tabla al crearlo
+    size_t fin;       // usadas al crearlo
+    nodo_hash_t* actual;
+    struct hash_iter* ant;
+    struct hash_iter* sig;
 };
 
 // Funcion de Hash
@@ -46,165 +214,2461 @@ unsigned long f_hash(const char *str) {
     return f_hash;
 }
 
+// Funcion de hash con semilla (SipHash-1-3), a la que pasa una tabla cuando
+// muchas claves colisionan en f_hash. La semilla es aleatoria por proceso,
+// de modo que no se pueden elegir claves que colisionen de antemano.
+
+uint64_t semilla_hash[2];
+pthread_once_t semilla_hash_iniciada = PTHREAD_ONCE_INIT;
+
+void semilla_hash_iniciar(void) {
+    FILE* aleatorio = fopen("/dev/urandom", "rb");
+    bool leida = aleatorio && fread(semilla_hash, sizeof(semilla_hash), 1, aleatorio) == 1;
+    if ( aleatorio )
+        fclose(aleatorio);
+    if ( leida )
+        return;
+    struct timespec ahora;
+    clock_gettime(CLOCK_REALTIME, &ahora);
+    semilla_hash[0] = (uint64_t)ahora.tv_nsec * 0x9e3779b97f4a7c15ULL ^ (uint64_t)(uintptr_t)&ahora;
+    semilla_hash[1] = (uint64_t)ahora.tv_sec * 0xc2b2ae3d27d4eb4fULL ^ (uint64_t)getpid();
+}
+
+#define ROTAR(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+void sip_ronda(uint64_t v[4]) {
+    v[0] += v[1]; v[1] = ROTAR(v[1], 13); v[1] ^= v[0]; v[0] = ROTAR(v[0], 32);
+    v[2] += v[3]; v[3] = ROTAR(v[3], 16); v[3] ^= v[2];
+    v[0] += v[3]; v[3] = ROTAR(v[3], 21); v[3] ^= v[0];
+    v[2] += v[1]; v[1] = ROTAR(v[1], 17); v[1] ^= v[2]; v[2] = ROTAR(v[2], 32);
+}
+
+// Pre: la semilla fue iniciada (lo hace hash_sembrar antes de usarla).
+unsigned long f_hash_sembrada(const char* clave) {
+    uint64_t v[4] = {
+        semilla_hash[0] ^ 0x736f6d6570736575ULL, semilla_hash[1] ^ 0x646f72616e646f6dULL,
+        semilla_hash[0] ^ 0x6c7967656e657261ULL, semilla_hash[1] ^ 0x7465646279746573ULL
+    };
+    size_t largo = strlen(clave);
+    uint64_t bloque;
+    size_t i = 0;
+    for (; i + sizeof(bloque) <= largo; i += sizeof(bloque)) {
+        memcpy(&bloque, clave + i, sizeof(bloque));
+        v[3] ^= bloque;
+        sip_ronda(v);
+        v[0] ^= bloque;
+    }
+    bloque = 0;
+    memcpy(&bloque, clave + i, largo - i);
+    bloque |= (uint64_t)largo << 56;
+    v[3] ^= bloque;
+    sip_ronda(v);
+    v[0] ^= bloque;
+    v[2] ^= 0xff;
+    sip_ronda(v);
+    sip_ronda(v);
+    sip_ronda(v);
+    return (unsigned long)(v[0] ^ v[1] ^ v[2] ^ v[3]);
+}
+
+// Funciones auxiliares de la memoria. Toda la memoria de la tabla pasa por
+// aca para respetar el limite y llevar la cuenta exacta de bytes. Con
+// paginas grandes, que un bloque este mapeado depende solo de su tamanio,
+// que siempre se conoce al liberarlo.
+
+bool bloque_mapeado(const hash_t* hash, size_t tamanio) {
+    return hash->paginas_grandes && tamanio >= PAGINA_GRANDE;
+}
+
+size_t bytes_mapeo(size_t tamanio) {
+    return (tamanio + PAGINA_GRANDE - 1) / PAGINA_GRANDE * PAGINA_GRANDE;
+}
+
+// Mapea el bloque alineado a PAGINA_GRANDE para que el kernel pueda
+// respaldarlo con paginas grandes. Si no las tiene, madvise falla y el
+// bloque queda en paginas comunes.
+void* mapeo_crear(size_t tamanio) {
+    size_t largo = bytes_mapeo(tamanio);
+    char* crudo = mmap(NULL, largo + PAGINA_GRANDE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( crudo == MAP_FAILED )
+        return NULL;
+    size_t antes = (PAGINA_GRANDE - (uintptr_t)crudo % PAGINA_GRANDE) % PAGINA_GRANDE;
+    if ( antes )
+        munmap(crudo, antes);
+    munmap(crudo + antes + largo, PAGINA_GRANDE - antes);
+#ifdef MADV_HUGEPAGE
+    madvise(crudo + antes, largo, MADV_HUGEPAGE);
+#endif
+    return crudo + antes;
+}
+
+// Escribe un byte por pagina para que los fallos de pagina ocurran ahora
+void bloque_prefaultear(const hash_t* hash, void* ptr, size_t desde, size_t hasta) {
+    if ( !hash->prefaultear || hasta < PAGINA_GRANDE )
+        return;
+    volatile char* bytes = ptr;
+    for (size_t i = desde; i < hasta; i += PAGINA_CHICA)
+        bytes[i] = 0;
+}
+
+void* hash_pedir(hash_t* hash, size_t tamanio) {
+    if ( hash->limite_memoria && hash->memoria + tamanio > hash->limite_memoria )
+        return NULL;
+    void* ptr = bloque_mapeado(hash, tamanio) ? mapeo_crear(tamanio) : allocador_pedir(&hash->allocador, tamanio);
+    if ( !ptr )
+        return NULL;
+    hash->memoria += tamanio;
+    bloque_prefaultear(hash, ptr, 0, tamanio);
+    return ptr;
+}
+
+void bloque_liberar(const hash_t* hash, void* ptr, size_t tamanio) {
+    if ( bloque_mapeado(hash, tamanio) )
+        munmap(ptr, bytes_mapeo(tamanio));
+    else
+        allocador_liberar(&hash->allocador, ptr);
+}
+
+void hash_liberar(hash_t* hash, void* ptr, size_t tamanio) {
+    if ( !ptr )
+        return;
+    bloque_liberar(hash, ptr, tamanio);
+    hash->memoria -= tamanio;
+}
+
+void* hash_repedir(hash_t* hash, void* ptr, size_t anterior, size_t tamanio) {
+    if ( hash->limite_memoria && tamanio > anterior && hash->memoria + (tamanio - anterior) > hash->limite_memoria )
+        return NULL;
+    void* nuevo;
+    if ( !bloque_mapeado(hash, anterior) && !bloque_mapeado(hash, tamanio) ) {
+        nuevo = allocador_redimensionar(&hash->allocador, ptr, tamanio);
+    } else if ( bloque_mapeado(hash, anterior) && bytes_mapeo(anterior) == bytes_mapeo(tamanio) ) {
+        nuevo = ptr; // el mapeo ya alcanza
+    } else {
+        nuevo = bloque_mapeado(hash, tamanio) ? mapeo_crear(tamanio) : allocador_pedir(&hash->allocador, tamanio);
+        if ( nuevo ) {
+            memcpy(nuevo, ptr, anterior < tamanio ? anterior : tamanio);
+            bloque_liberar(hash, ptr, anterior);
+        }
+    }
+    if ( !nuevo )
+        return NULL;
+    hash->memoria = hash->memoria - anterior + tamanio;
+    if ( tamanio > anterior )
+        bloque_prefaultear(hash, nuevo, anterior, tamanio);
+    return nuevo;
+}
+
 // Funciones auxiliares
 
-nodo_hash_t* nodo_hash_crear(const char* clave, void* dato) {
-    nodo_hash_t* nodo = malloc( sizeof(nodo_hash_t) );
+nodo_hash_t* nodo_hash_crear(hash_t* hash, const char* clave, void* dato) {
+    nodo_hash_t* nodo = hash_pedir(hash, sizeof(nodo_hash_t));
     if ( !nodo )
         return NULL;
 
-    nodo->clave = clave;
+    nodo->largo = strlen(clave);
+    memset(nodo->corta, 0, CLAVE_CORTA);
+    nodo->clave = nodo->largo < CLAVE_CORTA ? nodo->corta : hash_pedir(hash, nodo->largo + 1);
+    if ( !nodo->clave ) {
+        hash_liberar(hash, nodo, sizeof(nodo_hash_t));
+        return NULL;
+    }
+    memcpy(nodo->clave, clave, nodo->largo + 1);
     nodo->dato = dato;
+    nodo->posicion = 0;
+    nodo->rec_ant = NULL;
+    nodo->rec_sig = NULL;
+    nodo->referenciado = false;
+    nodo->con_ttl = false;
+    nodo->vence = 0;
+    nodo->ttl_ant = NULL;
+    nodo->ttl_sig = NULL;
+    nodo->ranura = NULL;
     return nodo;
 }
 
-void inicializar_tabla(hash_t* hash) {
-    for (size_t i=0; i < hash->capacidad; i++)
-        hash->tabla[i] = NULL;
+void nodo_hash_destruir(hash_t* hash, nodo_hash_t* nodo, hash_destruir_dato_t destruir_dato) {
+    if ( destruir_dato )
+        destruir_dato(nodo->dato);
+    if ( nodo->clave != nodo->corta )
+        hash_liberar(hash, nodo->clave, nodo->largo + 1);
+    hash_liberar(hash, nodo, sizeof(nodo_hash_t));
 }
 
+// Destruye un nodo ya desvinculado. Si hay iteradores fijados, alguno
+// puede estar parado en el: el dato se destruye ahora y el nodo (con su
+// clave) se libera cuando terminen los iteradores creados antes del borrado.
+void hash_retirar(hash_t* hash, nodo_hash_t* nodo, hash_destruir_dato_t destruir_dato) {
+    if ( !hash->primer_fijado ) {
+        nodo_hash_destruir(hash, nodo, destruir_dato);
+        return;
+    }
+    if ( destruir_dato )
+        destruir_dato(nodo->dato);
+    nodo->vence = hash->version;
+    nodo->ttl_sig = NULL;
+    if ( hash->ultimo_retirado )
+        hash->ultimo_retirado->ttl_sig = nodo;
+    else
+        hash->primer_retirado = nodo;
+    hash->ultimo_retirado = nodo;
+}
 
-// Primitivas del hash
+// Libera los nodos retirados que ningun iterador fijado puede ver: los
+// borrados hasta la version del mas viejo, o todos si no queda ninguno
+void hash_liberar_retirados(hash_t* hash) {
+    while ( hash->primer_retirado && (!hash->primer_fijado || hash->primer_retirado->vence <= hash->primer_fijado->version) ) {
+        nodo_hash_t* nodo = hash->primer_retirado;
+        hash->primer_retirado = nodo->ttl_sig;
+        nodo_hash_destruir(hash, nodo, NULL);
+    }
+    if ( !hash->primer_retirado )
+        hash->ultimo_retirado = NULL;
+}
 
-hash_t* hash_crear(hash_destruir_dato_t destruir_dato) {
-    hash_t* hash = malloc( sizeof(hash_t) );
-    if ( !hash )
-        return NULL;
+// Funciones auxiliares de la comparacion de claves. Las claves se comparan
+// de a 16 bytes con el largo conocido: dos cargas de 8 bytes que el
+// compilador junta en una sola carga vectorial.
 
-    lista_t** tabla = malloc( CAPACIDAD_INICIAL * sizeof(lista_t*) );
-    if ( !tabla ) {
-        free(hash);
-        return NULL;
+// Clave buscada, preparada una sola vez por busqueda
+typedef struct clave_buscada {
+    const char* clave;
+    size_t largo;
+    char corta[CLAVE_CORTA]; // completada con ceros, como la del nodo
+} clave_buscada_t;
+
+void clave_buscada_preparar(clave_buscada_t* buscada, const char* clave) {
+    buscada->clave = clave;
+    buscada->largo = strlen(clave);
+    memset(buscada->corta, 0, CLAVE_CORTA);
+    if ( buscada->largo < CLAVE_CORTA )
+        memcpy(buscada->corta, clave, buscada->largo);
+}
+
+bool bloques_iguales(const char* a, const char* b) {
+    uint64_t a0, a1, b0, b1;
+    memcpy(&a0, a, sizeof(uint64_t));
+    memcpy(&a1, a + sizeof(uint64_t), sizeof(uint64_t));
+    memcpy(&b0, b, sizeof(uint64_t));
+    memcpy(&b1, b + sizeof(uint64_t), sizeof(uint64_t));
+    return !((a0 ^ b0) | (a1 ^ b1));
+}
+
+bool nodo_clave_igual(const nodo_hash_t* nodo, const clave_buscada_t* buscada) {
+    if ( nodo->largo != buscada->largo )
+        return false;
+    if ( nodo->largo < CLAVE_CORTA )
+        return bloques_iguales(nodo->corta, buscada->corta);
+    // Claves largas: bloques enteros y el ultimo solapado con el anterior
+    size_t ultimo = nodo->largo - CLAVE_CORTA;
+    for (size_t i = 0; i < ultimo; i += CLAVE_CORTA) {
+        if ( !bloques_iguales(nodo->clave + i, buscada->clave + i) )
+            return false;
     }
+    return bloques_iguales(nodo->clave + ultimo, buscada->clave + ultimo);
+}
 
-    hash->tabla = tabla;
-    hash->funcion_hash = f_hash;
-    hash->capacidad = CAPACIDAD_INICIAL;
-    hash->cantidad = 0;
-    hash->destruir_dato = destruir_dato;
-    inicializar_tabla(hash);
-    return hash;
+// Funciones auxiliares del indice
+
+// Mezcla los bits del hash (finalizador de MurmurHash3). El sondeo lineal
+// necesita que claves parecidas no caigan en posiciones contiguas.
+uint64_t hash_mezclar(unsigned long h) {
+    uint64_t x = h;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
 }
 
-size_t hash_cantidad(const hash_t* hash) {
-    return hash->cantidad;
+size_t indice_inicial(unsigned long h, size_t capacidad) {
+    return (size_t)(hash_mezclar(h) % capacidad);
 }
 
-bool hash_pertenece(const hash_t* hash, const char* clave) {
-    size_t indice = hash->funcion_hash(clave) % hash->capacidad;
-    return hash->tabla[indice];
+size_t entradas_maximas(const hash_t* hash, size_t capacidad) {
+    if ( hash->cuckoo )
+        return capacidad * CUCKOO_CARGA_NUMERADOR / CUCKOO_CARGA_DENOMINADOR;
+    return capacidad * CARGA_MAXIMA_NUMERADOR / CARGA_MAXIMA_DENOMINADOR;
 }
 
-bool hash_guardar(hash_t* hash, const char* clave, void* dato) {
-    size_t indice = hash->funcion_hash(clave) % hash->capacidad;
-    nodo_hash_t* nodo_hash = nodo_hash_crear(clave, dato);
-    if ( !nodo_hash )
-        return false;
+// Los dos valores mas altos de cada ancho marcan posiciones vacias y borradas
+size_t ancho_indice(size_t entradas) {
+    if ( entradas < UINT8_MAX - 1 )
+        return sizeof(uint8_t);
+    if ( entradas < UINT16_MAX - 1 )
+        return sizeof(uint16_t);
+    if ( entradas < UINT32_MAX - 1 )
+        return sizeof(uint32_t);
+    return sizeof(uint64_t);
+}
+
+void* indice_crear(hash_t* hash, size_t capacidad, size_t ancho) {
+    void* indice = hash_pedir(hash, capacidad * ancho);
+    if ( indice )
+        memset(indice, 0xff, capacidad * ancho); // todas vacias
+    return indice;
+}
 
-    bool existe = false;
-    if ( !hash_pertenece(hash, clave) ) {
-        hash->tabla[indice] = lista_crear();
-        existe = true;
+size_t indice_leer(const void* indice, size_t ancho, size_t i) {
+    uint64_t valor, maximo;
+    switch ( ancho ) {
+        case sizeof(uint8_t):
+            valor = ((const uint8_t*)indice)[i];
+            maximo = UINT8_MAX;
+            break;
+        case sizeof(uint16_t):
+            valor = ((const uint16_t*)indice)[i];
+            maximo = UINT16_MAX;
+            break;
+        case sizeof(uint32_t):
+            valor = ((const uint32_t*)indice)[i];
+            maximo = UINT32_MAX;
+            break;
+        default:
+            valor = ((const uint64_t*)indice)[i];
+            maximo = UINT64_MAX;
     }
+    if ( valor == maximo )
+        return POSICION_VACIA;
+    if ( valor == maximo - 1 )
+        return POSICION_BORRADA;
+    return (size_t)valor;
+}
 
-    bool ok = lista_insertar_ultimo(hash->tabla[indice], nodo_hash);
-    if ( ok && existe )
-        hash->cantidad++;
-    return ok;
+// Las marcas se truncan a los dos valores mas altos del ancho
+void indice_escribir(void* indice, size_t ancho, size_t i, size_t posicion) {
+    switch ( ancho ) {
+        case sizeof(uint8_t):
+            ((uint8_t*)indice)[i] = (uint8_t)posicion;
+            break;
+        case sizeof(uint16_t):
+            ((uint16_t*)indice)[i] = (uint16_t)posicion;
+            break;
+        case sizeof(uint32_t):
+            ((uint32_t*)indice)[i] = (uint32_t)posicion;
+            break;
+        default:
+            ((uint64_t*)indice)[i] = (uint64_t)posicion;
+    }
 }
 
-void* hash_borrar(hash_t* hash, const char* clave) {
-    size_t indice = hash->funcion_hash(clave) % hash->capacidad;
-    if ( !hash_pertenece(hash, clave) )
+// Primera posicion libre del indice para el hash, sondeando linealmente
+size_t indice_buscar_libre(const void* indice, size_t ancho, size_t capacidad, unsigned long h) {
+    size_t i = indice_inicial(h, capacidad);
+    while ( indice_leer(indice, ancho, i) < POSICION_BORRADA )
+        i = (i + 1) % capacidad;
+    return i;
+}
+
+// Ocupa la primera posicion vacia del sondeo de h con una comparacion e
+// intercambio, de modo que varios hilos pueden llenar el mismo indice.
+// Pre: el indice no tiene posiciones borradas.
+void indice_reclamar(void* indice, size_t ancho, size_t capacidad, unsigned long h, size_t posicion) {
+    for (size_t i = indice_inicial(h, capacidad); ; i = (i + 1) % capacidad) {
+        bool ok;
+        switch ( ancho ) {
+            case sizeof(uint8_t): {
+                uint8_t vacia = UINT8_MAX;
+                ok = __atomic_compare_exchange_n((uint8_t*)indice + i, &vacia, (uint8_t)posicion, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+                break;
+            }
+            case sizeof(uint16_t): {
+                uint16_t vacia = UINT16_MAX;
+                ok = __atomic_compare_exchange_n((uint16_t*)indice + i, &vacia, (uint16_t)posicion, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+                break;
+            }
+            case sizeof(uint32_t): {
+                uint32_t vacia = UINT32_MAX;
+                ok = __atomic_compare_exchange_n((uint32_t*)indice + i, &vacia, (uint32_t)posicion, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+                break;
+            }
+            default: {
+                uint64_t vacia = UINT64_MAX;
+                ok = __atomic_compare_exchange_n((uint64_t*)indice + i, &vacia, (uint64_t)posicion, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+            }
+        }
+        if ( ok )
+            return;
+    }
+}
+
+// Funciones auxiliares del indice cuckoo
+
+// Los dos baldes de la clave salen de mitades distintas del hash mezclado
+void cuckoo_baldes(unsigned long h, size_t cantidad_baldes, size_t elegidos[2]) {
+    uint64_t mezcla = hash_mezclar(h);
+    elegidos[0] = (size_t)mezcla & (cantidad_baldes - 1);
+    elegidos[1] = (size_t)(mezcla >> 32) & (cantidad_baldes - 1);
+}
+
+size_t cuckoo_otro_balde(unsigned long h, size_t actual, size_t cantidad_baldes) {
+    size_t elegidos[2];
+    cuckoo_baldes(h, cantidad_baldes, elegidos);
+    return elegidos[0] == actual ? elegidos[1] : elegidos[0];
+}
+
+// Un balde de mas para el desborde y otro para poder alinear
+size_t cuckoo_bytes(size_t capacidad) {
+    return (capacidad / CUCKOO_VIAS + 2) * sizeof(balde_cuckoo_t);
+}
+
+balde_cuckoo_t* cuckoo_crear(hash_t* hash, size_t capacidad, void** bloque) {
+    *bloque = hash_pedir(hash, cuckoo_bytes(capacidad));
+    if ( !*bloque )
         return NULL;
+    size_t tamanio_balde = sizeof(balde_cuckoo_t);
+    uintptr_t alineada = ((uintptr_t)*bloque + tamanio_balde - 1) / tamanio_balde * tamanio_balde;
+    memset((void*)alineada, 0xff, (capacidad / CUCKOO_VIAS + 1) * tamanio_balde); // todas vacias
+    return (void*)alineada;
+}
+
+// Paso de la busqueda en anchura: el balde y desde que via de que paso
+// anterior se llega a el
+typedef struct paso_cuckoo {
+    size_t balde;
+    size_t anterior; // SIZE_MAX en los dos baldes de la clave
+    size_t via;
+} paso_cuckoo_t;
+
+bool cuckoo_en_camino(const paso_cuckoo_t* pasos, size_t i, size_t balde) {
+    for (; i != SIZE_MAX; i = pasos[i].anterior) {
+        if ( pasos[i].balde == balde )
+            return true;
+    }
+    return false;
+}
+
+// Recorre el camino hacia atras: cada elemento baja al hueco del balde
+// siguiente, y el hueco que deja lo ocupa la clave nueva al final
+void cuckoo_desplazar(balde_cuckoo_t* baldes, const paso_cuckoo_t* pasos, size_t i, size_t via, unsigned long h, size_t posicion) {
+    while ( pasos[i].anterior != SIZE_MAX ) {
+        balde_cuckoo_t* destino = &baldes[pasos[i].balde];
+        balde_cuckoo_t* origen = &baldes[pasos[pasos[i].anterior].balde];
+        destino->hashes[via] = origen->hashes[pasos[i].via];
+        destino->posiciones[via] = origen->posiciones[pasos[i].via];
+        via = pasos[i].via;
+        i = pasos[i].anterior;
+    }
+    baldes[pasos[i].balde].hashes[via] = h;
+    baldes[pasos[i].balde].posiciones[via] = posicion;
+}
+
+// Ubica la posicion en uno de sus dos baldes, buscando en anchura el
+// camino de desplazamientos mas corto hasta un hueco. Si no lo hay, usa el
+// desborde. Devuelve false, sin modificar nada, si tampoco hay lugar alli.
+bool cuckoo_ubicar(balde_cuckoo_t* baldes, size_t cantidad_baldes, unsigned long h, size_t posicion) {
+    paso_cuckoo_t pasos[CUCKOO_BFS_MAXIMO];
+    size_t elegidos[2];
+    cuckoo_baldes(h, cantidad_baldes, elegidos);
+    size_t cantidad = 0;
+    pasos[cantidad++] = (paso_cuckoo_t){ elegidos[0], SIZE_MAX, 0 };
+    if ( elegidos[1] != elegidos[0] )
+        pasos[cantidad++] = (paso_cuckoo_t){ elegidos[1], SIZE_MAX, 0 };
+
+    for (size_t i = 0; i < cantidad; i++) {
+        const balde_cuckoo_t* balde = &baldes[pasos[i].balde];
+        for (size_t via = 0; via < CUCKOO_VIAS; via++) {
+            if ( balde->posiciones[via] == POSICION_VACIA ) {
+                cuckoo_desplazar(baldes, pasos, i, via, h, posicion);
+                return true;
+            }
+        }
+        for (size_t via = 0; via < CUCKOO_VIAS && cantidad < CUCKOO_BFS_MAXIMO; via++) {
+            size_t otro = cuckoo_otro_balde(balde->hashes[via], pasos[i].balde, cantidad_baldes);
+            if ( !cuckoo_en_camino(pasos, i, otro) )
+                pasos[cantidad++] = (paso_cuckoo_t){ otro, i, via };
+        }
+    }
+
+    // El desborde se mantiene compacto: vacio si su primera via lo esta
+    balde_cuckoo_t* desborde = &baldes[cantidad_baldes];
+    for (size_t via = 0; via < CUCKOO_VIAS; via++) {
+        if ( desborde->posiciones[via] == POSICION_VACIA ) {
+            desborde->hashes[via] = h;
+            desborde->posiciones[via] = posicion;
+            return true;
+        }
+    }
+    return false;
+}
+
+void cuckoo_quitar(balde_cuckoo_t* baldes, size_t cantidad_baldes, unsigned long h, size_t posicion) {
+    size_t elegidos[2];
+    cuckoo_baldes(h, cantidad_baldes, elegidos);
+    for (size_t b = 0; b < 2; b++) {
+        balde_cuckoo_t* balde = &baldes[elegidos[b]];
+        for (size_t via = 0; via < CUCKOO_VIAS; via++) {
+            if ( balde->posiciones[via] == posicion ) {
+                balde->posiciones[via] = POSICION_VACIA;
+                return;
+            }
+        }
+    }
+    balde_cuckoo_t* desborde = &baldes[cantidad_baldes];
+    size_t ultima = 0;
+    while ( ultima + 1 < CUCKOO_VIAS && desborde->posiciones[ultima + 1] != POSICION_VACIA )
+        ultima++;
+    for (size_t via = 0; via <= ultima; via++) {
+        if ( desborde->posiciones[via] == posicion ) {
+            desborde->hashes[via] = desborde->hashes[ultima];
+            desborde->posiciones[via] = desborde->posiciones[ultima];
+            desborde->posiciones[ultima] = POSICION_VACIA;
+            return;
+        }
+    }
+}
+
+// Arma un indice cuckoo con las entradas presentes, numeradas como quedaran
+// despues de compactar (sin compactar si hay iteradores fijados). Si alguna
+// no entra, prueba con el doble de baldes.
+balde_cuckoo_t* cuckoo_armar(hash_t* hash, size_t* capacidad, void** bloque) {
+    for (size_t intento = 0; intento < CUCKOO_INTENTOS; intento++) {
+        balde_cuckoo_t* baldes = cuckoo_crear(hash, *capacidad, bloque);
+        if ( !baldes )
+            return NULL;
+        size_t usadas = 0;
+        bool ok = true;
+        for (size_t i = 0; i < hash->usadas && ok; i++) {
+            if ( hash->entradas[i].nodo )
+                ok = cuckoo_ubicar(baldes, *capacidad / CUCKOO_VIAS, hash->entradas[i].hash, hash->primer_fijado ? i : usadas++);
+        }
+        if ( ok )
+            return baldes;
+        hash_liberar(hash, *bloque, cuckoo_bytes(*capacidad));
+        *capacidad *= FACTOR_REDIMENSION;
+    }
+    return NULL;
+}
+
+// Funciones auxiliares comunes a ambos indices
+
+size_t indice_bytes(const hash_t* hash, size_t capacidad, size_t ancho) {
+    return hash->cuckoo ? cuckoo_bytes(capacidad) : capacidad * ancho;
+}
+
+// Pide un indice para la capacidad. El cuckoo se arma ya con las entradas
+// presentes y puede agrandar la capacidad; el lineal se llena al compactar.
+void* hash_indice_armar(hash_t* hash, size_t* capacidad, size_t* ancho, void** bloque) {
+    if ( hash->cuckoo ) {
+        *ancho = sizeof(balde_cuckoo_t) / CUCKOO_VIAS;
+        return cuckoo_armar(hash, capacidad, bloque);
+    }
+    *ancho = ancho_indice(entradas_maximas(hash, *capacidad));
+    *bloque = indice_crear(hash, *capacidad, *ancho);
+    return *bloque;
+}
+
+void hash_liberar_indice(hash_t* hash) {
+    hash_liberar(hash, hash->bloque_indice, indice_bytes(hash, hash->capacidad, hash->ancho_indice));
+    hash->indice = NULL;
+    hash->bloque_indice = NULL;
+}
+
+// Funciones auxiliares del filtro
+
+// Calcula el bloque de la clave y la mascara de cada palabra del bloque
+uint64_t* filtro_bloque(const filtro_t* filtro, unsigned long h, uint64_t mascaras[FILTRO_PALABRAS]) {
+    static const uint32_t semillas[FILTRO_PALABRAS] = {
+        0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+        0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+    };
+    uint64_t x = hash_mezclar(h);
+    uint32_t bajos = (uint32_t)x;
+    for (size_t i = 0; i < FILTRO_PALABRAS; i++)
+        mascaras[i] = (uint64_t)1 << ((bajos * semillas[i]) >> 26);
+    return filtro->bloques[(x >> 32) & (filtro->cantidad_bloques - 1)];
+}
+
+void filtro_agregar(filtro_t* filtro, unsigned long h) {
+    uint64_t mascaras[FILTRO_PALABRAS];
+    uint64_t* bloque = filtro_bloque(filtro, h, mascaras);
+    for (size_t i = 0; i < FILTRO_PALABRAS; i++)
+        bloque[i] |= mascaras[i];
+}
+
+bool filtro_puede_contener(const filtro_t* filtro, unsigned long h) {
+    uint64_t mascaras[FILTRO_PALABRAS];
+    const uint64_t* bloque = filtro_bloque(filtro, h, mascaras);
+    uint64_t faltan = 0;
+    for (size_t i = 0; i < FILTRO_PALABRAS; i++)
+        faltan |= mascaras[i] & ~bloque[i];
+    return !faltan;
+}
+
+// Dimensiona el filtro para la carga maxima de la tabla y lo llena con las
+// claves presentes. Si no hay memoria conserva el filtro anterior.
+size_t filtro_bytes(const filtro_t* filtro) {
+    // Un bloque de mas para poder alinear a linea de cache
+    return filtro->memoria ? (filtro->cantidad_bloques + 1) * sizeof(uint64_t[FILTRO_PALABRAS]) : 0;
+}
+
+bool filtro_reconstruir(hash_t* hash, filtro_t* filtro) {
+    size_t bits = entradas_maximas(hash, hash->capacidad) * filtro->bits_por_clave;
+    size_t cantidad_bloques = 1;
+    while ( cantidad_bloques * FILTRO_PALABRAS * 64 < bits )
+        cantidad_bloques *= 2;
+
+    size_t tamanio_bloque = sizeof(uint64_t[FILTRO_PALABRAS]);
+    void* memoria = hash_pedir(hash, (cantidad_bloques + 1) * tamanio_bloque);
+    if ( !memoria )
+        return false;
+    uintptr_t alineada = ((uintptr_t)memoria + tamanio_bloque - 1) / tamanio_bloque * tamanio_bloque;
+    memset((void*)alineada, 0, cantidad_bloques * tamanio_bloque);
+
+    hash_liberar(hash, filtro->memoria, filtro_bytes(filtro));
+    filtro->memoria = memoria;
+    filtro->bloques = (void*)alineada;
+    filtro->cantidad_bloques = cantidad_bloques;
+    filtro->borrados = 0;
+    for (size_t i = 0; i < hash->usadas; i++) {
+        if ( hash->entradas[i].nodo )
+            filtro_agregar(filtro, hash->entradas[i].hash);
+    }
+    return true;
+}
+
+// Recorre el indice sin modificar nada, por lo que varios hilos pueden
+// sondear la misma tabla a la vez
+// La clave buscada se prepara al primer hash igual: las ausencias casi
+// nunca llegan a compararse
+bool clave_coincide(const nodo_hash_t* nodo, const char* clave, clave_buscada_t* buscada) {
+    if ( !buscada->clave )
+        clave_buscada_preparar(buscada, clave);
+    return nodo_clave_igual(nodo, buscada);
+}
 
-    void* valor = NULL;
-    nodo_hash_t* actual = NULL;
-    bool existe = false;
+// Revisa a lo sumo los dos baldes de la clave y el desborde
+nodo_hash_t* cuckoo_sondear(const hash_t* hash, const char* clave, unsigned long h) {
+    const balde_cuckoo_t* baldes = hash->indice;
+    size_t cantidad_baldes = hash->capacidad / CUCKOO_VIAS;
+    size_t elegidos[2];
+    cuckoo_baldes(h, cantidad_baldes, elegidos);
+    const balde_cuckoo_t* candidatos[] = { &baldes[elegidos[0]], &baldes[elegidos[1]], &baldes[cantidad_baldes] };
+#ifdef __GNUC__
+    __builtin_prefetch(candidatos[1]);
+#endif
 
-    lista_iter_t* iter = lista_iter_crear(hash->tabla[indice]);
-    while ( !( existe || lista_iter_al_final(iter) ) ) {
-        actual = lista_iter_ver_actual(iter);
-        if ( actual->clave == clave ) {
-            valor = actual->dato;
-            lista_iter_borrar(iter);
-            existe = true;
+    clave_buscada_t buscada = { NULL, 0, {0} };
+    for (size_t c = 0; c < sizeof(candidatos) / sizeof(candidatos[0]); c++) {
+        for (size_t via = 0; via < CUCKOO_VIAS; via++) {
+            size_t posicion = candidatos[c]->posiciones[via];
+            if ( posicion == POSICION_VACIA || candidatos[c]->hashes[via] != h )
+                continue;
+            if ( clave_coincide(hash->entradas[posicion].nodo, clave, &buscada) )
+                return hash->entradas[posicion].nodo;
         }
-        lista_iter_avanzar(iter);
     }
-    free(iter);
+    return NULL;
+}
 
-    if ( existe )
-        free(actual);
+nodo_hash_t* hash_sondear(const hash_t* hash, const char* clave, unsigned long h) {
+    if ( hash->cuckoo )
+        return cuckoo_sondear(hash, clave, h);
+    clave_buscada_t buscada = { NULL, 0, {0} };
+    // Siempre queda alguna posicion vacia que corta el sondeo
+    for (size_t i = indice_inicial(h, hash->capacidad); ; i = (i + 1) % hash->capacidad) {
+        size_t posicion = indice_leer(hash->indice, hash->ancho_indice, i);
+        if ( posicion == POSICION_VACIA )
+            return NULL;
+        if ( posicion == POSICION_BORRADA )
+            continue;
+        const entrada_t* entrada = &hash->entradas[posicion];
+        if ( entrada->hash == h && clave_coincide(entrada->nodo, clave, &buscada) )
+            return entrada->nodo;
+    }
+}
 
-    if ( lista_esta_vacia(hash->tabla[indice]) ) {
-        free(hash->tabla[indice]);
-        hash->tabla[indice] = NULL;
+nodo_hash_t* hash_buscar_nodo(const hash_t* hash, const char* clave, unsigned long h) {
+    filtro_t* filtro = hash->filtro;
+    if ( filtro ) {
+        filtro->consultas++;
+        if ( !filtro_puede_contener(filtro, h) ) {
+            filtro->descartes++;
+            return NULL;
+        }
     }
 
+    nodo_hash_t* encontrado = hash_sondear(hash, clave, h);
+    if ( filtro && !encontrado )
+        filtro->falsos_positivos++;
+    return encontrado;
+}
+
+// Marca como borradas la entrada del nodo y su posicion en el indice. La
+// entrada se recupera al redimensionar.
+void hash_quitar_nodo(hash_t* hash, nodo_hash_t* nodo) {
+    entrada_t* entrada = &hash->entradas[nodo->posicion];
+    if ( hash->cuckoo ) {
+        cuckoo_quitar(hash->indice, hash->capacidad / CUCKOO_VIAS, entrada->hash, nodo->posicion);
+    } else {
+        size_t i = indice_inicial(entrada->hash, hash->capacidad);
+        while ( indice_leer(hash->indice, hash->ancho_indice, i) != nodo->posicion )
+            i = (i + 1) % hash->capacidad;
+        indice_escribir(hash->indice, hash->ancho_indice, i, POSICION_BORRADA);
+    }
+    entrada->nodo = NULL;
     hash->cantidad--;
-    return valor;
+
+    // Los bits del borrado quedan puestos: solo suben los falsos positivos
+    // hasta que se reconstruye el filtro
+    if ( hash->filtro && ++hash->filtro->borrados >= FILTRO_BORRADOS_MINIMO && hash->filtro->borrados > hash->cantidad )
+        filtro_reconstruir(hash, hash->filtro);
 }
 
-void* hash_obtener(const hash_t* hash, const char* clave) {
-    if ( !hash_pertenece(hash, clave) )
-        return NULL;
-    size_t indice = hash->funcion_hash(clave) % hash->capacidad;
-    nodo_hash_t* ultimo = lista_ver_ultimo(hash->tabla[indice]);
-    return ultimo->dato;
+bool hash_redimensionar(hash_t* hash, size_t capacidad_nueva);
+
+// Cuenta las claves con hash h en sus baldes cuckoo y en el desborde
+size_t hash_colisiones(const hash_t* hash, unsigned long h) {
+    const balde_cuckoo_t* baldes = hash->indice;
+    size_t cantidad_baldes = hash->capacidad / CUCKOO_VIAS;
+    size_t elegidos[2];
+    cuckoo_baldes(h, cantidad_baldes, elegidos);
+    const balde_cuckoo_t* candidatos[] = { &baldes[elegidos[0]], &baldes[elegidos[1]], &baldes[cantidad_baldes] };
+    size_t colisiones = 0;
+    for (size_t c = 0; c < 3; c++) {
+        if ( c == 1 && elegidos[1] == elegidos[0] )
+            continue;
+        for (size_t via = 0; via < CUCKOO_VIAS; via++)
+            colisiones += candidatos[c]->posiciones[via] != POSICION_VACIA && candidatos[c]->hashes[via] == h;
+    }
+    return colisiones;
 }
 
-void hash_destruir(hash_t* hash) {
-    for (size_t i=0; i < hash->capacidad; i++) {
-        if ( hash->tabla[i] ) {
-            while ( !lista_esta_vacia(hash->tabla[i]) ) {
-                nodo_hash_t* primero = lista_borrar_primero(hash->tabla[i]);
-                if ( hash->destruir_dato )
-                    hash->destruir_dato(primero->dato);
-                free(primero);
-            }
-            free(hash->tabla[i]);
+void hash_recalcular(hash_t* hash) {
+    for (size_t i = 0; i < hash->usadas; i++) {
+        if ( hash->entradas[i].nodo )
+            hash->entradas[i].hash = hash->funcion_hash(hash->entradas[i].nodo->clave);
+    }
+}
+
+// Pasa la tabla a f_hash_sembrada y rearma el indice (y el filtro) con los
+// hashes nuevos. Pasa una sola vez: si ya la usa devuelve false, igual que
+// si no hay memoria, y en ese caso la tabla vuelve a f_hash.
+bool hash_sembrar(hash_t* hash) {
+    if ( hash->funcion_hash != f_hash )
+        return false;
+    pthread_once(&semilla_hash_iniciada, semilla_hash_iniciar);
+    hash->funcion_hash = f_hash_sembrada;
+    hash_recalcular(hash);
+    // El filtro se rearma aparte: con los hashes viejos daria falsos negativos
+    filtro_t* filtro = hash->filtro;
+    hash->filtro = NULL;
+    bool ok = hash_redimensionar(hash, hash->capacidad);
+    hash->filtro = filtro;
+    if ( !ok ) {
+        hash->funcion_hash = f_hash;
+        hash_recalcular(hash);
+        return false;
+    }
+    if ( filtro && !filtro_reconstruir(hash, filtro) )
+        hash_filtro_desactivar(hash);
+    return true;
+}
+
+// Agrega el nodo al final de las entradas. Solo el indice cuckoo puede
+// fallar, si al agrandarlo no hay memoria; el hash queda como estaba.
+// Pre: quedan entradas libres (usadas < entradas_maximas(capacidad)).
+bool hash_insertar_nodo(hash_t* hash, nodo_hash_t* nodo, unsigned long h) {
+    size_t posicion = hash->usadas;
+    nodo->posicion = posicion;
+    hash->entradas[posicion].hash = h;
+    hash->entradas[posicion].nodo = nodo;
+    hash->usadas++;
+    hash->cantidad++;
+    if ( !hash->cuckoo ) {
+        size_t inicial = indice_inicial(h, hash->capacidad);
+        size_t i = indice_buscar_libre(hash->indice, hash->ancho_indice, hash->capacidad, h);
+        indice_escribir(hash->indice, hash->ancho_indice, i, posicion);
+        // Con el indice a lo sumo a medias, un sondeo largo casi nunca es
+        // azar: muchos son claves elegidas para caer juntas, tengan o no el
+        // mismo hash. Sin memoria para cambiar de funcion, la tabla sigue
+        // valida con la actual.
+        bool sondeo_largo = (i + hash->capacidad - inicial) % hash->capacidad > SONDEO_LARGO;
+        if ( sondeo_largo && hash->usadas * 2 <= hash->capacidad
+             && ++hash->sondeos_largos >= SONDEOS_LARGOS_MINIMO + hash->cantidad / SONDEOS_LARGOS_POR )
+            hash_sembrar(hash);
+        return true;
+    }
+    if ( cuckoo_ubicar(hash->indice, hash->capacidad / CUCKOO_VIAS, h, posicion) )
+        return true;
+    // Las claves con el mismo hash no se separan agrandando el indice. Si no,
+    // se agranda, y el indice nuevo ya se arma con la entrada nueva.
+    if ( hash_colisiones(hash, h) >= COLISIONES_MAXIMAS && hash_sembrar(hash) )
+        return true;
+    if ( hash_redimensionar(hash, hash->capacidad * FACTOR_REDIMENSION) )
+        return true;
+    hash->usadas--;
+    hash->cantidad--;
+    return false;
+}
+
+// Funciones auxiliares de la redimension en paralelo. Las entradas ya
+// compactadas se parten en franjas de FRANJA_ENTRADAS; cada hilo reclama la
+// siguiente franja libre al terminar la suya (como el transfer de
+// ConcurrentHashMap), de modo que ninguno espera a otro mas lento, y ubica
+// sus entradas en el indice nuevo con indice_reclamar.
+
+typedef struct migracion {
+    hash_t* hash;
+    void* indice;
+    size_t ancho;
+    size_t capacidad;
+    size_t usadas;
+    size_t siguiente; // proxima franja sin reclamar
+} migracion_t;
+
+void* migracion_trabajar(void* extra) {
+    migracion_t* migracion = extra;
+    hash_t* hash = migracion->hash;
+    size_t franjas = hash->franjas_totales;
+    size_t franja;
+    while ( (franja = __atomic_fetch_add(&migracion->siguiente, 1, __ATOMIC_RELAXED)) < franjas ) {
+        size_t desde = franja * FRANJA_ENTRADAS;
+        size_t hasta = desde + FRANJA_ENTRADAS < migracion->usadas ? desde + FRANJA_ENTRADAS : migracion->usadas;
+        for (size_t i = desde; i < hasta; i++) {
+            if ( hash->entradas[i].nodo )
+                indice_reclamar(migracion->indice, migracion->ancho, migracion->capacidad, hash->entradas[i].hash, i);
         }
+        __atomic_fetch_add(&hash->franjas_movidas, 1, __ATOMIC_RELAXED);
     }
-    free(hash->tabla);
-    free(hash);
+    return NULL;
 }
 
-// Primitivas del iterador
+// Hilos para redimensionar: 1 con el indice cuckoo, que no admite
+// ubicaciones concurrentes, y nunca mas que franjas, porque cada hilo
+// mueve franjas enteras y los de mas no tendrian nada que hacer
+size_t hash_hilos_redimension(const hash_t* hash) {
+    if ( hash->cuckoo || hash->hilos_redimension == 1 )
+        return 1;
+    size_t hilos = hash->hilos_redimension;
+    if ( !hilos ) {
+        long nucleos = sysconf(_SC_NPROCESSORS_ONLN);
+        hilos = nucleos > 0 ? (size_t)nucleos : 1;
+    }
+    size_t franjas = (hash->cantidad + FRANJA_ENTRADAS - 1) / FRANJA_ENTRADAS;
+    if ( hilos > franjas )
+        hilos = franjas ? franjas : 1;
+    return hilos < PARALELO_MAX_HILOS ? hilos : PARALELO_MAX_HILOS;
+}
 
-hash_iter_t* hash_iter_crear(const hash_t* hash) {
-    hash_iter_t* iter = malloc( sizeof(hash_iter_t) );
-    if ( !iter )
-        return NULL;
-    iter->tabla = hash->tabla;
-    iter->pos = 0;
-    iter->act = iter->tabla[iter->pos];
-    iter->tabla_largo = hash->capacidad;
-    return iter;
+// Llena el indice nuevo con las usadas entradas. El hilo que llama tambien
+// mueve franjas; si no se puede crear un hilo, los demas hacen su parte.
+void hash_migrar(hash_t* hash, void* indice, size_t ancho, size_t capacidad, size_t usadas, size_t hilos) {
+    migracion_t migracion = { hash, indice, ancho, capacidad, usadas, 0 };
+    __atomic_store_n(&hash->franjas_movidas, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&hash->franjas_totales, (usadas + FRANJA_ENTRADAS - 1) / FRANJA_ENTRADAS, __ATOMIC_RELAXED);
+    __atomic_store_n(&hash->redimensionando, true, __ATOMIC_RELEASE);
+
+    pthread_t ids[PARALELO_MAX_HILOS];
+    bool lanzado[PARALELO_MAX_HILOS];
+    for (size_t t = 1; t < hilos; t++)
+        lanzado[t] = pthread_create(&ids[t], NULL, migracion_trabajar, &migracion) == 0;
+    migracion_trabajar(&migracion);
+    for (size_t t = 1; t < hilos; t++) {
+        if ( lanzado[t] )
+            pthread_join(ids[t], NULL);
+    }
+    __atomic_store_n(&hash->redimensionando, false, __ATOMIC_RELEASE);
+    hash->redimensiones_paralelas++;
 }
 
-bool hash_iter_al_final(const hash_iter_t* iter) {
-    return ( iter->pos != iter->tabla_largo );
+// Entradas que quedan despues de redimensionar: con iteradores fijados no
+// se compacta, para que las posiciones no cambien bajo sus pies
+size_t entradas_conservadas(const hash_t* hash) {
+    return hash->primer_fijado ? hash->usadas : hash->cantidad;
 }
 
-bool hash_iter_avanzar(hash_iter_t* iter) {
-    if ( hash_iter_al_final(iter) )
+// Arma un indice nuevo y compacta en el lugar las entradas borradas, sin
+// cambiar el orden. Si falla, el hash queda como estaba.
+bool hash_redimensionar(hash_t* hash, size_t capacidad_nueva) {
+    size_t maximas_anteriores = entradas_maximas(hash, hash->capacidad);
+    if ( entradas_maximas(hash, capacidad_nueva) < entradas_conservadas(hash) )
         return false;
-    iter->pos++;
-    iter->act = iter->tabla[iter->pos];
+    size_t ancho;
+    void* bloque;
+    void* indice = hash_indice_armar(hash, &capacidad_nueva, &ancho, &bloque);
+    if ( !indice )
+        return false;
+    size_t maximas = entradas_maximas(hash, capacidad_nueva);
+    if ( maximas > maximas_anteriores ) {
+        entrada_t* entradas = hash_repedir(hash, hash->entradas, maximas_anteriores * sizeof(entrada_t), maximas * sizeof(entrada_t));
+        if ( !entradas ) {
+            hash_liberar(hash, bloque, indice_bytes(hash, capacidad_nueva, ancho));
+            return false;
+        }
+        hash->entradas = entradas;
+    }
+
+    // En paralelo, primero se compacta y despues se arma el indice
+    size_t hilos = hash_hilos_redimension(hash);
+    bool compactar = !hash->primer_fijado;
+    size_t usadas = 0;
+    for (size_t i = 0; i < hash->usadas; i++) {
+        entrada_t entrada = hash->entradas[i];
+        if ( !entrada.nodo ) {
+            usadas += !compactar;
+            continue;
+        }
+        if ( !hash->cuckoo && hilos == 1 ) {
+            size_t libre = indice_buscar_libre(indice, ancho, capacidad_nueva, entrada.hash);
+            indice_escribir(indice, ancho, libre, usadas);
+        }
+        // Antes del primer borrado las entradas no se mueven
+        if ( usadas != i ) {
+            entrada.nodo->posicion = usadas;
+            hash->entradas[usadas] = entrada;
+        }
+        usadas++;
+    }
+    if ( hilos > 1 )
+        hash_migrar(hash, indice, ancho, capacidad_nueva, usadas, hilos);
+
+    hash_liberar_indice(hash);
+    hash->indice = indice;
+    hash->bloque_indice = bloque;
+    hash->ancho_indice = ancho;
+    hash->usadas = usadas;
+    hash->capacidad = capacidad_nueva;
+    hash->sondeos_largos = 0;
+    hash->redimensiones++;
+    if ( hash->filtro )
+        filtro_reconstruir(hash, hash->filtro);
     return true;
 }
 
-const char* hash_iter_ver_actual(const hash_iter_t* iter) {
-    if ( hash_iter_al_final(iter) )
+// Asegura lugar para una entrada mas. Si la mitad de las entradas estan
+// borradas alcanza con compactar, sin agrandar el indice.
+bool hash_reservar(hash_t* hash) {
+    size_t maximas = entradas_maximas(hash, hash->capacidad);
+    if ( hash->usadas < maximas )
+        return true;
+    if ( hash->cantidad * 2 < maximas && !hash->primer_fijado )
+        return hash_redimensionar(hash, hash->capacidad);
+    return hash_redimensionar(hash, hash->capacidad * FACTOR_REDIMENSION);
+}
+
+// Funciones auxiliares del modo cache
+
+size_t cache_bytes_nodo(const nodo_hash_t* nodo) {
+    return sizeof(nodo_hash_t) + nodo->largo + 1;
+}
+
+// Agrega el nodo como el mas reciente (LRU) o detras de la aguja (CLOCK),
+// en ambos casos es el ultimo en ser considerado para desalojar.
+void cache_enlazar(cache_t* cache, nodo_hash_t* nodo) {
+    if ( !cache->primero ) {
+        nodo->rec_ant = nodo;
+        nodo->rec_sig = nodo;
+        cache->primero = nodo;
+        return;
+    }
+    nodo->rec_sig = cache->primero;
+    nodo->rec_ant = cache->primero->rec_ant;
+    nodo->rec_ant->rec_sig = nodo;
+    cache->primero->rec_ant = nodo;
+    if ( cache->politica == HASH_POLITICA_LRU )
+        cache->primero = nodo;
+}
+
+void cache_desenlazar(cache_t* cache, nodo_hash_t* nodo) {
+    if ( nodo->rec_sig == nodo ) {
+        cache->primero = NULL;
+    } else {
+        nodo->rec_ant->rec_sig = nodo->rec_sig;
+        nodo->rec_sig->rec_ant = nodo->rec_ant;
+        if ( cache->primero == nodo )
+            cache->primero = nodo->rec_sig;
+    }
+    nodo->rec_ant = NULL;
+    nodo->rec_sig = NULL;
+}
+
+// Registra un acierto. En CLOCK solo marca el bit, sin tocar la lista.
+void cache_acceder(cache_t* cache, nodo_hash_t* nodo) {
+    if ( cache->politica == HASH_POLITICA_CLOCK ) {
+        nodo->referenciado = true;
+        return;
+    }
+    if ( cache->primero == nodo )
+        return;
+    cache_desenlazar(cache, nodo);
+    cache_enlazar(cache, nodo);
+}
+
+nodo_hash_t* cache_elegir_victima(cache_t* cache) {
+    if ( cache->politica == HASH_POLITICA_LRU )
+        return cache->primero->rec_ant;
+
+    // La aguja da segundas oportunidades a los nodos referenciados
+    while ( cache->primero->referenciado ) {
+        cache->primero->referenciado = false;
+        cache->primero = cache->primero->rec_sig;
+    }
+    return cache->primero;
+}
+
+bool cache_excedido(const hash_t* hash) {
+    const cache_t* cache = hash->cache;
+    if ( cache->max_entradas && hash->cantidad > cache->max_entradas )
+        return true;
+    return cache->max_bytes && cache->bytes > cache->max_bytes;
+}
+
+void hash_desvincular(hash_t* hash, nodo_hash_t* nodo);
+
+// Desaloja hasta respetar los limites, sin desalojar al recien guardado
+void cache_desalojar(hash_t* hash, const nodo_hash_t* protegido) {
+    cache_t* cache = hash->cache;
+    while ( hash->cantidad > 1 && cache_excedido(hash) ) {
+        nodo_hash_t* victima = cache_elegir_victima(cache);
+        if ( victima == protegido ) {
+            cache_acceder(cache, victima);
+            continue;
+        }
+        hash_desvincular(hash, victima);
+        hash_retirar(hash, victima, hash->destruir_dato);
+    }
+}
+
+// Funciones auxiliares de la rueda de temporizadores
+
+uint64_t reloj_monotonico(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+rueda_t* rueda_crear(hash_t* hash, uint64_t (*reloj)(void)) {
+    rueda_t* rueda = hash_pedir(hash, sizeof(rueda_t));
+    if ( !rueda )
         return NULL;
-    nodo_hash_t* ultimo = lista_ver_ultimo(iter->act);
-    char clave_caracter[strlen(ultimo->clave)];
-    strcpy(clave_caracter, ultimo->clave);
-    const char* clave = clave_caracter;
-    return clave;
+    memset(rueda, 0, sizeof(rueda_t));
+    rueda->reloj = reloj;
+    rueda->actual = reloj();
+    return rueda;
 }
 
-void hash_iter_destruir(hash_iter_t* iter) {
-    free(iter);
+void rueda_enlazar(rueda_t* rueda, nodo_hash_t* nodo) {
+    uint64_t vence = nodo->vence < rueda->actual ? rueda->actual : nodo->vence;
+    uint64_t delta = vence - rueda->actual;
+
+    size_t nivel = 0;
+    while ( nivel < RUEDA_NIVELES - 1 && delta >> (RUEDA_BITS * (nivel + 1)) )
+        nivel++;
+    // Lo que no entra en la rueda espera en el ultimo nivel y se reubica
+    // al bajar en cascada
+    uint64_t limite = ((uint64_t)1 << (RUEDA_BITS * RUEDA_NIVELES)) - 1;
+    if ( delta > limite )
+        vence = rueda->actual + limite;
+
+    size_t indice = (vence >> (RUEDA_BITS * nivel)) & (RUEDA_RANURAS - 1);
+    nodo_hash_t** ranura = &rueda->ranuras[nivel][indice];
+    nodo->ranura = ranura;
+    nodo->ttl_ant = NULL;
+    nodo->ttl_sig = *ranura;
+    if ( *ranura )
+        (*ranura)->ttl_ant = nodo;
+    *ranura = nodo;
+}
+
+void rueda_desenlazar(nodo_hash_t* nodo) {
+    if ( nodo->ttl_ant )
+        nodo->ttl_ant->ttl_sig = nodo->ttl_sig;
+    else
+        *nodo->ranura = nodo->ttl_sig;
+    if ( nodo->ttl_sig )
+        nodo->ttl_sig->ttl_ant = nodo->ttl_ant;
+    nodo->ttl_ant = NULL;
+    nodo->ttl_sig = NULL;
+    nodo->ranura = NULL;
+}
+
+void hash_quitar_ttl(hash_t* hash, nodo_hash_t* nodo) {
+    if ( !nodo->con_ttl )
+        return;
+    rueda_desenlazar(nodo);
+    nodo->con_ttl = false;
+    hash->rueda->cantidad--;
+}
+
+// Sin rueda ningun nodo vence, y no se toca la linea de cache de con_ttl
+bool nodo_vencido(const hash_t* hash, const nodo_hash_t* nodo) {
+    return hash->rueda && nodo->con_ttl && nodo->vence <= hash->rueda->reloj();
+}
+
+uint64_t reloj_real(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// Vencimiento del nodo en milisegundos de CLOCK_REALTIME, que a diferencia
+// del reloj de la rueda sigue valiendo despues de reiniciar. 0 si no vence.
+uint64_t nodo_vence_real(const hash_t* hash, const nodo_hash_t* nodo) {
+    if ( !hash->rueda || !nodo->con_ttl )
+        return 0;
+    uint64_t ahora = hash->rueda->reloj();
+    return reloj_real() + (nodo->vence > ahora ? nodo->vence - ahora : 0);
+}
+
+// Funciones auxiliares del registro de cambios
+
+void cambio_liberar(hash_t* hash, cambio_t* cambio) {
+    if ( !cambio->clave )
+        return;
+    hash_liberar(hash, cambio->clave, strlen(cambio->clave) + 1);
+    cambio->clave = NULL;
+}
+
+// Cuenta una modificacion de la clave. Si no hay memoria para anotarla, el
+// registro descarta su historia y las consultas anteriores reciben todo.
+void hash_anotar_cambio(hash_t* hash, const char* clave) {
+    hash->version++;
+    cambios_t* cambios = hash->cambios;
+    if ( !cambios )
+        return;
+    cambio_t* cambio = &cambios->registro[cambios->siguiente];
+    // La ranura que se pisa tenia el cambio mas viejo
+    if ( cambio->clave )
+        cambios->desde = cambio->version;
+    cambio_liberar(hash, cambio);
+    size_t largo = strlen(clave) + 1;
+    cambio->clave = hash_pedir(hash, largo);
+    if ( !cambio->clave ) {
+        cambios->desde = hash->version;
+        return;
+    }
+    memcpy(cambio->clave, clave, largo);
+    cambio->version = hash->version;
+    cambios->siguiente = (cambios->siguiente + 1) % cambios->capacidad;
+}
+
+// Busca el dato actual sin contar estadisticas ni descartar vencidas
+bool hash_dato_actual(const hash_t* hash, const char* clave, void** dato) {
+    if ( hash->congelado ) {
+        size_t posicion = congelado_buscar(hash->congelado, clave);
+        if ( posicion == congelado_cantidad(hash->congelado) )
+            return false;
+        *dato = congelado_dato(hash->congelado, posicion);
+        return true;
+    }
+    nodo_hash_t* nodo = hash_sondear(hash, clave, hash->funcion_hash(clave));
+    if ( !nodo || nodo_vencido(hash, nodo) )
+        return false;
+    *dato = nodo->dato;
+    return true;
+}
+
+void hash_enviar_todo(const hash_t* hash, hash_visitar_cambio_t visitar, void* extra) {
+    visitar(HASH_CAMBIO_REINICIO, NULL, NULL, extra);
+    if ( hash->congelado ) {
+        for (size_t i = 0; i < hash->cantidad; i++)
+            visitar(HASH_CAMBIO_GUARDADO, congelado_clave(hash->congelado, i), congelado_dato(hash->congelado, i), extra);
+        return;
+    }
+    for (size_t i = 0; i < hash->usadas; i++) {
+        const nodo_hash_t* nodo = hash->entradas[i].nodo;
+        if ( nodo && !nodo_vencido(hash, nodo) )
+            visitar(HASH_CAMBIO_GUARDADO, nodo->clave, nodo->dato, extra);
+    }
+}
+
+// Saca al nodo de todas las estructuras del hash, sin liberarlo
+void hash_desvincular(hash_t* hash, nodo_hash_t* nodo) {
+    if ( hash->cache ) {
+        cache_desenlazar(hash->cache, nodo);
+        hash->cache->bytes -= cache_bytes_nodo(nodo);
+    }
+    hash_quitar_ttl(hash, nodo);
+    hash_quitar_nodo(hash, nodo);
+    hash_anotar_cambio(hash, nodo->clave);
+    // Un error de escritura queda registrado y lo informa la sincronizacion
+    if ( hash->registro )
+        registro_anotar(hash->registro, REGISTRO_BORRAR, nodo->clave, NULL, 0);
+}
+
+// Busca la clave descartando (y liberando) la entrada si ya vencio
+nodo_hash_t* hash_buscar_vigente(const hash_t* hash, const char* clave, unsigned long h) {
+    nodo_hash_t* nodo = hash_buscar_nodo(hash, clave, h);
+    if ( nodo && nodo_vencido(hash, nodo) ) {
+        // Expiracion perezosa: la consulta es logicamente de solo lectura
+        hash_t* mutable = (hash_t*)hash;
+        hash_desvincular(mutable, nodo);
+        hash_retirar(mutable, nodo, hash->destruir_dato);
+        return NULL;
+    }
+    return nodo;
+}
+
+// El sondeo de una clave cuckoo es 1 o 2 segun en cual de sus baldes este,
+// o 3 si quedo en el desborde
+void cuckoo_estadisticas(const hash_t* hash, hash_estadisticas_t* estadisticas) {
+    const balde_cuckoo_t* baldes = hash->indice;
+    size_t cantidad_baldes = hash->capacidad / CUCKOO_VIAS;
+    for (size_t b = 0; b <= cantidad_baldes; b++) {
+        for (size_t via = 0; via < CUCKOO_VIAS; via++) {
+            if ( baldes[b].posiciones[via] == POSICION_VACIA )
+                continue;
+            size_t elegidos[2];
+            cuckoo_baldes(baldes[b].hashes[via], cantidad_baldes, elegidos);
+            size_t largo = b == cantidad_baldes ? 3 : b == elegidos[0] ? 1 : 2;
+            estadisticas->baldes_ocupados++;
+            if ( largo > estadisticas->cadena_maxima )
+                estadisticas->cadena_maxima = largo;
+        }
+    }
+}
+
+// Primitivas del hash
+
+hash_t* hash_crear(hash_destruir_dato_t destruir_dato) {
+    return hash_crear_con_allocador(NULL, NULL, NULL, NULL, destruir_dato);
+}
+
+// Crea un hash vacio con el indice pedido
+hash_t* hash_armar(const allocador_t* allocador, bool cuckoo, hash_destruir_dato_t destruir_dato) {
+    hash_t* hash = allocador_pedir(allocador, sizeof(hash_t));
+    if ( !hash )
+        return NULL;
+    hash->allocador = *allocador;
+    hash->memoria = sizeof(hash_t);
+    hash->limite_memoria = 0;
+    hash->paginas_grandes = false;
+    hash->prefaultear = false;
+    hash->version = 0;
+    hash->cambios = NULL;
+    hash->hilos_redimension = 1;
+    hash->redimensiones = 0;
+    hash->redimensiones_paralelas = 0;
+    hash->redimensionando = false;
+    hash->franjas_movidas = 0;
+    hash->franjas_totales = 0;
+    hash->primer_fijado = NULL;
+    hash->ultimo_fijado = NULL;
+    hash->primer_retirado = NULL;
+    hash->ultimo_retirado = NULL;
+    hash->cuckoo = cuckoo;
+    hash->usadas = 0;
+    hash->entradas = NULL;
+
+    hash->capacidad = cuckoo ? CUCKOO_CAPACIDAD_INICIAL : CAPACIDAD_INICIAL;
+    hash->indice = hash_indice_armar(hash, &hash->capacidad, &hash->ancho_indice, &hash->bloque_indice);
+    if ( hash->indice )
+        hash->entradas = hash_pedir(hash, entradas_maximas(hash, hash->capacidad) * sizeof(entrada_t));
+    if ( !hash->entradas ) {
+        if ( hash->indice )
+            hash_liberar_indice(hash);
+        allocador_liberar(allocador, hash);
+        return NULL;
+    }
+
+    hash->funcion_hash = f_hash;
+    hash->sondeos_largos = 0;
+    hash->cantidad = 0;
+    hash->destruir_dato = destruir_dato;
+    hash->cache = NULL;
+    hash->rueda = NULL;
+    hash->filtro = NULL;
+    hash->registro = NULL;
+    hash->serializar = NULL;
+    hash->siguiente_diferido = NULL;
+    hash->traza = NULL;
+    hash->congelado = NULL;
+    return hash;
+}
+
+hash_t* hash_crear_con_allocador(allocador_pedir_t pedir, allocador_redimensionar_t redimensionar,
+                                 allocador_liberar_t liberar, void* contexto, hash_destruir_dato_t destruir_dato) {
+    allocador_t allocador = { pedir, redimensionar, liberar, contexto };
+    return hash_armar(&allocador, false, destruir_dato);
+}
+
+hash_t* hash_cuckoo_crear(hash_destruir_dato_t destruir_dato) {
+    allocador_t allocador = { NULL, NULL, NULL, NULL };
+    return hash_armar(&allocador, true, destruir_dato);
+}
+
+hash_t* hash_cache_crear(size_t max_entradas, size_t max_bytes, hash_politica_t politica, hash_destruir_dato_t destruir_dato) {
+    if ( !max_entradas && !max_bytes )
+        return NULL;
+
+    hash_t* hash = hash_crear(destruir_dato);
+    if ( !hash )
+        return NULL;
+
+    cache_t* cache = hash_pedir(hash, sizeof(cache_t));
+    if ( !cache ) {
+        hash_destruir(hash);
+        return NULL;
+    }
+
+    cache->politica = politica;
+    cache->max_entradas = max_entradas;
+    cache->max_bytes = max_bytes;
+    cache->bytes = 0;
+    cache->primero = NULL;
+    hash->cache = cache;
+    return hash;
+}
+
+size_t hash_cantidad(const hash_t* hash) {
+    return hash->cantidad;
+}
+
+void hash_estadisticas(const hash_t* hash, hash_estadisticas_t* estadisticas) {
+    estadisticas->redimensiones = hash->redimensiones;
+    estadisticas->redimensiones_paralelas = hash->redimensiones_paralelas;
+    if ( hash->congelado ) {
+        // Cada clave tiene su posicion y se encuentra al primer intento
+        estadisticas->cantidad = hash->cantidad;
+        estadisticas->capacidad = hash->cantidad;
+        estadisticas->baldes_ocupados = hash->cantidad;
+        estadisticas->cadena_maxima = hash->cantidad ? 1 : 0;
+        estadisticas->factor_carga = hash->cantidad ? 1 : 0;
+        return;
+    }
+    estadisticas->cantidad = hash->cantidad;
+    estadisticas->capacidad = hash->capacidad;
+    estadisticas->baldes_ocupados = 0;
+    estadisticas->cadena_maxima = 0;
+    estadisticas->factor_carga = (double)hash->cantidad / (double)hash->capacidad;
+    if ( hash->cuckoo ) {
+        cuckoo_estadisticas(hash, estadisticas);
+        return;
+    }
+    for (size_t i=0; i < hash->capacidad; i++) {
+        size_t posicion = indice_leer(hash->indice, hash->ancho_indice, i);
+        if ( posicion >= POSICION_BORRADA )
+            continue;
+        // Largo del sondeo desde la posicion inicial de la clave
+        size_t inicial = indice_inicial(hash->entradas[posicion].hash, hash->capacidad);
+        size_t largo = (i + hash->capacidad - inicial) % hash->capacidad + 1;
+        estadisticas->baldes_ocupados++;
+        if ( largo > estadisticas->cadena_maxima )
+            estadisticas->cadena_maxima = largo;
+    }
+}
+
+// Se graba f_hash y no la funcion actual de la tabla, que cambia al
+// sembrarla: asi una misma clave tiene el mismo hash en toda la traza
+void hash_trazar(const hash_t* hash, traza_operacion_t operacion, const char* clave) {
+    if ( hash->traza )
+        traza_anotar(hash->traza, operacion, clave, f_hash(clave));
+}
+
+bool hash_traza_iniciar(hash_t* hash, const char* ruta, bool con_claves) {
+    traza_t* traza = traza_crear(ruta, con_claves);
+    if ( !traza )
+        return false;
+    hash_traza_detener(hash);
+    hash->traza = traza;
+    return true;
+}
+
+bool hash_traza_detener(hash_t* hash) {
+    if ( !hash->traza )
+        return true;
+    bool ok = traza_cerrar(hash->traza);
+    hash->traza = NULL;
+    return ok;
+}
+
+size_t hash_memoria(const hash_t* hash) {
+    return hash->memoria;
+}
+
+void hash_limitar_memoria(hash_t* hash, size_t max_bytes) {
+    hash->limite_memoria = max_bytes;
+}
+
+bool hash_configurar_paginas(hash_t* hash, bool paginas_grandes, bool prefaultear) {
+    // Cambiar como se piden los bloques grandes solo es seguro si no hay
+    // ninguno: se liberarian de otra forma que como se pidieron
+    if ( paginas_grandes != hash->paginas_grandes ) {
+        if ( hash->usadas || hash->congelado )
+            return false;
+        size_t mayor = indice_bytes(hash, hash->capacidad, hash->ancho_indice);
+        size_t entradas = entradas_maximas(hash, hash->capacidad) * sizeof(entrada_t);
+        if ( entradas > mayor )
+            mayor = entradas;
+        if ( hash->filtro && filtro_bytes(hash->filtro) > mayor )
+            mayor = filtro_bytes(hash->filtro);
+        if ( hash->cambios && hash->cambios->capacidad * sizeof(cambio_t) > mayor )
+            mayor = hash->cambios->capacidad * sizeof(cambio_t);
+        if ( mayor >= PAGINA_GRANDE )
+            return false;
+    }
+    hash->paginas_grandes = paginas_grandes;
+    hash->prefaultear = prefaultear;
+    return true;
+}
+
+void hash_configurar_redimension(hash_t* hash, size_t hilos) {
+    hash->hilos_redimension = hilos;
+}
+
+bool hash_redimension_progreso(const hash_t* hash, size_t* movidas, size_t* totales) {
+    bool en_curso = __atomic_load_n(&hash->redimensionando, __ATOMIC_ACQUIRE);
+    *movidas = __atomic_load_n(&hash->franjas_movidas, __ATOMIC_RELAXED);
+    *totales = __atomic_load_n(&hash->franjas_totales, __ATOMIC_RELAXED);
+    return en_curso;
+}
+
+bool hash_pertenece(const hash_t* hash, const char* clave) {
+    hash_trazar(hash, TRAZA_PERTENECE, clave);
+    if ( hash->congelado )
+        return congelado_buscar(hash->congelado, clave) < hash->cantidad;
+    return hash_buscar_vigente(hash, clave, hash->funcion_hash(clave));
+}
+
+// Anota el guardado en el registro, si lo hay. Se anota antes de aplicarlo,
+// para que si la escritura falla la tabla quede como estaba. vence_real es
+// el vencimiento absoluto de nodo_vence_real (0: no vence).
+bool hash_anotar_guardar(hash_t* hash, const char* clave, void* dato, uint64_t vence_real) {
+    if ( !hash->registro )
+        return true;
+    size_t largo = 0;
+    const void* bytes = hash->serializar(dato, &largo);
+    if ( vence_real )
+        return registro_anotar_con_vencimiento(hash->registro, clave, vence_real, bytes, largo);
+    return registro_anotar(hash->registro, REGISTRO_GUARDAR, clave, bytes, largo);
+}
+
+// Anula un guardado ya anotado que despues no se pudo aplicar (solo falla
+// agregar una clave nueva), para que la recuperacion no la reviva. Un error
+// de escritura queda registrado y lo informa la sincronizacion.
+void hash_anular_guardar(hash_t* hash, const char* clave) {
+    if ( hash->registro )
+        registro_anotar(hash->registro, REGISTRO_BORRAR, clave, NULL, 0);
+}
+
+nodo_hash_t* hash_agregar_nodo(hash_t* hash, const char* clave, void* dato, unsigned long h);
+
+// Guarda el par y devuelve el nodo que lo contiene, o NULL si no pudo.
+// vence_real solo se usa para anotarlo en el registro.
+nodo_hash_t* hash_guardar_nodo(hash_t* hash, const char* clave, void* dato, uint64_t vence_real) {
+    if ( hash->congelado || !hash_anotar_guardar(hash, clave, dato, vence_real) )
+        return NULL;
+
+    unsigned long h = hash->funcion_hash(clave);
+    nodo_hash_t* existente = hash_buscar_nodo(hash, clave, h);
+    if ( existente ) {
+        if ( hash->destruir_dato )
+            hash->destruir_dato(existente->dato);
+        existente->dato = dato;
+        hash_anotar_cambio(hash, clave);
+        if ( hash->cache )
+            cache_acceder(hash->cache, existente);
+        return existente;
+    }
+    nodo_hash_t* nodo = hash_agregar_nodo(hash, clave, dato, h);
+    if ( !nodo )
+        hash_anular_guardar(hash, clave);
+    return nodo;
+}
+
+// Agrega una clave que no esta en el hash
+nodo_hash_t* hash_agregar_nodo(hash_t* hash, const char* clave, void* dato, unsigned long h) {
+    if ( !hash_reservar(hash) )
+        return NULL;
+
+    nodo_hash_t* nodo_hash = nodo_hash_crear(hash, clave, dato);
+    if ( !nodo_hash )
+        return NULL;
+
+    if ( !hash_insertar_nodo(hash, nodo_hash, h) ) {
+        nodo_hash_destruir(hash, nodo_hash, NULL);
+        return NULL;
+    }
+    // Si la tabla cambio de funcion al insertar, h ya no es el hash del nodo
+    if ( hash->filtro )
+        filtro_agregar(hash->filtro, hash->entradas[nodo_hash->posicion].hash);
+    hash_anotar_cambio(hash, nodo_hash->clave);
+
+    if ( hash->cache ) {
+        cache_enlazar(hash->cache, nodo_hash);
+        hash->cache->bytes += cache_bytes_nodo(nodo_hash);
+        cache_desalojar(hash, nodo_hash);
+    }
+    return nodo_hash;
+}
+
+bool hash_guardar(hash_t* hash, const char* clave, void* dato) {
+    hash_trazar(hash, TRAZA_GUARDAR, clave);
+    nodo_hash_t* nodo = hash_guardar_nodo(hash, clave, dato, 0);
+    if ( !nodo )
+        return false;
+    if ( hash->rueda )
+        hash_quitar_ttl(hash, nodo);
+    return true;
+}
+
+// Una sola redimension para todo el lote en lugar de varias intermedias
+void hash_reservar_lote(hash_t* hash, size_t cantidad) {
+    size_t capacidad = hash->capacidad;
+    while ( entradas_conservadas(hash) + cantidad > entradas_maximas(hash, capacidad) )
+        capacidad *= FACTOR_REDIMENSION;
+    if ( hash->usadas + cantidad > entradas_maximas(hash, hash->capacidad) )
+        hash_redimensionar(hash, capacidad);
+}
+
+size_t hash_guardar_lote(hash_t* hash, const char** claves, void** datos, size_t cantidad) {
+    if ( hash->congelado )
+        return 0;
+    hash_reservar_lote(hash, cantidad);
+
+    size_t guardados = 0;
+    for (size_t i = 0; i < cantidad; i++) {
+        if ( !hash_guardar(hash, claves[i], datos[i]) )
+            break;
+        guardados++;
+    }
+    return guardados;
+}
+
+nodo_hash_t* hash_obtener_o_agregar(hash_t* hash, const char* clave, unsigned long h, bool* insertado) {
+    hash_trazar(hash, TRAZA_GUARDAR, clave);
+    nodo_hash_t* nodo = hash_buscar_vigente(hash, clave, h);
+    *insertado = !nodo;
+    if ( !nodo )
+        return hash_agregar_nodo(hash, clave, NULL, h);
+    // Encontrarla no la modifica: solo el alta anota un cambio
+    if ( hash->cache )
+        cache_acceder(hash->cache, nodo);
+    return nodo;
+}
+
+void** hash_obtener_o_insertar(hash_t* hash, const char* clave, bool* insertado) {
+    // El registro anota el dato antes de guardarlo, y aca todavia no existe
+    if ( hash->congelado || hash->registro )
+        return NULL;
+    nodo_hash_t* nodo = hash_obtener_o_agregar(hash, clave, hash->funcion_hash(clave), insertado);
+    return nodo ? &nodo->dato : NULL;
+}
+
+// Primera etapa de la prebusqueda: trae la linea del indice (o los dos
+// baldes cuckoo) donde empieza el sondeo
+void hash_prebuscar_indice(const hash_t* hash, unsigned long h) {
+#ifdef __GNUC__
+    if ( hash->cuckoo ) {
+        const balde_cuckoo_t* baldes = hash->indice;
+        size_t elegidos[2];
+        cuckoo_baldes(h, hash->capacidad / CUCKOO_VIAS, elegidos);
+        __builtin_prefetch(&baldes[elegidos[0]]);
+        __builtin_prefetch(&baldes[elegidos[1]]);
+        return;
+    }
+    __builtin_prefetch((const char*)hash->indice + indice_inicial(h, hash->capacidad) * hash->ancho_indice);
+#else
+    (void)hash;
+    (void)h;
+#endif
+}
+
+// Segunda etapa, con la linea del indice ya en cache: trae la entrada de
+// la primera posicion del sondeo
+void hash_prebuscar_entrada(const hash_t* hash, unsigned long h) {
+#ifdef __GNUC__
+    if ( hash->cuckoo )
+        return;
+    size_t posicion = indice_leer(hash->indice, hash->ancho_indice, indice_inicial(h, hash->capacidad));
+    if ( posicion < hash->usadas )
+        __builtin_prefetch(&hash->entradas[posicion]);
+#else
+    (void)hash;
+    (void)h;
+#endif
+}
+
+// Tercera etapa, con la entrada ya en cache: trae el nodo si su hash
+// coincide, para comparar la clave
+void hash_prebuscar_nodo(const hash_t* hash, unsigned long h) {
+#ifdef __GNUC__
+    if ( hash->cuckoo )
+        return;
+    size_t posicion = indice_leer(hash->indice, hash->ancho_indice, indice_inicial(h, hash->capacidad));
+    if ( posicion < hash->usadas && hash->entradas[posicion].hash == h )
+        __builtin_prefetch(hash->entradas[posicion].nodo);
+#else
+    (void)hash;
+    (void)h;
+#endif
+}
+
+size_t hash_obtener_o_insertar_lote(hash_t* hash, const char** claves, size_t cantidad, void*** datos, bool* insertados) {
+    // En una cache, una clave nueva del lote podria desalojar un nodo cuya
+    // direccion ya se devolvio
+    if ( hash->congelado || hash->registro || hash->cache )
+        return 0;
+    hash_reservar_lote(hash, cantidad);
+
+    unsigned long hashes[LOTE_HASHES];
+    for (size_t inicio = 0; inicio < cantidad; inicio += LOTE_HASHES) {
+        size_t largo = cantidad - inicio < LOTE_HASHES ? cantidad - inicio : LOTE_HASHES;
+        const char** lote = claves + inicio;
+        // Sin dependencias entre iteraciones: el procesador superpone los hashes
+        for (size_t i = 0; i < largo; i++)
+            hashes[i] = hash->funcion_hash(lote[i]);
+        for (size_t i = 0; i < largo && i < 3 * LOTE_ADELANTO; i++)
+            hash_prebuscar_indice(hash, hashes[i]);
+
+        // Cada clave pasa por las tres etapas antes de que le toque
+        for (size_t i = 0; i < largo; i++) {
+            if ( i + 3 * LOTE_ADELANTO < largo )
+                hash_prebuscar_indice(hash, hashes[i + 3 * LOTE_ADELANTO]);
+            if ( i + 2 * LOTE_ADELANTO < largo )
+                hash_prebuscar_entrada(hash, hashes[i + 2 * LOTE_ADELANTO]);
+            if ( i + LOTE_ADELANTO < largo )
+                hash_prebuscar_nodo(hash, hashes[i + LOTE_ADELANTO]);
+            unsigned long (*funcion)(const char*) = hash->funcion_hash;
+            nodo_hash_t* nodo = hash_obtener_o_agregar(hash, lote[i], hashes[i], &insertados[inicio + i]);
+            if ( !nodo )
+                return inicio + i;
+            // Muchas colisiones cambiaron la funcion: los hashes siguientes no valen
+            for (size_t j = i + 1; funcion != hash->funcion_hash && j < largo; j++)
+                hashes[j] = hash->funcion_hash(lote[j]);
+            datos[inicio + i] = &nodo->dato;
+        }
+    }
+    return cantidad;
+}
+
+bool hash_actualizar(hash_t* hash, const char* clave, hash_actualizar_t actualizar, void* extra) {
+    bool insertado;
+    void** dato = hash_obtener_o_insertar(hash, clave, &insertado);
+    if ( !dato )
+        return false;
+    *dato = actualizar(clave, *dato, !insertado, extra);
+    // El alta ya se anoto al insertar
+    if ( !insertado )
+        hash_anotar_cambio(hash, clave);
+    return true;
+}
+
+bool hash_configurar_reloj(hash_t* hash, uint64_t (*reloj)(void)) {
+    if ( hash->congelado )
+        return false;
+    if ( !hash->rueda ) {
+        hash->rueda = rueda_crear(hash, reloj);
+        return hash->rueda;
+    }
+    hash->rueda->reloj = reloj;
+    return true;
+}
+
+bool hash_guardar_con_ttl(hash_t* hash, const char* clave, void* dato, uint64_t ttl) {
+    if ( !hash->rueda && !hash_configurar_reloj(hash, reloj_monotonico) )
+        return false;
+    hash_trazar(hash, TRAZA_GUARDAR, clave);
+
+    // Un hash persistente anota el vencimiento absoluto, no el ttl
+    uint64_t vence_real = hash->registro ? reloj_real() + ttl : 0;
+    nodo_hash_t* nodo = hash_guardar_nodo(hash, clave, dato, vence_real);
+    if ( !nodo )
+        return false;
+
+    hash_quitar_ttl(hash, nodo);
+    nodo->con_ttl = true;
+    nodo->vence = hash->rueda->reloj() + ttl;
+    rueda_enlazar(hash->rueda, nodo);
+    hash->rueda->cantidad++;
+    return true;
+}
+
+// Baja en cascada la ranura del nivel que corresponde al tick actual
+bool rueda_cascada(hash_t* hash, size_t nivel, size_t* trabajo, size_t max_trabajo) {
+    rueda_t* rueda = hash->rueda;
+    size_t indice = (rueda->actual >> (RUEDA_BITS * nivel)) & (RUEDA_RANURAS - 1);
+    nodo_hash_t** ranura = &rueda->ranuras[nivel][indice];
+    while ( *ranura ) {
+        if ( *trabajo >= max_trabajo )
+            return false;
+        nodo_hash_t* nodo = *ranura;
+        rueda_desenlazar(nodo);
+        rueda_enlazar(rueda, nodo);
+        (*trabajo)++;
+    }
+    return true;
+}
+
+// Devuelve el primer tick desde el actual, sin pasar de hasta + 1, en que
+// hay nodos para expirar o bajar en cascada. Alcanza con mirar RUEDA_RANURAS
+// ticks del nivel 0 y RUEDA_RANURAS bordes de cada nivel superior: en ese
+// tramo se pasa una vez por cada ranura.
+uint64_t rueda_proximo(const rueda_t* rueda, uint64_t hasta) {
+    uint64_t proximo = hasta + 1;
+    for (size_t nivel = 0; nivel < RUEDA_NIVELES; nivel++) {
+        size_t bits = RUEDA_BITS * nivel;
+        uint64_t borde = (rueda->actual + ((uint64_t)1 << bits) - 1) >> bits;
+        for (size_t i = 0; i < RUEDA_RANURAS && (borde << bits) < proximo; i++, borde++) {
+            if ( rueda->ranuras[nivel][borde & (RUEDA_RANURAS - 1)] ) {
+                proximo = borde << bits;
+                break;
+            }
+        }
+    }
+    return proximo;
+}
+
+size_t hash_expirar(hash_t* hash, uint64_t ahora, size_t max_trabajo) {
+    rueda_t* rueda = hash->rueda;
+    if ( !rueda )
+        return 0;
+
+    size_t expirados = 0;
+    size_t trabajo = 0;
+    while ( rueda->actual <= ahora && trabajo < max_trabajo ) {
+        if ( !rueda->cantidad ) {
+            rueda->actual = ahora + 1;
+            break;
+        }
+        // Los ticks sin nodos se saltean sin contar trabajo
+        rueda->actual = rueda_proximo(rueda, ahora);
+        if ( rueda->actual > ahora )
+            break;
+
+        // La cascada es idempotente para un mismo tick, por lo que si se
+        // corta por falta de trabajo se retoma en la proxima llamada
+        bool completo = true;
+        for (size_t nivel = RUEDA_NIVELES - 1; nivel > 0 && completo; nivel--) {
+            uint64_t mascara = ((uint64_t)1 << (RUEDA_BITS * nivel)) - 1;
+            if ( !(rueda->actual & mascara) )
+                completo = rueda_cascada(hash, nivel, &trabajo, max_trabajo);
+        }
+        if ( !completo )
+            break;
+
+        nodo_hash_t** ranura = &rueda->ranuras[0][rueda->actual & (RUEDA_RANURAS - 1)];
+        while ( *ranura && trabajo < max_trabajo ) {
+            nodo_hash_t* nodo = *ranura;
+            trabajo++;
+            if ( nodo->vence > ahora ) {
+                rueda_desenlazar(nodo);
+                rueda_enlazar(rueda, nodo);
+                continue;
+            }
+            hash_desvincular(hash, nodo);
+            hash_retirar(hash, nodo, hash->destruir_dato);
+            expirados++;
+        }
+        if ( *ranura )
+            break;
+        rueda->actual++;
+    }
+    return expirados;
+}
+
+bool hash_filtro_activar(hash_t* hash, size_t bits_por_clave) {
+    if ( hash->congelado )
+        return false;
+    filtro_t* filtro = hash_pedir(hash, sizeof(filtro_t));
+    if ( !filtro )
+        return false;
+    memset(filtro, 0, sizeof(filtro_t));
+    filtro->bits_por_clave = bits_por_clave ? bits_por_clave : 1;
+    if ( !filtro_reconstruir(hash, filtro) ) {
+        hash_liberar(hash, filtro, sizeof(filtro_t));
+        return false;
+    }
+    hash_filtro_desactivar(hash);
+    hash->filtro = filtro;
+    return true;
+}
+
+void hash_filtro_desactivar(hash_t* hash) {
+    if ( !hash->filtro )
+        return;
+    hash_liberar(hash, hash->filtro->memoria, filtro_bytes(hash->filtro));
+    hash_liberar(hash, hash->filtro, sizeof(filtro_t));
+    hash->filtro = NULL;
+}
+
+void hash_filtro_estadisticas(const hash_t* hash, hash_filtro_estadisticas_t* estadisticas) {
+    const filtro_t* filtro = hash->filtro;
+    if ( !filtro ) {
+        memset(estadisticas, 0, sizeof(hash_filtro_estadisticas_t));
+        return;
+    }
+    estadisticas->consultas = filtro->consultas;
+    estadisticas->descartes = filtro->descartes;
+    estadisticas->falsos_positivos = filtro->falsos_positivos;
+    size_t negativos = filtro->descartes + filtro->falsos_positivos;
+    estadisticas->tasa_falsos_positivos = negativos ? (double)filtro->falsos_positivos / (double)negativos : 0;
+    estadisticas->bytes = filtro_bytes(filtro);
+}
+
+bool hash_cambios_activar(hash_t* hash, size_t capacidad) {
+    if ( !capacidad )
+        return false;
+    cambios_t* cambios = hash_pedir(hash, sizeof(cambios_t));
+    cambio_t* registro = hash_pedir(hash, capacidad * sizeof(cambio_t));
+    if ( !cambios || !registro ) {
+        hash_liberar(hash, cambios, sizeof(cambios_t));
+        hash_liberar(hash, registro, capacidad * sizeof(cambio_t));
+        return false;
+    }
+    memset(registro, 0, capacidad * sizeof(cambio_t));
+    hash_cambios_desactivar(hash);
+    cambios->registro = registro;
+    cambios->capacidad = capacidad;
+    cambios->siguiente = 0;
+    cambios->desde = hash->version;
+    hash->cambios = cambios;
+    return true;
+}
+
+void hash_cambios_desactivar(hash_t* hash) {
+    cambios_t* cambios = hash->cambios;
+    if ( !cambios )
+        return;
+    for (size_t i = 0; i < cambios->capacidad; i++)
+        cambio_liberar(hash, &cambios->registro[i]);
+    hash_liberar(hash, cambios->registro, cambios->capacidad * sizeof(cambio_t));
+    hash_liberar(hash, cambios, sizeof(cambios_t));
+    hash->cambios = NULL;
+}
+
+uint64_t hash_version(const hash_t* hash) {
+    return hash->version;
+}
+
+uint64_t hash_cambios_desde(const hash_t* hash, uint64_t version, hash_visitar_cambio_t visitar, void* extra) {
+    const cambios_t* cambios = hash->cambios;
+    if ( version == hash->version )
+        return version;
+    // Las claves ya enviadas se saltean: se recorre del cambio mas nuevo al
+    // mas viejo y cada clave se informa una vez, con su estado actual
+    hash_t* enviadas = cambios && version >= cambios->desde && version < hash->version ? hash_crear(NULL) : NULL;
+    if ( !enviadas ) {
+        hash_enviar_todo(hash, visitar, extra);
+        return hash->version;
+    }
+    for (size_t i = 0; i < cambios->capacidad; i++) {
+        const cambio_t* cambio = &cambios->registro[(cambios->siguiente + cambios->capacidad - 1 - i) % cambios->capacidad];
+        if ( !cambio->clave || cambio->version <= version )
+            break;
+        if ( hash_pertenece(enviadas, cambio->clave) )
+            continue;
+        if ( !hash_guardar(enviadas, cambio->clave, NULL) ) {
+            hash_destruir(enviadas);
+            hash_enviar_todo(hash, visitar, extra);
+            return hash->version;
+        }
+        void* dato = NULL;
+        if ( hash_dato_actual(hash, cambio->clave, &dato) )
+            visitar(HASH_CAMBIO_GUARDADO, cambio->clave, dato, extra);
+        else
+            visitar(HASH_CAMBIO_BORRADO, cambio->clave, NULL, extra);
+    }
+    hash_destruir(enviadas);
+    return hash->version;
+}
+
+bool hash_congelar(hash_t* hash) {
+    if ( hash->congelado )
+        return true;
+    if ( hash->cache || hash->rueda || hash->registro || hash->primer_fijado )
+        return false;
+
+    // Arreglos temporales, fuera de la cuenta de la tabla
+    const char** claves = allocador_pedir(&hash->allocador, hash->cantidad * sizeof(char*) + 1);
+    void** datos = allocador_pedir(&hash->allocador, hash->cantidad * sizeof(void*) + 1);
+    congelado_t* congelado = NULL;
+    if ( claves && datos ) {
+        size_t n = 0;
+        for (size_t i = 0; i < hash->usadas; i++) {
+            if ( !hash->entradas[i].nodo )
+                continue;
+            claves[n] = hash->entradas[i].nodo->clave;
+            datos[n++] = hash->entradas[i].nodo->dato;
+        }
+        congelado = congelado_crear(claves, datos, n, &hash->allocador);
+    }
+    if ( claves )
+        allocador_liberar(&hash->allocador, claves);
+    if ( datos )
+        allocador_liberar(&hash->allocador, datos);
+    if ( !congelado )
+        return false;
+    // Mientras se construye conviven ambas representaciones
+    if ( hash->limite_memoria && hash->memoria + congelado_memoria(congelado) > hash->limite_memoria ) {
+        congelado_destruir(congelado, NULL);
+        return false;
+    }
+
+    for (size_t i = 0; i < hash->usadas; i++) {
+        if ( hash->entradas[i].nodo )
+            nodo_hash_destruir(hash, hash->entradas[i].nodo, NULL);
+    }
+    hash_filtro_desactivar(hash);
+    hash_liberar_indice(hash);
+    hash_liberar(hash, hash->entradas, entradas_maximas(hash, hash->capacidad) * sizeof(entrada_t));
+    hash->entradas = NULL;
+    hash->ancho_indice = 0;
+    hash->capacidad = 0;
+    hash->usadas = 0;
+    hash->congelado = congelado;
+    hash->memoria += congelado_memoria(congelado);
+    return true;
+}
+
+bool hash_congelado(const hash_t* hash) {
+    return hash->congelado;
+}
+
+// Funciones auxiliares de las operaciones entre tablas. Una fase paralela
+// recorre las entradas de una tabla por tramos y busca cada clave en la
+// otra, sin modificar ninguna de las dos; despues, en el hilo que llamo,
+// se aplican los cambios en el orden de las entradas.
+
+typedef struct tramo {
+    const hash_t* recorrida;
+    const hash_t* consultada;
+    bool destino_recorrido; // si la recorrida es el destino (para el resolver)
+    size_t desde;
+    size_t hasta;
+    nodo_hash_t** encontrados; // nodo de la consultada, por posicion de la recorrida
+    void** resueltos;          // dato combinado, si hay resolver
+    hash_resolver_t resolver;
+    void* extra;
+} tramo_t;
+
+void* tramo_procesar(void* extra) {
+    tramo_t* tramo = extra;
+    bool misma_funcion = tramo->recorrida->funcion_hash == tramo->consultada->funcion_hash;
+    for (size_t i = tramo->desde; i < tramo->hasta; i++) {
+        const entrada_t* entrada = &tramo->recorrida->entradas[i];
+        tramo->encontrados[i] = NULL;
+        if ( !entrada->nodo )
+            continue;
+        const char* clave = entrada->nodo->clave;
+        unsigned long h = misma_funcion ? entrada->hash : tramo->consultada->funcion_hash(clave);
+        nodo_hash_t* otro = hash_sondear(tramo->consultada, clave, h);
+        tramo->encontrados[i] = otro;
+        if ( !otro || !tramo->resolver )
+            continue;
+        if ( tramo->destino_recorrido )
+            tramo->resueltos[i] = tramo->resolver(clave, entrada->nodo->dato, otro->dato, tramo->extra);
+        else
+            tramo->resueltos[i] = tramo->resolver(clave, otro->dato, entrada->nodo->dato, tramo->extra);
+    }
+    return NULL;
+}
+
+// Reparte las entradas de la recorrida en tramos contiguos, uno por hilo.
+// El primer tramo lo procesa el hilo que llama; si no se puede crear un
+// hilo, su tramo tambien.
+void tramos_procesar(const tramo_t* base) {
+    size_t usadas = base->recorrida->usadas;
+    long nucleos = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t hilos = usadas / PARALELO_MINIMO + 1;
+    if ( nucleos > 0 && hilos > (size_t)nucleos )
+        hilos = (size_t)nucleos;
+    if ( hilos > PARALELO_MAX_HILOS )
+        hilos = PARALELO_MAX_HILOS;
+
+    tramo_t tramos[PARALELO_MAX_HILOS];
+    pthread_t ids[PARALELO_MAX_HILOS];
+    bool lanzado[PARALELO_MAX_HILOS];
+    for (size_t t = 0; t < hilos; t++) {
+        tramos[t] = *base;
+        tramos[t].desde = usadas * t / hilos;
+        tramos[t].hasta = usadas * (t + 1) / hilos;
+        lanzado[t] = t > 0 && pthread_create(&ids[t], NULL, tramo_procesar, &tramos[t]) == 0;
+    }
+    for (size_t t = 0; t < hilos; t++) {
+        if ( !lanzado[t] )
+            tramo_procesar(&tramos[t]);
+    }
+    for (size_t t = 1; t < hilos; t++) {
+        if ( lanzado[t] )
+            pthread_join(ids[t], NULL);
+    }
+}
+
+// Pide los arreglos del resultado y corre la fase paralela
+void tramos_liberar(hash_t* destino, tramo_t* base) {
+    size_t usadas = base->recorrida->usadas;
+    hash_liberar(destino, base->encontrados, usadas * sizeof(nodo_hash_t*));
+    hash_liberar(destino, base->resueltos, usadas * sizeof(void*));
+}
+
+bool tramos_buscar(hash_t* destino, tramo_t* base) {
+    size_t usadas = base->recorrida->usadas;
+    if ( !usadas )
+        return true;
+    base->encontrados = hash_pedir(destino, usadas * sizeof(nodo_hash_t*));
+    base->resueltos = base->resolver ? hash_pedir(destino, usadas * sizeof(void*)) : NULL;
+    if ( !base->encontrados || (base->resolver && !base->resueltos) ) {
+        tramos_liberar(destino, base);
+        return false;
+    }
+    tramos_procesar(base);
+    return true;
+}
+
+// Cambia el dato de un nodo del destino por el combinado. El dato
+// reemplazado queda a cargo del resolver.
+bool hash_reemplazar_resuelto(hash_t* hash, nodo_hash_t* nodo, void* dato) {
+    if ( nodo->dato == dato )
+        return true;
+    if ( !hash_anotar_guardar(hash, nodo->clave, dato, nodo_vence_real(hash, nodo)) )
+        return false;
+    nodo->dato = dato;
+    hash_anotar_cambio(hash, nodo->clave);
+    return true;
+}
+
+// Quita del destino las entradas cuya busqueda dio (o no dio) resultado
+void hash_quitar_segun(hash_t* hash, nodo_hash_t** encontrados, bool quitar_encontradas) {
+    size_t usadas = hash->usadas;
+    for (size_t i = 0; i < usadas; i++) {
+        nodo_hash_t* nodo = hash->entradas[i].nodo;
+        if ( !nodo || (encontrados[i] != NULL) != quitar_encontradas )
+            continue;
+        hash_desvincular(hash, nodo);
+        hash_retirar(hash, nodo, hash->destruir_dato);
+    }
+}
+
+// Primitivas de las operaciones entre tablas
+
+bool hash_fusionar(hash_t* destino, const hash_t* origen, hash_resolver_t resolver, void* extra) {
+    if ( destino->congelado || origen->congelado )
+        return false;
+    // Capacidad para el peor caso, sin claves en comun
+    size_t capacidad = destino->capacidad;
+    while ( entradas_maximas(destino, capacidad) < destino->cantidad + origen->cantidad )
+        capacidad *= FACTOR_REDIMENSION;
+    if ( destino->usadas + origen->cantidad > entradas_maximas(destino, destino->capacidad) && !hash_redimensionar(destino, capacidad) )
+        return false;
+
+    tramo_t base = { origen, destino, false, 0, 0, NULL, NULL, resolver, extra };
+    if ( !tramos_buscar(destino, &base) )
+        return false;
+
+    // Primero las claves en comun: agregar puede desalojar nodos en modo cache
+    bool ok = true;
+    for (size_t i = 0; i < origen->usadas && ok; i++) {
+        nodo_hash_t* comun = base.encontrados[i];
+        if ( !comun )
+            continue;
+        if ( resolver ) {
+            ok = hash_reemplazar_resuelto(destino, comun, base.resueltos[i]);
+        } else {
+            void* anterior = comun->dato;
+            ok = hash_reemplazar_resuelto(destino, comun, origen->entradas[i].nodo->dato);
+            if ( ok && destino->destruir_dato && anterior != comun->dato )
+                destino->destruir_dato(anterior);
+        }
+    }
+    for (size_t i = 0; i < origen->usadas && ok; i++) {
+        const entrada_t* entrada = &origen->entradas[i];
+        if ( !entrada->nodo || base.encontrados[i] )
+            continue;
+        const char* clave = entrada->nodo->clave;
+        unsigned long h = destino->funcion_hash == origen->funcion_hash ? entrada->hash : destino->funcion_hash(clave);
+        ok = hash_anotar_guardar(destino, clave, entrada->nodo->dato, 0);
+        if ( ok && !hash_agregar_nodo(destino, clave, entrada->nodo->dato, h) ) {
+            hash_anular_guardar(destino, clave);
+            ok = false;
+        }
+    }
+    tramos_liberar(destino, &base);
+    return ok;
+}
+
+bool hash_interseccion(hash_t* destino, const hash_t* origen, hash_resolver_t resolver, void* extra) {
+    if ( destino->congelado || origen->congelado )
+        return false;
+    tramo_t base = { destino, origen, true, 0, 0, NULL, NULL, resolver, extra };
+    if ( !tramos_buscar(destino, &base) )
+        return false;
+
+    bool ok = true;
+    for (size_t i = 0; i < destino->usadas && ok && resolver; i++) {
+        if ( base.encontrados[i] )
+            ok = hash_reemplazar_resuelto(destino, destino->entradas[i].nodo, base.resueltos[i]);
+    }
+    if ( ok )
+        hash_quitar_segun(destino, base.encontrados, false);
+    tramos_liberar(destino, &base);
+    return ok;
+}
+
+bool hash_diferencia(hash_t* destino, const hash_t* origen) {
+    if ( destino->congelado || origen->congelado )
+        return false;
+    tramo_t base = { destino, origen, true, 0, 0, NULL, NULL, NULL, NULL };
+    if ( !tramos_buscar(destino, &base) )
+        return false;
+    hash_quitar_segun(destino, base.encontrados, true);
+    tramos_liberar(destino, &base);
+    return true;
+}
+
+// Funciones auxiliares de la persistencia
+
+typedef struct recuperacion {
+    hash_t* hash;
+    hash_deserializar_dato_t deserializar;
+} recuperacion_t;
+
+bool hash_aplicar_operacion(registro_operacion_t operacion, const char* clave, const void* bytes, size_t largo, void* extra) {
+    recuperacion_t* recuperacion = extra;
+    hash_t* hash = recuperacion->hash;
+    uint64_t vence = 0, ahora = 0;
+    if ( operacion == REGISTRO_GUARDAR_TTL ) {
+        if ( largo < sizeof(uint64_t) )
+            return false;
+        memcpy(&vence, bytes, sizeof(uint64_t));
+        bytes = (const char*)bytes + sizeof(uint64_t);
+        largo -= sizeof(uint64_t);
+        // Lo que vencio mientras la tabla estaba cerrada no vuelve
+        ahora = reloj_real();
+        if ( vence <= ahora )
+            operacion = REGISTRO_BORRAR;
+    }
+    if ( operacion == REGISTRO_BORRAR ) {
+        if ( !hash_pertenece(hash, clave) )
+            return true;
+        void* dato = hash_borrar(hash, clave);
+        if ( hash->destruir_dato )
+            hash->destruir_dato(dato);
+        return true;
+    }
+    void* dato = recuperacion->deserializar(bytes, largo);
+    if ( vence )
+        return hash_guardar_con_ttl(hash, clave, dato, vence - ahora);
+    return hash_guardar(hash, clave, dato);
+}
+
+typedef struct volcado {
+    const hash_t* hash;
+    registro_t* instantanea;
+    bool ok;
+} volcado_t;
+
+bool hash_volcar_nodo(const nodo_hash_t* nodo, volcado_t* volcado) {
+    size_t largo = 0;
+    const void* bytes = volcado->hash->serializar(nodo->dato, &largo);
+    uint64_t vence_real = nodo_vence_real(volcado->hash, nodo);
+    if ( vence_real )
+        volcado->ok = registro_anotar_con_vencimiento(volcado->instantanea, nodo->clave, vence_real, bytes, largo);
+    else
+        volcado->ok = registro_anotar(volcado->instantanea, REGISTRO_GUARDAR, nodo->clave, bytes, largo);
+    return volcado->ok;
+}
+
+// Corre en el proceso hijo de la compactacion, sobre su copia de la tabla
+bool hash_volcar(registro_t* instantanea, void* extra) {
+    hash_t* hash = extra;
+    volcado_t volcado = { hash, instantanea, true };
+    for (size_t i = 0; i < hash->usadas && volcado.ok; i++) {
+        if ( hash->entradas[i].nodo )
+            hash_volcar_nodo(hash->entradas[i].nodo, &volcado);
+    }
+    return volcado.ok;
+}
+
+// Primitivas de la persistencia
+
+hash_t* hash_abrir_persistente(const char* ruta, const hash_persistencia_t* persistencia, hash_destruir_dato_t destruir_dato) {
+    hash_t* hash = hash_crear(destruir_dato);
+    if ( !hash )
+        return NULL;
+
+    recuperacion_t recuperacion = { hash, persistencia->deserializar };
+    registro_t* registro = registro_abrir(ruta, persistencia->tamanio_buffer,
+                                          persistencia->operaciones_por_fsync, persistencia->ms_por_fsync,
+                                          hash_aplicar_operacion, &recuperacion);
+    if ( !registro ) {
+        hash_destruir(hash);
+        return NULL;
+    }
+    hash->registro = registro;
+    hash->serializar = persistencia->serializar;
+    return hash;
+}
+
+bool hash_sincronizar(hash_t* hash) {
+    return !hash->registro || registro_sincronizar(hash->registro);
+}
+
+bool hash_compactar(hash_t* hash) {
+    return hash->registro && registro_compactar(hash->registro, hash_volcar, hash);
+}
+
+bool hash_compactando(const hash_t* hash) {
+    return hash->registro && registro_compactando(hash->registro);
+}
+
+void* hash_borrar(hash_t* hash, const char* clave) {
+    hash_trazar(hash, TRAZA_BORRAR, clave);
+    if ( hash->congelado )
+        return NULL;
+    nodo_hash_t* nodo = hash_buscar_vigente(hash, clave, hash->funcion_hash(clave));
+    if ( !nodo )
+        return NULL;
+
+    hash_desvincular(hash, nodo);
+
+    void* valor = nodo->dato;
+    hash_retirar(hash, nodo, NULL);
+    return valor;
+}
+
+void* hash_obtener(const hash_t* hash, const char* clave) {
+    hash_trazar(hash, TRAZA_OBTENER, clave);
+    if ( hash->congelado ) {
+        size_t posicion = congelado_buscar(hash->congelado, clave);
+        return posicion < hash->cantidad ? congelado_dato(hash->congelado, posicion) : NULL;
+    }
+    nodo_hash_t* nodo = hash_buscar_vigente(hash, clave, hash->funcion_hash(clave));
+    if ( !nodo )
+        return NULL;
+    if ( hash->cache )
+        cache_acceder(hash->cache, nodo);
+    return nodo->dato;
+}
+
+void hash_destruir(hash_t* hash) {
+    hash_traza_detener(hash);
+    hash_cambios_desactivar(hash);
+    if ( hash->registro )
+        registro_cerrar(hash->registro);
+    for (size_t i=0; i < hash->usadas; i++) {
+        if ( hash->entradas[i].nodo )
+            nodo_hash_destruir(hash, hash->entradas[i].nodo, hash->destruir_dato);
+    }
+    hash->primer_fijado = NULL;
+    hash_liberar_retirados(hash);
+    hash_liberar(hash, hash->cache, sizeof(cache_t));
+    hash_liberar(hash, hash->rueda, sizeof(rueda_t));
+    hash_filtro_desactivar(hash);
+    hash_liberar_indice(hash);
+    hash_liberar(hash, hash->entradas, entradas_maximas(hash, hash->capacidad) * sizeof(entrada_t));
+    if ( hash->congelado )
+        congelado_destruir(hash->congelado, hash->destruir_dato);
+    allocador_liberar(&hash->allocador, hash);
+}
+
+// Destruccion diferida: un unico hilo libera, en orden de llegada, las
+// tablas encoladas por hash_destruir_diferido
+
+typedef struct reclamador {
+    pthread_mutex_t mutex;
+    pthread_cond_t hay_trabajo;
+    pthread_cond_t terminado;
+    hash_t* primero;
+    hash_t* ultimo;
+    bool iniciado;
+    bool ocupado;
+    size_t pendientes; // entradas sin liberar
+} reclamador_t;
+
+reclamador_t reclamador = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    NULL, NULL, false, false, 0
+};
+
+// Libera las entradas por lotes para que el pendiente avance de a poco
+void reclamador_liberar(hash_t* hash) {
+    if ( hash->congelado ) {
+        size_t liberadas = hash->cantidad;
+        hash_destruir(hash);
+        pthread_mutex_lock(&reclamador.mutex);
+        reclamador.pendientes -= liberadas;
+        pthread_mutex_unlock(&reclamador.mutex);
+        return;
+    }
+    for (size_t inicio = 0; inicio < hash->usadas; inicio += DIFERIDO_LOTE) {
+        size_t fin = inicio + DIFERIDO_LOTE < hash->usadas ? inicio + DIFERIDO_LOTE : hash->usadas;
+        size_t liberadas = 0;
+        for (size_t i = inicio; i < fin; i++) {
+            if ( !hash->entradas[i].nodo )
+                continue;
+            nodo_hash_destruir(hash, hash->entradas[i].nodo, hash->destruir_dato);
+            liberadas++;
+        }
+        pthread_mutex_lock(&reclamador.mutex);
+        reclamador.pendientes -= liberadas;
+        pthread_mutex_unlock(&reclamador.mutex);
+    }
+    hash->usadas = 0;
+    hash_destruir(hash);
+}
+
+void* reclamador_trabajar(void* extra) {
+    (void)extra;
+    pthread_mutex_lock(&reclamador.mutex);
+    while ( true ) {
+        while ( !reclamador.primero ) {
+            reclamador.ocupado = false;
+            pthread_cond_broadcast(&reclamador.terminado);
+            pthread_cond_wait(&reclamador.hay_trabajo, &reclamador.mutex);
+        }
+        reclamador.ocupado = true;
+        hash_t* hash = reclamador.primero;
+        reclamador.primero = hash->siguiente_diferido;
+        if ( !reclamador.primero )
+            reclamador.ultimo = NULL;
+        pthread_mutex_unlock(&reclamador.mutex);
+
+        reclamador_liberar(hash);
+        pthread_mutex_lock(&reclamador.mutex);
+    }
+    return NULL;
+}
+
+// Pre: se tiene el mutex del reclamador
+bool reclamador_iniciar(void) {
+    if ( reclamador.iniciado )
+        return true;
+    pthread_t hilo;
+    if ( pthread_create(&hilo, NULL, reclamador_trabajar, NULL) )
+        return false;
+    pthread_detach(hilo);
+    reclamador.iniciado = true;
+    return true;
+}
+
+void hash_destruir_diferido(hash_t* hash, bool llamadas_en_fondo) {
+    // El registro se cierra ahora: al volver, lo escrito ya es durable
+    if ( hash->registro ) {
+        registro_cerrar(hash->registro);
+        hash->registro = NULL;
+    }
+    // Sin permiso, las funciones del usuario no se llaman desde otro hilo
+    bool con_llamadas = hash->destruir_dato || hash->allocador.liberar;
+    if ( hash->cantidad < DIFERIDO_MINIMO || (con_llamadas && !llamadas_en_fondo) ) {
+        hash_destruir(hash);
+        return;
+    }
+
+    pthread_mutex_lock(&reclamador.mutex);
+    if ( !reclamador_iniciar() ) {
+        pthread_mutex_unlock(&reclamador.mutex);
+        hash_destruir(hash);
+        return;
+    }
+    hash->siguiente_diferido = NULL;
+    if ( reclamador.ultimo )
+        reclamador.ultimo->siguiente_diferido = hash;
+    else
+        reclamador.primero = hash;
+    reclamador.ultimo = hash;
+    reclamador.pendientes += hash->cantidad;
+    pthread_cond_signal(&reclamador.hay_trabajo);
+    pthread_mutex_unlock(&reclamador.mutex);
+}
+
+size_t hash_destruccion_pendiente(void) {
+    pthread_mutex_lock(&reclamador.mutex);
+    size_t pendientes = reclamador.pendientes;
+    pthread_mutex_unlock(&reclamador.mutex);
+    return pendientes;
+}
+
+void hash_esperar_destrucciones(void) {
+    pthread_mutex_lock(&reclamador.mutex);
+    while ( reclamador.primero || reclamador.ocupado )
+        pthread_cond_wait(&reclamador.terminado, &reclamador.mutex);
+    pthread_mutex_unlock(&reclamador.mutex);
+}
+
+// Funciones auxiliares del iterador
+
+// Una tabla congelada se recorre por posicion y no tiene borradas
+size_t hash_iter_fin(const hash_t* hash) {
+    return hash->congelado ? hash->cantidad : hash->usadas;
+}
+
+// Primera entrada no borrada desde pos, o usadas si no hay
+size_t hash_iter_saltar_borradas(const hash_t* hash, size_t pos) {
+    if ( hash->congelado )
+        return pos;
+    while ( pos < hash->usadas && !hash->entradas[pos].nodo )
+        pos++;
+    return pos;
+}
+
+// Ubica el iterador en la primera entrada no borrada desde pos. El fijado
+// se queda con su nodo, que sigue vivo aunque despues lo borren.
+void hash_iter_ubicar(hash_iter_t* iter, size_t pos) {
+    iter->pos = hash_iter_saltar_borradas(iter->hash, pos);
+    if ( iter->fijado )
+        iter->actual = iter->pos < iter->fin ? iter->hash->entradas[iter->pos].nodo : NULL;
+}
+
+// Primitivas del iterador
+
+hash_iter_t* hash_iter_crear(const hash_t* hash) {
+    // Los iteradores no se cuentan en la memoria de la tabla
+    hash_iter_t* iter = allocador_pedir(&hash->allocador, sizeof(hash_iter_t));
+    if ( !iter )
+        return NULL;
+    iter->hash = hash;
+    iter->fijado = NULL;
+    hash_iter_ubicar(iter, 0);
+    return iter;
+}
+
+hash_iter_t* hash_iter_fijar(hash_t* hash) {
+    hash_iter_t* iter = hash_iter_crear(hash);
+    // Una tabla congelada no cambia: no hace falta fijarla
+    if ( !iter || hash->congelado )
+        return iter;
+    iter->fijado = hash;
+    iter->version = hash->version;
+    iter->fin = hash->usadas;
+    iter->ant = hash->ultimo_fijado;
+    iter->sig = NULL;
+    if ( hash->ultimo_fijado )
+        hash->ultimo_fijado->sig = iter;
+    else
+        hash->primer_fijado = iter;
+    hash->ultimo_fijado = iter;
+    hash_iter_ubicar(iter, 0);
+    return iter;
+}
+
+bool hash_iter_al_final(const hash_iter_t* iter) {
+    if ( iter->fijado )
+        return iter->pos >= iter->fin;
+    return iter->pos >= hash_iter_fin(iter->hash);
+}
+
+bool hash_iter_avanzar(hash_iter_t* iter) {
+    if ( hash_iter_al_final(iter) )
+        return false;
+    hash_iter_ubicar(iter, iter->pos + 1);
+    return true;
+}
+
+const char* hash_iter_ver_actual(const hash_iter_t* iter) {
+    if ( hash_iter_al_final(iter) )
+        return NULL;
+    if ( iter->fijado )
+        return iter->actual->clave;
+    if ( iter->hash->congelado )
+        return congelado_clave(iter->hash->congelado, iter->pos);
+    return iter->hash->entradas[iter->pos].nodo->clave;
+}
+
+void hash_iter_destruir(hash_iter_t* iter) {
+    hash_t* hash = iter->fijado;
+    if ( hash ) {
+        if ( iter->ant )
+            iter->ant->sig = iter->sig;
+        else
+            hash->primer_fijado = iter->sig;
+        if ( iter->sig )
+            iter->sig->ant = iter->ant;
+        else
+            hash->ultimo_fijado = iter->ant;
+        hash_liberar_retirados(hash);
+    }
+    allocador_liberar(&iter->hash->allocador, iter);
 }
@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include "allocador.h"
 
 // Los structs deben llamarse "hash" y "hash_iter".
 struct hash;
@@ -14,10 +16,51 @@ typedef struct hash_iter hash_iter_t;
 // tipo de función para destruir dato
 typedef void (*hash_destruir_dato_t)(void *);
 
-/* Crea el hash
+// Políticas de desalojo del modo cache
+typedef enum {
+    HASH_POLITICA_LRU,   // desaloja el menos usado recientemente
+    HASH_POLITICA_CLOCK  // segunda oportunidad: un acierto solo marca un bit
+} hash_politica_t;
+
+/* Crea el hash. Si al guardar muchas claves sondean largo con la tabla a
+ * medio llenar (por ejemplo, elegidas a propósito para colisionar, con el
+ * mismo hash o con la misma posición inicial), la tabla pasa a una
+ * función de hash con semilla aleatoria (SipHash-1-3) y rearma su índice,
+ * de modo que el sondeo vuelve a ser corto.
  */
 hash_t *hash_crear(hash_destruir_dato_t destruir_dato);
 
+/* Crea un hash que pide, redimensiona y libera toda su memoria con las
+ * funciones recibidas, pasándoles contexto (las que sean NULL usan malloc,
+ * realloc y free). La tabla lleva la cuenta exacta de los bytes pedidos.
+ */
+hash_t *hash_crear_con_allocador(allocador_pedir_t pedir, allocador_redimensionar_t redimensionar,
+                                 allocador_liberar_t liberar, void *contexto,
+                                 hash_destruir_dato_t destruir_dato);
+
+/* Crea un hash cuyo índice es cuckoo por baldes: cada clave puede estar en
+ * una de 4 posiciones de cada uno de sus dos baldes de una línea de cache,
+ * o en un pequeño desborde. Una búsqueda revisa a lo sumo esos dos baldes
+ * y el desborde, sin importar la carga, y la tabla se llena hasta 15/16 de
+ * su capacidad. Al guardar, si ambos baldes están llenos se busca en
+ * anchura el camino de desplazamientos más corto hasta un lugar libre; si
+ * no lo hay y el desborde está lleno, la tabla crece. Admite todas las
+ * demás primitivas. Las claves con el mismo hash comparten sus baldes;
+ * cuando no entran, la tabla cambia de función como en hash_crear.
+ */
+hash_t *hash_cuckoo_crear(hash_destruir_dato_t destruir_dato);
+
+/* Crea un hash acotado que funciona como cache. Al guardar una clave nueva
+ * que excede max_entradas o max_bytes (0 indica sin límite en ese criterio),
+ * desaloja en O(1) amortizado según la política, llamando a destruir_dato
+ * con cada dato desalojado. Los bytes contabilizados son los de cada entrada
+ * y su clave, no los del dato. Devuelve NULL si ambos límites son 0.
+ * Post: hash_obtener y hash_guardar cuentan como accesos a la clave.
+ */
+hash_t *hash_cache_crear(size_t max_entradas, size_t max_bytes,
+                         hash_politica_t politica,
+                         hash_destruir_dato_t destruir_dato);
+
 /* Guarda un elemento en el hash, si la clave ya se encuentra en la
  * estructura, la reemplaza. De no poder guardarlo devuelve false.
  * Pre: La estructura hash fue inicializada
@@ -25,6 +68,160 @@ hash_t *hash_crear(hash_destruir_dato_t destruir_dato);
  */
 bool hash_guardar(hash_t *hash, const char *clave, void *dato);
 
+/* Guarda cantidad pares (claves[i], datos[i]) con las mismas reglas que
+ * hash_guardar, redimensionando la tabla una sola vez para todo el lote.
+ * Devuelve cuántos pares guardó; se detiene en el primero que falla.
+ * Pre: La estructura hash fue inicializada
+ */
+size_t hash_guardar_lote(hash_t *hash, const char **claves, void **datos,
+                         size_t cantidad);
+
+/* Busca la clave y, si no está, la guarda con dato NULL, con una sola
+ * búsqueda en ambos casos. Devuelve la dirección del dato de la clave,
+ * para leerlo y reemplazarlo en el lugar: el dato anterior queda a cargo
+ * de quien lo reemplaza. insertado indica si la clave era nueva. La
+ * dirección vale hasta que la clave se borre, venza o se desaloje. Solo
+ * el alta cuenta como cambio para hash_version: reemplazar el dato por la
+ * dirección no se registra.
+ * Devuelve NULL si no hay memoria o si la tabla es persistente o está
+ * congelada.
+ * Pre: La estructura hash fue inicializada
+ */
+void **hash_obtener_o_insertar(hash_t *hash, const char *clave,
+                               bool *insertado);
+
+/* Aplica hash_obtener_o_insertar a cantidad claves, dejando en datos[i] la
+ * dirección del dato de claves[i] y en insertados[i] si era nueva. Hashea
+ * las claves de a bloques y trae a cache el índice de las siguientes
+ * mientras resuelve la actual; la tabla se redimensiona una sola vez. Una
+ * clave repetida en el lote recibe la misma dirección. En una cache no se
+ * resuelve ninguna (devuelve 0): una clave nueva podría desalojar a otra
+ * anterior del mismo lote y dejar colgada su dirección.
+ * Devuelve cuántas claves resolvió; se detiene en la primera que falla.
+ * Pre: La estructura hash fue inicializada
+ */
+size_t hash_obtener_o_insertar_lote(hash_t *hash, const char **claves,
+                                    size_t cantidad, void ***datos,
+                                    bool *insertados);
+
+// Calcula el nuevo dato de una clave a partir del actual (NULL y existia en
+// false si la clave no estaba). Si descarta el dato actual, debe liberarlo.
+typedef void *(*hash_actualizar_t)(const char *clave, void *dato,
+                                   bool existia, void *extra);
+
+/* Reemplaza el dato de la clave por el que devuelve actualizar, con una
+ * sola búsqueda. Si la clave no estaba la guarda. Devuelve false en los
+ * mismos casos que hash_obtener_o_insertar, sin llamar a actualizar.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_actualizar(hash_t *hash, const char *clave,
+                     hash_actualizar_t actualizar, void *extra);
+
+/* Guarda un elemento que vence ttl ticks después del instante actual del
+ * reloj del hash (por defecto, milisegundos de CLOCK_MONOTONIC). Una entrada
+ * vencida deja de ser visible para hash_obtener, hash_pertenece y
+ * hash_borrar, que la liberan al encontrarla. Guardar la clave con
+ * hash_guardar le quita el vencimiento. Un hash persistente anota el
+ * vencimiento como instante absoluto de CLOCK_REALTIME, tomando los ticks
+ * como milisegundos, y al recuperar descarta lo que ya venció. De no poder
+ * guardarlo devuelve false.
+ * Pre: La estructura hash fue inicializada
+ * Post: Se almacenó el par (clave, dato) con su vencimiento
+ */
+bool hash_guardar_con_ttl(hash_t *hash, const char *clave, void *dato,
+                          uint64_t ttl);
+
+/* Reemplaza el reloj con el que se calculan los vencimientos. Devuelve false
+ * si no pudo inicializar la rueda de temporizadores.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_configurar_reloj(hash_t *hash, uint64_t (*reloj)(void));
+
+/* Libera las entradas vencidas hasta el instante ahora, avanzando una rueda
+ * de temporizadores jerárquica sin recorrer la tabla. Procesa a lo sumo
+ * max_trabajo entradas (vencidas o movidas de nivel) y retoma desde ese
+ * punto en la próxima llamada; los ticks sin entradas se saltean sin costo. Devuelve la cantidad de entradas liberadas.
+ * Pre: La estructura hash fue inicializada
+ */
+size_t hash_expirar(hash_t *hash, uint64_t ahora, size_t max_trabajo);
+
+// Estadísticas del filtro de pertenencia
+typedef struct hash_filtro_estadisticas {
+    size_t consultas;          // búsquedas que pasaron por el filtro
+    size_t descartes;          // ausencias resueltas sin tocar la tabla
+    size_t falsos_positivos;   // el filtro dijo "quizás" y la clave no estaba
+    double tasa_falsos_positivos; // falsos_positivos / ausencias totales
+    size_t bytes;              // memoria ocupada por el filtro
+} hash_filtro_estadisticas_t;
+
+/* Antepone a las búsquedas un filtro de Bloom por bloques de una línea de
+ * cache, de modo que la mayoría de las claves ausentes se descartan sin
+ * recorrer la tabla. Usa unos bits_por_clave bits por entrada a carga
+ * máxima (10 da alrededor de 1% de falsos positivos). hash_guardar y
+ * hash_borrar lo mantienen al día, y se reconstruye al redimensionar o
+ * cuando se acumulan borrados. Devuelve false si no hay memoria.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_filtro_activar(hash_t *hash, size_t bits_por_clave);
+
+/* Quita el filtro de pertenencia, si lo había.
+ * Pre: La estructura hash fue inicializada
+ */
+void hash_filtro_desactivar(hash_t *hash);
+
+/* Completa las estadísticas del filtro. Sin filtro quedan en 0.
+ * Pre: La estructura hash fue inicializada
+ */
+void hash_filtro_estadisticas(const hash_t *hash,
+                              hash_filtro_estadisticas_t *estadisticas);
+
+// Conversión de datos a bytes para el registro de operaciones. serializar
+// no debe pedir memoria: también se llama desde el proceso que compacta.
+typedef const void *(*hash_serializar_dato_t)(const void *dato, size_t *largo);
+typedef void *(*hash_deserializar_dato_t)(const void *bytes, size_t largo);
+
+// Configuración de un hash persistente
+typedef struct hash_persistencia {
+    hash_serializar_dato_t serializar;
+    hash_deserializar_dato_t deserializar;
+    size_t tamanio_buffer;          // bytes acumulados antes de escribir (0: 1 MiB)
+    size_t operaciones_por_fsync;   // commit agrupado por cantidad (0: desactivado)
+    uint64_t ms_por_fsync;          // commit agrupado por tiempo (0: desactivado)
+} hash_persistencia_t;
+
+/* Crea un hash durable respaldado por un registro de operaciones en ruta.
+ * Recupera el contenido reproduciendo la última instantánea y el registro
+ * posterior (una cola incompleta por una caída se descarta). Desde entonces
+ * cada alta, reemplazo o baja se copia a un buffer antes de aplicarse; el
+ * fsync se agrupa según la configuración o se fuerza con hash_sincronizar.
+ * Con ms_por_fsync un hilo sincroniza lo pendiente a lo sumo ese tiempo
+ * después de anotado, aunque la tabla quede quieta.
+ * Devuelve NULL si no pudo recuperar el registro.
+ * Post: El hash contiene lo último que llegó a disco
+ */
+hash_t *hash_abrir_persistente(const char *ruta,
+                               const hash_persistencia_t *persistencia,
+                               hash_destruir_dato_t destruir_dato);
+
+/* Escribe y sincroniza las operaciones pendientes del registro. Devuelve
+ * false si alguna escritura falló. Sin registro devuelve true.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_sincronizar(hash_t *hash);
+
+/* Inicia en segundo plano la compactación del registro: un proceso hijo
+ * escribe una instantánea de la tabla mientras el hash sigue aceptando
+ * operaciones en un segmento nuevo. Devuelve false si no hay registro, si
+ * ya hay una compactación en curso o si no pudo iniciarla.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_compactar(hash_t *hash);
+
+/* Devuelve true mientras haya una compactación en curso.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_compactando(const hash_t *hash);
+
 /* Borra un elemento del hash y devuelve el dato asociado.  Devuelve
  * NULL si el dato no estaba.
  * Pre: La estructura hash fue inicializada
@@ -49,18 +246,223 @@ bool hash_pertenece(const hash_t *hash, const char *clave);
  */
 size_t hash_cantidad(const hash_t *hash);
 
+// Estadísticas de ocupación de la tabla. La capacidad cuenta posiciones del
+// índice; la cadena máxima es el sondeo más largo hasta encontrar una clave
+// (en una tabla cuckoo, los baldes revisados: 3 si está en el desborde).
+// Las redimensiones cuentan las veces que se rearmó el índice, y las
+// paralelas cuántas de ellas repartieron el trabajo entre varios hilos.
+typedef struct hash_estadisticas {
+    size_t cantidad;
+    size_t capacidad;
+    size_t baldes_ocupados;
+    size_t cadena_maxima;
+    double factor_carga;
+    size_t redimensiones;
+    size_t redimensiones_paralelas;
+} hash_estadisticas_t;
+
+/* Completa las estadísticas de ocupación recorriendo el índice.
+ * Pre: La estructura hash fue inicializada
+ */
+void hash_estadisticas(const hash_t *hash, hash_estadisticas_t *estadisticas);
+
+/* Empieza a grabar en ruta una traza binaria (ver traza.h) con cada llamada
+ * a guardar, obtener, borrar y pertenece, para reproducirla con
+ * reproducir_traza. Si con_claves es false se graba solo el hash de cada
+ * clave. Si ya había una traza en curso, la cierra.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_traza_iniciar(hash_t *hash, const char *ruta, bool con_claves);
+
+/* Cierra la traza en curso, si la hay. Devuelve false si hubo errores de
+ * escritura. hash_destruir también la cierra.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_traza_detener(hash_t *hash);
+
+/* Devuelve los bytes que la tabla tiene pedidos: la estructura, el índice,
+ * las entradas, las claves copiadas y las estructuras auxiliares. No incluye
+ * los datos del usuario ni los iteradores.
+ * Pre: La estructura hash fue inicializada
+ */
+size_t hash_memoria(const hash_t *hash);
+
+/* Fija un máximo de bytes para hash_memoria (0 indica sin límite). Las
+ * operaciones que lo excederían fallan devolviendo false, sin modificar el
+ * hash. Bajar el límite por debajo del uso actual no libera nada.
+ * Pre: La estructura hash fue inicializada
+ */
+void hash_limitar_memoria(hash_t *hash, size_t max_bytes);
+
+/* Congela la tabla: la reconstruye sobre una función de hash perfecta
+ * mínima, con las claves y los datos empaquetados en arreglos densos, y
+ * libera el índice, las entradas y el filtro. Cada búsqueda calcula una
+ * posición y compara una sola clave. Desde entonces la tabla es de solo
+ * lectura: guardar, borrar, el filtro y las operaciones entre tablas
+ * fallan, y el iterador recorre las claves en el orden de sus posiciones.
+ * Devuelve false si no hay memoria o si la tabla es una cache, tiene
+ * vencimientos, es persistente o tiene iteradores fijados; en ese caso
+ * queda como estaba. Congelar una tabla ya congelada devuelve true.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_congelar(hash_t *hash);
+
+/* Determina si la tabla fue congelada.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_congelado(const hash_t *hash);
+
+/* Pide los bloques de 2 MiB o más de la tabla (el índice, las entradas y el
+ * filtro de una tabla grande) directamente al sistema, alineados a 2 MiB y
+ * marcados para que el kernel los respalde con páginas grandes, lo que
+ * reduce los fallos de TLB de las búsquedas al azar. Si el sistema no tiene
+ * páginas grandes, los bloques quedan en páginas comunes. Estos bloques no
+ * pasan por el allocador de la tabla. Con prefaultear, al pedir o agrandar
+ * un bloque de ese tamaño se tocan todas sus páginas, de modo que los
+ * fallos de página ocurren al crecer y no en las operaciones siguientes.
+ * Activar o desactivar las páginas grandes devuelve false si la tabla ya
+ * tiene claves o bloques de ese tamaño; prefaultear se puede cambiar siempre.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_configurar_paginas(hash_t *hash, bool paginas_grandes,
+                             bool prefaultear);
+
+/* Redimensiona con hasta hilos hilos (0 usa uno por núcleo en línea, hasta
+ * 16). Las entradas se parten en franjas que los hilos, incluido el que
+ * llamó, se reparten a medida que terminan la anterior, y cada uno ubica
+ * las de su franja en el índice nuevo sin bloqueos. Solo se usa con el
+ * índice lineal, y nunca con más hilos que franjas de 65536 claves. Con
+ * 1, el valor inicial, el índice se rearma en el hilo que llama.
+ * Pre: La estructura hash fue inicializada
+ */
+void hash_configurar_redimension(hash_t *hash, size_t hilos);
+
+/* Devuelve true si hay una redimensión en paralelo en curso, y completa
+ * cuántas franjas ya están en el índice nuevo y cuántas hay en total (si no
+ * hay ninguna en curso, las de la última). A diferencia de las demás,
+ * puede llamarse desde otro hilo mientras la tabla se usa.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_redimension_progreso(const hash_t *hash, size_t *movidas,
+                               size_t *totales);
+
+// Tipo de cambio informado por hash_cambios_desde. REINICIO indica que lo
+// que se tenía de la tabla no vale más y se envía completa a continuación.
+typedef enum {
+    HASH_CAMBIO_GUARDADO,
+    HASH_CAMBIO_BORRADO,
+    HASH_CAMBIO_REINICIO
+} hash_cambio_t;
+
+typedef void (*hash_visitar_cambio_t)(hash_cambio_t tipo, const char *clave,
+                                      void *dato, void *extra);
+
+/* Mantiene un registro con las últimas capacidad modificaciones (guardar,
+ * reemplazar, borrar, expirar y desalojar), que usa hash_cambios_desde.
+ * Activarlo de nuevo descarta el registro anterior.
+ * Devuelve false si no hubo memoria o capacidad es 0.
+ * Pre: La estructura hash fue inicializada
+ */
+bool hash_cambios_activar(hash_t *hash, size_t capacidad);
+
+/* Libera el registro de cambios. La versión se sigue contando.
+ * Pre: La estructura hash fue inicializada
+ */
+void hash_cambios_desactivar(hash_t *hash);
+
+/* Devuelve la versión de la tabla: la cantidad de modificaciones desde que
+ * fue creada, se tenga o no el registro de cambios.
+ * Pre: La estructura hash fue inicializada
+ */
+uint64_t hash_version(const hash_t *hash);
+
+/* Informa a visitar lo que cambió después de version, y devuelve la
+ * versión actual para la próxima consulta. Cada clave modificada se
+ * informa una sola vez con su estado actual: GUARDADO con el dato vigente
+ * o BORRADO. Si el registro no alcanza para cubrir desde version (o no
+ * está activo), se envía REINICIO y después GUARDADO por cada clave.
+ * Pre: La estructura hash fue inicializada y visitar no la modifica.
+ */
+uint64_t hash_cambios_desde(const hash_t *hash, uint64_t version,
+                            hash_visitar_cambio_t visitar, void *extra);
+
+// Combina los datos de una clave presente en ambas tablas. Devuelve el dato
+// que queda en el destino; si descarta alguno de los dos, debe liberarlo.
+// Puede llamarse desde varios hilos a la vez, con claves distintas.
+typedef void *(*hash_resolver_t)(const char *clave, void *dato_destino,
+                                 void *dato_origen, void *extra);
+
+/* Guarda en destino todas las claves de origen. Las claves en común se
+ * combinan con resolver; si es NULL, gana el dato de origen y el de destino
+ * se destruye. Las búsquedas corren en varios hilos y el destino se
+ * redimensiona una sola vez. Los datos copiados pasan a compartirse entre
+ * ambas tablas: solo una de ellas debería destruirlos.
+ * Devuelve false si no hubo memoria; si falla después de empezar a
+ * guardar, el destino queda con parte de las claves.
+ * Pre: Ambas estructuras fueron inicializadas y origen no se modifica
+ * durante la operación.
+ */
+bool hash_fusionar(hash_t *destino, const hash_t *origen,
+                   hash_resolver_t resolver, void *extra);
+
+/* Deja en destino solo las claves que también están en origen, destruyendo
+ * los datos de las demás. Las claves en común se combinan con resolver; si
+ * es NULL, se conserva el dato de destino.
+ * Pre: Ambas estructuras fueron inicializadas.
+ */
+bool hash_interseccion(hash_t *destino, const hash_t *origen,
+                       hash_resolver_t resolver, void *extra);
+
+/* Quita de destino, destruyendo sus datos, las claves que están en origen.
+ * Pre: Ambas estructuras fueron inicializadas.
+ */
+bool hash_diferencia(hash_t *destino, const hash_t *origen);
+
 /* Destruye la estructura liberando la memoria pedida y llamando a la función
- * destruir para cada par (clave, dato).
+ * destruir para cada par (clave, dato). Si es persistente, sincroniza el
+ * registro y espera la compactación en curso.
  * Pre: La estructura hash fue inicializada
  * Post: La estructura hash fue destruida
  */
 void hash_destruir(hash_t *hash);
 
-/* Iterador del hash */
+/* Como hash_destruir, pero devuelve el control en O(1): la liberación de las
+ * entradas la hace un hilo de fondo compartido por todas las tablas. Si la
+ * tabla tiene destruir_dato o un allocador propio, esas funciones correrían
+ * en el hilo de fondo, así que solo se difiere con llamadas_en_fondo en
+ * true (quien llama garantiza que pueden correr en otro hilo); si no, se
+ * destruye en el momento. Si es persistente, el registro se sincroniza y
+ * se cierra antes de devolver. Las tablas chicas se destruyen en el momento.
+ * Pre: La estructura hash fue inicializada
+ * Post: La estructura hash ya no puede usarse
+ */
+void hash_destruir_diferido(hash_t *hash, bool llamadas_en_fondo);
+
+/* Devuelve cuántas entradas de tablas destruidas en diferido faltan liberar.
+ */
+size_t hash_destruccion_pendiente(void);
+
+/* Bloquea hasta que el hilo de fondo termine de liberar todas las tablas
+ * destruidas en diferido hasta el momento.
+ */
+void hash_esperar_destrucciones(void);
+
+/* Iterador del hash. Recorre las claves en orden de inserción; reemplazar
+ * el dato de una clave no cambia su lugar. */
 
 // Crea iterador
 hash_iter_t *hash_iter_crear(const hash_t *hash);
 
+// Crea un iterador fijado a la versión actual de la tabla, que se puede
+// seguir usando mientras se guarda y se borra. Recorre, en orden de
+// inserción, las claves que había al crearlo, salvo las que se borren antes
+// de llegar a ellas; no ve las que se agreguen después. La clave actual
+// sigue valiendo aunque se borre. Mientras viva, la tabla no compacta sus
+// entradas al crecer y guarda los nodos borrados (no sus datos, que se
+// destruyen como siempre) hasta que se destruyan los iteradores fijados
+// creados antes del borrado.
+hash_iter_t *hash_iter_fijar(hash_t *hash);
+
 // Avanza iterador
 bool hash_iter_avanzar(hash_iter_t *iter);
 
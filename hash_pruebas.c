@@ -6,12 +6,22 @@
  */
 
 #include "hash.h"
+#include "agregacion.h"
+#include "derrame.h"
+#include "compartido.h"
+#include "hamt.h"
+#include "lista.h"
+#include "traza.h"
 #include "testing.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>  // For ssize_t in Linux.
+#include <sys/wait.h>
+#include <stdint.h>
 
 
 /* ******************************************************************
@@ -209,6 +219,1514 @@ static void prueba_hash_valor_null()
     hash_destruir(hash);
 }
 
+static void prueba_hash_cache()
+{
+    char *claves[] = {"perro", "gato", "vaca", "pato"};
+    char *valores[] = {"guau", "miau", "mu", "cuac"};
+
+    /* LRU: el acceso a clave0 hace que se desaloje clave1 */
+    hash_t* hash = hash_cache_crear(3, 0, HASH_POLITICA_LRU, NULL);
+    print_test("Prueba hash cache LRU crear", hash);
+    for (size_t i = 0; i < 3; i++)
+        hash_guardar(hash, claves[i], valores[i]);
+    print_test("Prueba hash cache LRU obtener clave0", hash_obtener(hash, claves[0]) == valores[0]);
+    print_test("Prueba hash cache LRU insertar clave3", hash_guardar(hash, claves[3], valores[3]));
+    print_test("Prueba hash cache LRU la cantidad de elementos es 3", hash_cantidad(hash) == 3);
+    print_test("Prueba hash cache LRU clave1 fue desalojada", !hash_pertenece(hash, claves[1]));
+    print_test("Prueba hash cache LRU clave0 sigue", hash_pertenece(hash, claves[0]));
+    print_test("Prueba hash cache LRU clave3 sigue", hash_pertenece(hash, claves[3]));
+    hash_destruir(hash);
+
+    /* CLOCK: clave0 referenciada recibe segunda oportunidad */
+    hash = hash_cache_crear(3, 0, HASH_POLITICA_CLOCK, NULL);
+    print_test("Prueba hash cache CLOCK crear", hash);
+    for (size_t i = 0; i < 3; i++)
+        hash_guardar(hash, claves[i], valores[i]);
+    print_test("Prueba hash cache CLOCK obtener clave0", hash_obtener(hash, claves[0]) == valores[0]);
+    print_test("Prueba hash cache CLOCK insertar clave3", hash_guardar(hash, claves[3], valores[3]));
+    print_test("Prueba hash cache CLOCK la cantidad de elementos es 3", hash_cantidad(hash) == 3);
+    print_test("Prueba hash cache CLOCK clave1 fue desalojada", !hash_pertenece(hash, claves[1]));
+    print_test("Prueba hash cache CLOCK clave0 sigue", hash_pertenece(hash, claves[0]));
+    hash_destruir(hash);
+
+    /* Los datos desalojados se destruyen */
+    hash = hash_cache_crear(1, 0, HASH_POLITICA_LRU, free);
+    bool ok = true;
+    for (size_t i = 0; i < 4; i++)
+        ok &= hash_guardar(hash, claves[i], malloc(sizeof(int)));
+    print_test("Prueba hash cache desalojar con destruir", ok && hash_cantidad(hash) == 1);
+    print_test("Prueba hash cache queda la ultima clave", hash_pertenece(hash, claves[3]));
+    hash_destruir(hash);
+
+    print_test("Prueba hash cache sin limites es NULL", !hash_cache_crear(0, 0, HASH_POLITICA_LRU, NULL));
+}
+
+static uint64_t reloj_prueba;
+
+static uint64_t reloj_prueba_ver(void)
+{
+    return reloj_prueba;
+}
+
+static void prueba_hash_ttl()
+{
+    hash_t* hash = hash_crear(free);
+    reloj_prueba = 1000;
+    print_test("Prueba hash ttl configurar reloj", hash_configurar_reloj(hash, reloj_prueba_ver));
+
+    int* valor1 = malloc(sizeof(int));
+    print_test("Prueba hash ttl guardar perro", hash_guardar_con_ttl(hash, "perro", valor1, 10));
+    print_test("Prueba hash ttl guardar gato", hash_guardar_con_ttl(hash, "gato", malloc(sizeof(int)), 5000));
+    print_test("Prueba hash ttl guardar vaca sin ttl", hash_guardar(hash, "vaca", malloc(sizeof(int))));
+    print_test("Prueba hash ttl obtener perro antes de vencer", hash_obtener(hash, "perro") == valor1);
+
+    /* Vencimiento perezoso al consultar */
+    reloj_prueba = 1010;
+    print_test("Prueba hash ttl obtener perro vencido es NULL", !hash_obtener(hash, "perro"));
+    print_test("Prueba hash ttl la cantidad de elementos es 2", hash_cantidad(hash) == 2);
+
+    /* Expiracion incremental acotada */
+    bool ok = true;
+    for (size_t i = 0; i < 1000; i++) {
+        char clave[10];
+        sprintf(clave, "%08zu", i);
+        ok &= hash_guardar_con_ttl(hash, clave, malloc(sizeof(int)), 100 + i % 300);
+    }
+    print_test("Prueba hash ttl guardar muchos elementos", ok);
+    print_test("Prueba hash ttl expirar sin vencidos", hash_expirar(hash, 1050, 1000) == 0);
+    print_test("Prueba hash ttl expirar acotado", hash_expirar(hash, 1500, 10) <= 10);
+    size_t expirados = 0;
+    for (size_t i = 0; i < 1000 && hash_cantidad(hash) > 2; i++)
+        expirados += hash_expirar(hash, 1500, 64);
+    print_test("Prueba hash ttl expiraron todos los vencidos", hash_cantidad(hash) == 2);
+    print_test("Prueba hash ttl gato sigue", hash_pertenece(hash, "gato"));
+    print_test("Prueba hash ttl vaca sigue", hash_pertenece(hash, "vaca"));
+
+    /* Guardar sin ttl le quita el vencimiento */
+    hash_guardar(hash, "gato", malloc(sizeof(int)));
+    reloj_prueba = 10000;
+    hash_expirar(hash, 10000, 100000);
+    print_test("Prueba hash ttl gato sin ttl no vence", hash_pertenece(hash, "gato"));
+    print_test("Prueba hash ttl la cantidad de elementos es 2", hash_cantidad(hash) == 2);
+    hash_destruir(hash);
+
+    /* Los ticks vacios no gastan trabajo: con una entrada de una hora, la
+     * de 30 s se libera expirando una vez por segundo simulado */
+    hash = hash_crear(free);
+    reloj_prueba = 0;
+    hash_configurar_reloj(hash, reloj_prueba_ver);
+    hash_guardar_con_ttl(hash, "hora", malloc(sizeof(int)), 3600 * 1000);
+    hash_guardar_con_ttl(hash, "medio minuto", malloc(sizeof(int)), 30 * 1000);
+    while (hash_cantidad(hash) == 2 && reloj_prueba < 60 * 1000) {
+        reloj_prueba += 1000;
+        hash_expirar(hash, reloj_prueba, 256);
+    }
+    print_test("Prueba hash ttl ticks vacios no gastan trabajo", reloj_prueba == 30 * 1000 && hash_cantidad(hash) == 1);
+    print_test("Prueba hash ttl la entrada de una hora sigue", hash_pertenece(hash, "hora"));
+
+    hash_destruir(hash);
+}
+
+static void prueba_hash_filtro()
+{
+    hash_t* hash = hash_crear(NULL);
+    print_test("Prueba hash filtro guardar antes de activar", hash_guardar(hash, "perro", "guau"));
+    print_test("Prueba hash filtro activar", hash_filtro_activar(hash, 10));
+    print_test("Prueba hash filtro pertenece clave previa", hash_pertenece(hash, "perro"));
+
+    const size_t largo = 5000;
+    char clave[12];
+    bool ok = true;
+    for (size_t i = 0; i < largo; i++) {
+        sprintf(clave, "%08zu", i);
+        ok &= hash_guardar(hash, clave, NULL);
+    }
+    for (size_t i = 0; i < largo; i++) {
+        sprintf(clave, "%08zu", i);
+        ok &= hash_pertenece(hash, clave);
+    }
+    print_test("Prueba hash filtro no hay falsos negativos", ok);
+
+    ok = true;
+    for (size_t i = 0; i < largo; i += 2) {
+        sprintf(clave, "%08zu", i);
+        hash_borrar(hash, clave);
+    }
+    for (size_t i = 0; i < largo; i++) {
+        sprintf(clave, "%08zu", i);
+        ok &= hash_pertenece(hash, clave) == (i % 2 == 1);
+    }
+    print_test("Prueba hash filtro pertenece tras borrar", ok);
+
+    hash_filtro_estadisticas_t antes, despues;
+    hash_filtro_estadisticas(hash, &antes);
+    for (size_t i = largo; i < 11 * largo; i++) {
+        sprintf(clave, "%08zu", i);
+        hash_pertenece(hash, clave);
+    }
+    hash_filtro_estadisticas(hash, &despues);
+    size_t descartes = despues.descartes - antes.descartes;
+    print_test("Prueba hash filtro descarta la mayoria de las ausencias", descartes > 9 * largo);
+    print_test("Prueba hash filtro tasa de falsos positivos", despues.tasa_falsos_positivos < 0.1);
+    print_test("Prueba hash filtro ocupa memoria", despues.bytes > 0);
+
+    hash_filtro_desactivar(hash);
+    hash_filtro_estadisticas(hash, &despues);
+    print_test("Prueba hash filtro desactivado no tiene estadisticas", despues.consultas == 0);
+    print_test("Prueba hash filtro desactivado pertenece", hash_pertenece(hash, "perro"));
+    hash_destruir(hash);
+}
+
+static const void* serializar_cadena(const void* dato, size_t* largo)
+{
+    *largo = strlen(dato) + 1;
+    return dato;
+}
+
+static void* deserializar_cadena(const void* bytes, size_t largo)
+{
+    char* cadena = malloc(largo);
+    if (cadena) memcpy(cadena, bytes, largo);
+    return cadena;
+}
+
+static char* duplicar(const char* cadena)
+{
+    return deserializar_cadena(cadena, strlen(cadena) + 1);
+}
+
+static void borrar_archivos_persistencia(const char* ruta)
+{
+    char nombre[256];
+    sprintf(nombre, "%s.snap", ruta);
+    unlink(nombre);
+    for (unsigned i = 0; i < 8; i++) {
+        sprintf(nombre, "%s.log.%u", ruta, i);
+        unlink(nombre);
+    }
+}
+
+static void prueba_hash_persistente()
+{
+    char ruta[128];
+    sprintf(ruta, "/tmp/hash_pruebas_%d", (int) getpid());
+    borrar_archivos_persistencia(ruta);
+    hash_persistencia_t persistencia = { serializar_cadena, deserializar_cadena, 64, 2, 0 };
+
+    hash_t* hash = hash_abrir_persistente(ruta, &persistencia, free);
+    print_test("Prueba hash persistente abrir vacio", hash && hash_cantidad(hash) == 0);
+    print_test("Prueba hash persistente guardar perro", hash_guardar(hash, "perro", duplicar("guau")));
+    print_test("Prueba hash persistente guardar gato", hash_guardar(hash, "gato", duplicar("miau")));
+    print_test("Prueba hash persistente guardar vaca", hash_guardar(hash, "vaca", duplicar("mu")));
+    print_test("Prueba hash persistente reemplazar perro", hash_guardar(hash, "perro", duplicar("warf")));
+    free(hash_borrar(hash, "gato"));
+    print_test("Prueba hash persistente sincronizar", hash_sincronizar(hash));
+    hash_destruir(hash);
+
+    hash = hash_abrir_persistente(ruta, &persistencia, free);
+    print_test("Prueba hash persistente recuperar", hash && hash_cantidad(hash) == 2);
+    print_test("Prueba hash persistente recupera perro", hash && strcmp(hash_obtener(hash, "perro"), "warf") == 0);
+    print_test("Prueba hash persistente recupera vaca", hash && strcmp(hash_obtener(hash, "vaca"), "mu") == 0);
+    print_test("Prueba hash persistente gato sigue borrado", hash && !hash_pertenece(hash, "gato"));
+
+    /* Compacta mientras sigue recibiendo operaciones */
+    print_test("Prueba hash persistente compactar", hash_compactar(hash));
+    print_test("Prueba hash persistente guardar durante compactacion", hash_guardar(hash, "pato", duplicar("cuac")));
+    free(hash_borrar(hash, "vaca"));
+    hash_destruir(hash);
+
+    hash = hash_abrir_persistente(ruta, &persistencia, free);
+    print_test("Prueba hash persistente recuperar compactado", hash && hash_cantidad(hash) == 2);
+    print_test("Prueba hash persistente recupera pato", hash && strcmp(hash_obtener(hash, "pato"), "cuac") == 0);
+    print_test("Prueba hash persistente vaca sigue borrada", hash && !hash_pertenece(hash, "vaca"));
+    hash_destruir(hash);
+
+    /* Un alta que falla por el limite de memoria no revive al recuperar */
+    hash = hash_abrir_persistente(ruta, &persistencia, free);
+    char* dato = duplicar("nuevo");
+    bool ok = hash != NULL;
+    if (ok) {
+        hash_limitar_memoria(hash, hash_memoria(hash));
+        ok = !hash_guardar(hash, "clave larga que no entra en el limite", dato);
+        hash_limitar_memoria(hash, 0);
+        ok = ok && hash_sincronizar(hash);
+        hash_destruir(hash);
+    }
+    free(dato);
+    print_test("Prueba hash persistente guardar sobre el limite falla", ok);
+    hash = hash_abrir_persistente(ruta, &persistencia, free);
+    print_test("Prueba hash persistente el alta fallida no se recupera",
+               hash && !hash_pertenece(hash, "clave larga que no entra en el limite") && hash_cantidad(hash) == 2);
+    hash_destruir(hash);
+
+    /* Con commit por tiempo, lo anotado llega a disco aunque la tabla quede
+     * quieta: el hijo guarda, espera y termina sin cerrar la tabla */
+    hash_persistencia_t por_tiempo = { serializar_cadena, deserializar_cadena, 0, 0, 20 };
+    pid_t hijo = fork();
+    if (hijo == 0) {
+        hash = hash_abrir_persistente(ruta, &por_tiempo, free);
+        bool guardado = hash && hash_guardar(hash, "quieto", duplicar("zzz"));
+        struct timespec espera = { 0, 200 * 1000000L };
+        nanosleep(&espera, NULL);
+        _exit(guardado ? 0 : 1);
+    }
+    int estado = 1;
+    if (hijo > 0)
+        waitpid(hijo, &estado, 0);
+    hash = hash_abrir_persistente(ruta, &persistencia, free);
+    print_test("Prueba hash persistente commit por tiempo sin mas operaciones",
+               hijo > 0 && WIFEXITED(estado) && WEXITSTATUS(estado) == 0
+               && hash && hash_obtener(hash, "quieto") && strcmp(hash_obtener(hash, "quieto"), "zzz") == 0);
+    hash_destruir(hash);
+
+    /* Los vencimientos sobreviven al reinicio y a la compactacion */
+    hash = hash_abrir_persistente(ruta, &persistencia, free);
+    ok = hash && hash_guardar_con_ttl(hash, "efimera", duplicar("tic"), 300)
+         && hash_guardar_con_ttl(hash, "vencida", duplicar("tac"), 0)
+         && hash_guardar_con_ttl(hash, "perro", duplicar("grr"), 300);
+    print_test("Prueba hash persistente guardar con ttl", ok && hash_sincronizar(hash));
+    hash_destruir(hash);
+    hash = hash_abrir_persistente(ruta, &persistencia, free);
+    print_test("Prueba hash persistente recupera la clave con ttl", hash && hash_pertenece(hash, "efimera"));
+    print_test("Prueba hash persistente la clave vencida no se recupera", hash && !hash_pertenece(hash, "vencida"));
+    print_test("Prueba hash persistente compactar con ttl", hash && hash_compactar(hash));
+    hash_destruir(hash);
+    hash = hash_abrir_persistente(ruta, &persistencia, free);
+    print_test("Prueba hash persistente la instantanea conserva el ttl", hash && hash_pertenece(hash, "efimera") && hash_pertenece(hash, "perro"));
+    struct timespec vencer = { 0, 400 * 1000000L };
+    nanosleep(&vencer, NULL);
+    print_test("Prueba hash persistente el ttl recuperado vence", hash && !hash_pertenece(hash, "efimera") && !hash_pertenece(hash, "perro"));
+    hash_destruir(hash);
+    hash = hash_abrir_persistente(ruta, &persistencia, free);
+    print_test("Prueba hash persistente lo vencido no vuelve", hash && !hash_pertenece(hash, "efimera") && hash_pertenece(hash, "quieto"));
+    hash_destruir(hash);
+    borrar_archivos_persistencia(ruta);
+
+    /* Una cola cortada solo se descarta en el ultimo segmento: en uno
+     * anterior son operaciones perdidas y la recuperacion falla */
+    char segmento[160];
+    hash = hash_abrir_persistente(ruta, &persistencia, free);
+    ok = hash && hash_guardar(hash, "perro", duplicar("guau")) && hash_sincronizar(hash);
+    hash_destruir(hash);
+    sprintf(segmento, "%s.log.0", ruta);
+    FILE* archivo = fopen(segmento, "ab");
+    ok = ok && archivo && fwrite("\x01\x05\x00", 1, 3, archivo) == 3;
+    if (archivo)
+        fclose(archivo);
+    sprintf(segmento, "%s.log.1", ruta);
+    archivo = fopen(segmento, "wb");
+    if (archivo)
+        fclose(archivo);
+    hash = ok && archivo ? hash_abrir_persistente(ruta, &persistencia, free) : NULL;
+    print_test("Prueba hash persistente cola cortada en segmento anterior falla", ok && archivo && !hash);
+    if (hash)
+        hash_destruir(hash);
+    unlink(segmento);
+    hash = hash_abrir_persistente(ruta, &persistencia, free);
+    print_test("Prueba hash persistente cola cortada en el ultimo segmento se descarta",
+               hash && hash_cantidad(hash) == 1 && strcmp(hash_obtener(hash, "perro"), "guau") == 0);
+    if (hash)
+        hash_destruir(hash);
+
+    borrar_archivos_persistencia(ruta);
+}
+
+static void prueba_hash_guardar_lote()
+{
+    hash_t* hash = hash_crear(NULL);
+    const char *claves[] = {"perro", "gato", "vaca", "perro"};
+    void *datos[] = {"guau", "miau", "mu", "warf"};
+
+    print_test("Prueba hash guardar lote", hash_guardar_lote(hash, claves, datos, 4) == 4);
+    print_test("Prueba hash guardar lote la cantidad de elementos es 3", hash_cantidad(hash) == 3);
+    print_test("Prueba hash guardar lote la clave repetida se reemplaza", hash_obtener(hash, "perro") == datos[3]);
+
+    hash_estadisticas_t estadisticas;
+    hash_estadisticas(hash, &estadisticas);
+    print_test("Prueba hash estadisticas cantidad", estadisticas.cantidad == 3);
+    print_test("Prueba hash estadisticas baldes ocupados", estadisticas.baldes_ocupados > 0 && estadisticas.baldes_ocupados <= 3);
+    print_test("Prueba hash estadisticas cadena maxima", estadisticas.cadena_maxima >= 1);
+    hash_destruir(hash);
+}
+
+static size_t destruidos_diferido = 0;
+
+static void contar_destruido(void* dato)
+{
+    free(dato);
+    destruidos_diferido++;
+}
+
+static void prueba_hash_destruir_diferido()
+{
+    hash_t* hash = hash_crear(contar_destruido);
+    char clave[16];
+    bool ok = true;
+    for (size_t i = 0; i < 20000 && ok; i++) {
+        sprintf(clave, "%zu", i);
+        ok = hash_guardar(hash, clave, malloc(sizeof(size_t)));
+    }
+    print_test("Prueba hash diferido guardar muchos elementos", ok);
+
+    hash_destruir_diferido(hash, true);
+    print_test("Prueba hash diferido el pendiente no supera lo encolado", hash_destruccion_pendiente() <= 20000);
+    hash_esperar_destrucciones();
+    print_test("Prueba hash diferido no queda nada pendiente", hash_destruccion_pendiente() == 0);
+    print_test("Prueba hash diferido destruye todos los datos", destruidos_diferido == 20000);
+
+    /* Una tabla chica se destruye en el momento */
+    hash = hash_crear(contar_destruido);
+    hash_guardar(hash, "perro", malloc(sizeof(size_t)));
+    hash_destruir_diferido(hash, true);
+    print_test("Prueba hash diferido tabla chica se destruye en el momento", destruidos_diferido == 20001);
+
+    /* Sin permiso, destruir_dato no corre en el hilo de fondo */
+    hash = hash_crear(contar_destruido);
+    ok = true;
+    for (size_t i = 0; i < 20000 && ok; i++) {
+        sprintf(clave, "%zu", i);
+        ok = hash_guardar(hash, clave, malloc(sizeof(size_t)));
+    }
+    hash_destruir_diferido(hash, false);
+    print_test("Prueba hash diferido sin llamadas en fondo se destruye en el momento",
+               ok && destruidos_diferido == 40001 && hash_destruccion_pendiente() == 0);
+}
+
+/* Allocador de prueba: guarda el tamanio delante de cada bloque para
+ * saber cuantos bytes quedan pedidos */
+typedef struct contador_memoria {
+    size_t bytes;
+    size_t bloques;
+    size_t pedidos_restantes;  // si no es 0, falla el pedido que lo lleva a 0
+} contador_memoria_t;
+
+static void* contador_pedir(void* contexto, size_t tamanio)
+{
+    contador_memoria_t* contador = contexto;
+    if (contador->pedidos_restantes && --contador->pedidos_restantes == 0) return NULL;
+    size_t* bloque = malloc(sizeof(size_t) + tamanio);
+    if (!bloque) return NULL;
+    *bloque = tamanio;
+    contador->bytes += tamanio;
+    contador->bloques++;
+    return bloque + 1;
+}
+
+static void* contador_redimensionar(void* contexto, void* ptr, size_t tamanio)
+{
+    contador_memoria_t* contador = contexto;
+    size_t* bloque = (size_t*) ptr - 1;
+    size_t anterior = *bloque;
+    bloque = realloc(bloque, sizeof(size_t) + tamanio);
+    if (!bloque) return NULL;
+    *bloque = tamanio;
+    contador->bytes = contador->bytes - anterior + tamanio;
+    return bloque + 1;
+}
+
+static void contador_liberar(void* contexto, void* ptr)
+{
+    contador_memoria_t* contador = contexto;
+    size_t* bloque = (size_t*) ptr - 1;
+    contador->bytes -= *bloque;
+    contador->bloques--;
+    free(bloque);
+}
+
+static void prueba_hash_allocador()
+{
+    contador_memoria_t contador = {0, 0, 0};
+    hash_t* hash = hash_crear_con_allocador(contador_pedir, contador_redimensionar, contador_liberar, &contador, NULL);
+    char clave[16];
+    bool ok = hash && hash_filtro_activar(hash, 10);
+    for (size_t i = 0; i < 2000 && ok; i++) {
+        sprintf(clave, "%zu", i);
+        ok = hash_guardar(hash, clave, NULL);
+    }
+    for (size_t i = 0; i < 2000 && ok; i += 3) {
+        sprintf(clave, "%zu", i);
+        hash_borrar(hash, clave);
+    }
+    print_test("Prueba hash allocador guardar y borrar", ok);
+    print_test("Prueba hash allocador la cuenta de memoria es exacta", hash_memoria(hash) == contador.bytes);
+
+    /* Con el limite en el uso actual no entran claves nuevas */
+    size_t cantidad = hash_cantidad(hash);
+    hash_limitar_memoria(hash, hash_memoria(hash));
+    print_test("Prueba hash allocador guardar sobre el limite es false", !hash_guardar(hash, "nueva", NULL));
+    print_test("Prueba hash allocador la cantidad no cambia", hash_cantidad(hash) == cantidad);
+    print_test("Prueba hash allocador reemplazar no pide memoria", hash_guardar(hash, "1", "reemplazo"));
+    print_test("Prueba hash allocador la memoria no supera el limite", hash_memoria(hash) == contador.bytes);
+
+    hash_limitar_memoria(hash, 0);
+    print_test("Prueba hash allocador sin limite vuelve a guardar", hash_guardar(hash, "nueva", NULL));
+    hash_destruir(hash);
+    print_test("Prueba hash allocador destruir libera todo", contador.bytes == 0 && contador.bloques == 0);
+
+    allocador_t allocador = { contador_pedir, contador_redimensionar, contador_liberar, &contador };
+    lista_t* lista = lista_crear_con_allocador(&allocador);
+    ok = lista && lista_insertar_ultimo(lista, "a") && lista_insertar_primero(lista, "b");
+    print_test("Prueba lista allocador pide memoria", ok && contador.bloques == 3);
+    lista_destruir(lista, NULL);
+    print_test("Prueba lista allocador destruir libera todo", contador.bytes == 0 && contador.bloques == 0);
+
+    /* Congelar que se queda sin memoria a mitad de camino no pierde bloques */
+    hash = hash_crear_con_allocador(contador_pedir, contador_redimensionar, contador_liberar, &contador, NULL);
+    ok = hash != NULL;
+    for (size_t i = 0; i < 500 && ok; i++) {
+        sprintf(clave, "%zu", i);
+        ok = hash_guardar(hash, clave, NULL);
+    }
+    size_t bloques = contador.bloques;
+    bool sin_perdidas = true;
+    bool congelado = false;
+    for (size_t pedidos = 1; ok && !congelado; pedidos++) {
+        contador.pedidos_restantes = pedidos;
+        congelado = hash_congelar(hash);
+        sin_perdidas = sin_perdidas && (congelado || contador.bloques == bloques);
+    }
+    contador.pedidos_restantes = 0;
+    print_test("Prueba hash allocador congelar sin memoria no pierde bloques", ok && congelado && sin_perdidas);
+    hash_destruir(hash);
+    print_test("Prueba hash allocador destruir congelado libera todo", contador.bytes == 0 && contador.bloques == 0);
+}
+
+static void* resolver_mayor(const char* clave, void* dato_destino, void* dato_origen, void* extra)
+{
+    (void) clave;
+    __atomic_add_fetch((size_t*) extra, 1, __ATOMIC_RELAXED);
+    return *(size_t*) dato_destino >= *(size_t*) dato_origen ? dato_destino : dato_origen;
+}
+
+/* Llena el hash con las claves [desde, hasta); el dato de la clave i apunta
+ * a valores[i] */
+static bool llenar_rango(hash_t* hash, size_t desde, size_t hasta, size_t* valores)
+{
+    char clave[24];
+    bool ok = true;
+    for (size_t i = desde; i < hasta && ok; i++) {
+        sprintf(clave, "%zu", i);
+        ok = hash_guardar(hash, clave, &valores[i]);
+    }
+    return ok;
+}
+
+static void prueba_hash_fusionar()
+{
+    /* Lo bastante grande para repartir el trabajo en varios hilos */
+    const size_t largo = 60000;
+    size_t* valores = malloc(largo * sizeof(size_t));
+    size_t* otros = malloc(largo * sizeof(size_t));
+    for (size_t i = 0; i < largo; i++) {
+        valores[i] = i;
+        otros[i] = i % 2 ? 0 : largo + i;
+    }
+
+    hash_t* destino = hash_crear(NULL);
+    hash_t* origen = hash_crear(NULL);
+    bool ok = llenar_rango(destino, 0, 40000, valores) && llenar_rango(origen, 20000, largo, otros);
+    size_t comunes = 0;
+    ok = ok && hash_fusionar(destino, origen, resolver_mayor, &comunes);
+    print_test("Prueba hash fusionar", ok);
+    print_test("Prueba hash fusionar la cantidad es la union", hash_cantidad(destino) == largo);
+    print_test("Prueba hash fusionar llama al resolver por cada clave en comun", comunes == 20000);
+    print_test("Prueba hash fusionar el resolver elige el dato",
+               hash_obtener(destino, "20000") == &otros[20000] && hash_obtener(destino, "20001") == &valores[20001]);
+    print_test("Prueba hash fusionar agrega las claves nuevas", hash_obtener(destino, "59999") == &otros[59999]);
+    print_test("Prueba hash fusionar no modifica el origen", hash_cantidad(origen) == 40000);
+
+    hash_iter_t* iter = hash_iter_crear(destino);
+    for (size_t i = 0; i < 40000; i++)
+        hash_iter_avanzar(iter);
+    print_test("Prueba hash fusionar agrega en el orden del origen", strcmp(hash_iter_ver_actual(iter), "40000") == 0);
+    hash_iter_destruir(iter);
+    hash_destruir(destino);
+
+    destino = hash_crear(NULL);
+    ok = llenar_rango(destino, 0, 40000, valores) && hash_interseccion(destino, origen, NULL, NULL);
+    print_test("Prueba hash interseccion", ok && hash_cantidad(destino) == 20000);
+    print_test("Prueba hash interseccion conserva el dato del destino", hash_obtener(destino, "20000") == &valores[20000]);
+    print_test("Prueba hash interseccion quita las claves que no estan en origen", !hash_pertenece(destino, "19999"));
+    hash_destruir(destino);
+
+    destino = hash_crear(NULL);
+    ok = llenar_rango(destino, 0, 40000, valores) && hash_diferencia(destino, origen);
+    print_test("Prueba hash diferencia", ok && hash_cantidad(destino) == 20000);
+    print_test("Prueba hash diferencia quita las claves de origen",
+               !hash_pertenece(destino, "20000") && hash_pertenece(destino, "19999"));
+    hash_destruir(destino);
+
+    hash_destruir(origen);
+    free(valores);
+    free(otros);
+}
+
+typedef struct lectura_traza {
+    traza_operacion_t operaciones[8];
+    char claves[8][16];
+    size_t cantidad;
+} lectura_traza_t;
+
+static bool leer_operacion(traza_operacion_t operacion, const char* clave, size_t largo,
+                           uint64_t hash, uint64_t instante, void* extra)
+{
+    (void) hash;
+    (void) instante;
+    lectura_traza_t* lectura = extra;
+    if (lectura->cantidad == 8 || largo >= 16) return false;
+    lectura->operaciones[lectura->cantidad] = operacion;
+    strcpy(lectura->claves[lectura->cantidad], clave);
+    lectura->cantidad++;
+    return true;
+}
+
+static void prueba_hash_traza()
+{
+    char ruta[64];
+    sprintf(ruta, "/tmp/hash_pruebas_traza_%d", (int) getpid());
+    hash_t* hash = hash_crear(NULL);
+
+    print_test("Prueba hash traza iniciar", hash_traza_iniciar(hash, ruta, true));
+    hash_guardar(hash, "perro", "guau");
+    hash_obtener(hash, "perro");
+    hash_pertenece(hash, "gato");
+    hash_borrar(hash, "perro");
+    print_test("Prueba hash traza detener", hash_traza_detener(hash));
+    hash_guardar(hash, "vaca", "mu");
+
+    lectura_traza_t lectura = { .cantidad = 0 };
+    bool con_claves = false;
+    bool ok = traza_leer(ruta, &con_claves, leer_operacion, &lectura);
+    print_test("Prueba hash traza leer", ok && con_claves);
+    print_test("Prueba hash traza tiene las operaciones grabadas", lectura.cantidad == 4);
+    print_test("Prueba hash traza respeta el orden",
+               lectura.operaciones[0] == TRAZA_GUARDAR && lectura.operaciones[1] == TRAZA_OBTENER &&
+               lectura.operaciones[2] == TRAZA_PERTENECE && lectura.operaciones[3] == TRAZA_BORRAR);
+    print_test("Prueba hash traza guarda las claves",
+               strcmp(lectura.claves[0], "perro") == 0 && strcmp(lectura.claves[2], "gato") == 0);
+
+    hash_destruir(hash);
+    unlink(ruta);
+}
+
+/* "Aa" y "B@" tienen el mismo f_hash, y cualquier concatenacion de ellos
+ * tambien: todas las claves de un mismo largo colisionan y se distinguen
+ * solo al comparar las claves, cortas (dentro del nodo) y largas. */
+static void armar_clave_colision(char* clave, size_t bloques, size_t bits, const char* sufijo)
+{
+    for (size_t b = 0; b < bloques; b++)
+        memcpy(clave + 2 * b, (bits >> b) & 1 ? "B@" : "Aa", 2);
+    strcpy(clave + 2 * bloques, sufijo);
+}
+
+static void prueba_hash_claves_colisionan()
+{
+    hash_t* hash = hash_crear(free);
+    const size_t bloques[] = { 7, 8, 8, 12 };
+    const char* sufijos[] = { "", "", "x", "yz" };
+    char clave[32];
+    bool ok = true;
+
+    for (size_t l = 0; l < 4 && ok; l++) {
+        for (size_t bits = 0; bits < 128 && ok; bits++) {
+            armar_clave_colision(clave, bloques[l], bits, sufijos[l]);
+            size_t* valor = malloc(sizeof(size_t));
+            *valor = l * 128 + bits;
+            ok = valor && hash_guardar(hash, clave, valor);
+        }
+    }
+    print_test("Prueba hash guardar claves que colisionan", ok && hash_cantidad(hash) == 512);
+
+    for (size_t l = 0; l < 4 && ok; l++) {
+        for (size_t bits = 0; bits < 128 && ok; bits++) {
+            armar_clave_colision(clave, bloques[l], bits, sufijos[l]);
+            size_t* valor = hash_obtener(hash, clave);
+            ok = valor && *valor == l * 128 + bits;
+        }
+    }
+    print_test("Prueba hash obtener claves que colisionan", ok);
+
+    /* Mismo hash y mismo largo, pero con bloques que no se guardaron */
+    armar_clave_colision(clave, 8, 255, "");
+    ok = !hash_pertenece(hash, clave);
+    armar_clave_colision(clave, 12, 4095, "yz");
+    ok = ok && !hash_pertenece(hash, clave);
+    armar_clave_colision(clave, 8, 1, "");
+    ok = ok && hash_pertenece(hash, clave);
+    clave[15] = '\0';
+    print_test("Prueba hash claves que colisionan se distinguen", ok && !hash_pertenece(hash, clave));
+
+    hash_destruir(hash);
+}
+
+/* Funciones de hash de la tabla, definidas en hash.c */
+unsigned long f_hash(const char* str);
+uint64_t hash_mezclar(unsigned long h);
+
+static bool leer_hash_pertenece(traza_operacion_t operacion, const char* clave, size_t largo,
+                                uint64_t hash, uint64_t instante, void* extra)
+{
+    (void) clave;
+    (void) largo;
+    (void) instante;
+    uint64_t* hashes = extra;
+    if (operacion == TRAZA_PERTENECE && hashes[2] < 2)
+        hashes[hashes[2]++] = hash;
+    return true;
+}
+
+static void prueba_hash_colisiones_cambian_funcion()
+{
+    hash_t* hash = hash_crear(NULL);
+    hash_t* cuckoo = hash_cuckoo_crear(NULL);
+    size_t* valores = malloc(512 * sizeof(size_t));
+    char clave[32];
+    char ruta[64];
+    sprintf(ruta, "/tmp/hash_pruebas_traza_%d", (int) getpid());
+    bool ok = valores != NULL;
+
+    /* La traza sin claves graba un hash que no cambia con la funcion */
+    print_test("Prueba hash colisiones iniciar traza", hash_traza_iniciar(hash, ruta, false));
+    hash_pertenece(hash, "perro");
+
+    /* 512 claves con el mismo f_hash: sin defensa, cada una sondea todas */
+    for (size_t bits = 0; bits < 512 && ok; bits++) {
+        valores[bits] = bits;
+        armar_clave_colision(clave, 9, bits, "");
+        ok = hash_guardar(hash, clave, &valores[bits]) && hash_guardar(cuckoo, clave, &valores[bits]);
+    }
+    print_test("Prueba hash guardar muchas claves con el mismo hash", ok && hash_cantidad(hash) == 512 && hash_cantidad(cuckoo) == 512);
+    for (size_t bits = 0; bits < 512 && ok; bits++) {
+        armar_clave_colision(clave, 9, bits, "");
+        ok = hash_obtener(hash, clave) == &valores[bits] && hash_obtener(cuckoo, clave) == &valores[bits];
+    }
+    print_test("Prueba hash obtener muchas claves con el mismo hash", ok);
+
+    hash_estadisticas_t estadisticas;
+    hash_estadisticas(hash, &estadisticas);
+    print_test("Prueba hash colisiones dejan el sondeo corto", estadisticas.cadena_maxima < 32);
+
+    hash_pertenece(hash, "perro");
+    uint64_t hashes[3] = { 0, 0, 0 };
+    bool con_claves = true;
+    ok = hash_traza_detener(hash) && traza_leer(ruta, &con_claves, leer_hash_pertenece, hashes);
+    print_test("Prueba hash colisiones la traza conserva el hash de cada clave", ok && !con_claves && hashes[2] == 2 && hashes[0] == hashes[1]);
+    unlink(ruta);
+
+    /* Hashes distintos que caen en la misma posicion inicial para toda
+     * capacidad 31 * 2^k (la inicial es 31) hasta 31 * 2^10: solo los
+     * delata el largo del sondeo */
+    hash_t* agrupadas = hash_crear(NULL);
+    size_t guardadas = 0;
+    ok = agrupadas != NULL;
+    for (size_t i = 0; ok && guardadas < 64; i++) {
+        sprintf(clave, "k%zu", i);
+        if (hash_mezclar(f_hash(clave)) % (31 << 10) == 0) {
+            ok = hash_guardar(agrupadas, clave, NULL);
+            guardadas++;
+        }
+    }
+    print_test("Prueba hash guardar claves que caen juntas", ok && hash_cantidad(agrupadas) == 64);
+    hash_estadisticas(agrupadas, &estadisticas);
+    print_test("Prueba hash sondeos largos cambian la funcion", ok && estadisticas.cadena_maxima < 32);
+
+    if (agrupadas)
+        hash_destruir(agrupadas);
+    hash_destruir(hash);
+    hash_destruir(cuckoo);
+    free(valores);
+}
+
+static void prueba_hash_redimension_paralela()
+{
+    size_t cantidad = 200000;
+    hash_t* hash = hash_crear(NULL);
+    size_t* valores = malloc(cantidad * sizeof(size_t));
+    char clave[24];
+    bool ok = hash && valores;
+
+    hash_configurar_redimension(hash, 4);
+    for (size_t i = 0; i < cantidad && ok; i++) {
+        sprintf(clave, "%08zu", i);
+        valores[i] = i;
+        ok = hash_guardar(hash, clave, &valores[i]);
+        /* Borra una de cada tres para que las redimensiones compacten */
+        if (ok && i % 3 == 0 && i > 0) {
+            sprintf(clave, "%08zu", i - 1);
+            ok = hash_borrar(hash, clave) == &valores[i - 1];
+        }
+    }
+    print_test("Prueba hash redimension paralela guardar muchos", ok);
+
+    for (size_t i = 0; i < cantidad && ok; i++) {
+        sprintf(clave, "%08zu", i);
+        bool borrada = i % 3 == 2 && i + 1 < cantidad;
+        ok = hash_obtener(hash, clave) == (borrada ? NULL : &valores[i]);
+    }
+    print_test("Prueba hash redimension paralela obtener todos", ok);
+
+    /* El orden de insercion se conserva al compactar */
+    hash_iter_t* iter = hash_iter_crear(hash);
+    size_t anterior = 0, vistas = 0;
+    while (ok && !hash_iter_al_final(iter)) {
+        size_t actual = *(size_t*)hash_obtener(hash, hash_iter_ver_actual(iter));
+        ok = vistas == 0 || actual > anterior;
+        anterior = actual;
+        vistas++;
+        hash_iter_avanzar(iter);
+    }
+    hash_iter_destruir(iter);
+    print_test("Prueba hash redimension paralela conserva el orden", ok && vistas == hash_cantidad(hash));
+
+    hash_estadisticas_t estadisticas;
+    hash_estadisticas(hash, &estadisticas);
+    size_t movidas, totales;
+    bool en_curso = hash_redimension_progreso(hash, &movidas, &totales);
+    print_test("Prueba hash redimension paralela en las estadisticas", estadisticas.redimensiones_paralelas > 0 && estadisticas.redimensiones >= estadisticas.redimensiones_paralelas);
+    print_test("Prueba hash redimension paralela progreso completo", !en_curso && totales > 0 && movidas == totales);
+
+    hash_destruir(hash);
+    free(valores);
+}
+
+static void prueba_hash_cuckoo()
+{
+    size_t cantidad = 100000;
+    hash_t* hash = hash_cuckoo_crear(NULL);
+    size_t* valores = malloc(cantidad * sizeof(size_t));
+    char clave[24];
+    bool ok = hash && valores;
+
+    for (size_t i = 0; i < cantidad && ok; i++) {
+        sprintf(clave, "%08zu", i);
+        valores[i] = i;
+        ok = hash_guardar(hash, clave, &valores[i]);
+    }
+    print_test("Prueba hash cuckoo guardar muchos", ok && hash_cantidad(hash) == cantidad);
+    for (size_t i = 0; i < cantidad && ok; i++) {
+        sprintf(clave, "%08zu", i);
+        ok = hash_obtener(hash, clave) == &valores[i];
+    }
+    print_test("Prueba hash cuckoo obtener muchos", ok);
+
+    hash_estadisticas_t estadisticas;
+    hash_estadisticas(hash, &estadisticas);
+    print_test("Prueba hash cuckoo revisa a lo sumo dos baldes y el desborde", estadisticas.cadena_maxima <= 3);
+    print_test("Prueba hash cuckoo ocupados coincide con la cantidad", estadisticas.baldes_ocupados == cantidad);
+
+    for (size_t i = 0; i < cantidad && ok; i += 2) {
+        sprintf(clave, "%08zu", i);
+        ok = hash_borrar(hash, clave) == &valores[i];
+    }
+    for (size_t i = 0; i < cantidad && ok; i++) {
+        sprintf(clave, "%08zu", i);
+        ok = hash_pertenece(hash, clave) == (i % 2 == 1);
+    }
+    print_test("Prueba hash cuckoo borrar la mitad", ok && hash_cantidad(hash) == cantidad / 2);
+    for (size_t i = 0; i < cantidad && ok; i += 2) {
+        sprintf(clave, "%08zu", i);
+        ok = hash_guardar(hash, clave, &valores[i]);
+    }
+    print_test("Prueba hash cuckoo volver a guardar", ok && hash_cantidad(hash) == cantidad);
+
+    hash_iter_t* iter = hash_iter_crear(hash);
+    print_test("Prueba hash cuckoo iterar en orden de insercion", strcmp(hash_iter_ver_actual(iter), "00000001") == 0);
+    hash_iter_destruir(iter);
+    hash_destruir(hash);
+
+    /* Las claves con el mismo hash comparten sus dos baldes */
+    hash = hash_cuckoo_crear(NULL);
+    ok = true;
+    for (size_t bits = 0; bits < 8 && ok; bits++) {
+        armar_clave_colision(clave, 8, bits, "");
+        ok = hash_guardar(hash, clave, &valores[bits]);
+    }
+    for (size_t bits = 0; bits < 8 && ok; bits++) {
+        armar_clave_colision(clave, 8, bits, "");
+        ok = hash_obtener(hash, clave) == &valores[bits];
+    }
+    print_test("Prueba hash cuckoo claves con el mismo hash", ok);
+    hash_destruir(hash);
+    free(valores);
+}
+
+static void* sumar_uno(const char* clave, void* dato, bool existia, void* extra)
+{
+    (void) clave;
+    size_t* llamadas = extra;
+    (*llamadas)++;
+    size_t* contador = existia ? dato : calloc(1, sizeof(size_t));
+    if (contador) (*contador)++;
+    return contador;
+}
+
+static void prueba_hash_obtener_o_insertar()
+{
+    hash_t* hash = hash_crear(free);
+    bool insertado = false;
+
+    void** dato = hash_obtener_o_insertar(hash, "perro", &insertado);
+    print_test("Prueba hash obtener o insertar clave nueva", dato && insertado && !*dato);
+    print_test("Prueba hash obtener o insertar guarda la clave", hash_cantidad(hash) == 1 && hash_pertenece(hash, "perro"));
+    *dato = malloc(sizeof("guau"));
+    if (*dato) strcpy(*dato, "guau");
+    uint64_t version = hash_version(hash);
+    dato = hash_obtener_o_insertar(hash, "perro", &insertado);
+    print_test("Prueba hash obtener o insertar clave existente", dato && !insertado && strcmp(*dato, "guau") == 0);
+    print_test("Prueba hash obtener o insertar clave existente no es un cambio", hash_version(hash) == version);
+    print_test("Prueba hash obtener o insertar no duplica", hash_cantidad(hash) == 1);
+    print_test("Prueba hash obtener ve el dato escrito en el lugar", hash_obtener(hash, "perro") == *dato);
+    hash_destruir(hash);
+
+    /* Cuenta palabras con hash_actualizar */
+    const char* palabras[] = { "a", "b", "a", "c", "a", "b" };
+    hash = hash_crear(free);
+    size_t llamadas = 0;
+    bool ok = true;
+    for (size_t i = 0; i < 6 && ok; i++)
+        ok = hash_actualizar(hash, palabras[i], sumar_uno, &llamadas);
+    size_t* a = hash_obtener(hash, "a");
+    size_t* b = hash_obtener(hash, "b");
+    size_t* c = hash_obtener(hash, "c");
+    print_test("Prueba hash actualizar", ok && llamadas == 6 && hash_cantidad(hash) == 3);
+    print_test("Prueba hash actualizar cuenta", a && *a == 3 && b && *b == 2 && c && *c == 1);
+    print_test("Prueba hash actualizar cuenta cada llamada como cambio", hash_version(hash) == 6);
+    hash_destruir(hash);
+
+    /* Una clave vencida se trata como nueva */
+    hash = hash_crear(NULL);
+    ok = hash_configurar_reloj(hash, reloj_prueba_ver);
+    reloj_prueba = 0;
+    ok = ok && hash_guardar_con_ttl(hash, "efimera", "vieja", 5);
+    reloj_prueba = 10;
+    dato = hash_obtener_o_insertar(hash, "efimera", &insertado);
+    print_test("Prueba hash obtener o insertar clave vencida", ok && dato && insertado && !*dato);
+    hash_destruir(hash);
+
+    hash = hash_crear(NULL);
+    hash_guardar(hash, "fija", "dato");
+    hash_congelar(hash);
+    print_test("Prueba hash obtener o insertar en tabla congelada", !hash_obtener_o_insertar(hash, "fija", &insertado));
+    llamadas = 0;
+    print_test("Prueba hash actualizar en tabla congelada", !hash_actualizar(hash, "fija", sumar_uno, &llamadas) && !llamadas);
+    hash_destruir(hash);
+}
+
+static void prueba_hash_paginas_grandes()
+{
+    size_t cantidad = 300000;
+    hash_t* hash = hash_crear(NULL);
+    hash_t* cuckoo = hash_cuckoo_crear(NULL);
+    char clave[24];
+
+    print_test("Prueba hash configurar paginas grandes", hash_configurar_paginas(hash, true, true));
+    print_test("Prueba hash cuckoo configurar paginas grandes", hash_configurar_paginas(cuckoo, true, false));
+    bool ok = hash_filtro_activar(hash, 10);
+    for (size_t i = 0; i < cantidad && ok; i++) {
+        sprintf(clave, "%08zu", i);
+        ok = hash_guardar(hash, clave, NULL) && hash_guardar(cuckoo, clave, NULL);
+    }
+    print_test("Prueba hash paginas grandes guardar muchos", ok && hash_cantidad(hash) == cantidad);
+    for (size_t i = 0; i < cantidad && ok; i += 3) {
+        sprintf(clave, "%08zu", i);
+        ok = hash_pertenece(hash, clave) && hash_pertenece(cuckoo, clave);
+        hash_borrar(hash, clave);
+    }
+    sprintf(clave, "%08zu", cantidad);
+    print_test("Prueba hash paginas grandes buscar y borrar", ok && !hash_pertenece(hash, clave));
+    print_test("Prueba hash paginas grandes no se cambian con claves", !hash_configurar_paginas(hash, false, false));
+    print_test("Prueba hash prefaultear se cambia siempre", hash_configurar_paginas(cuckoo, true, true));
+
+    hash_destruir(hash);
+    hash_destruir(cuckoo);
+
+    /* Un registro de cambios grande ya se pidio de la otra forma */
+    hash = hash_crear(NULL);
+    ok = hash && hash_cambios_activar(hash, 200000);
+    print_test("Prueba hash paginas grandes no se cambian con un registro de cambios grande",
+               ok && !hash_configurar_paginas(hash, true, false));
+    if (hash) {
+        hash_cambios_desactivar(hash);
+        hash_destruir(hash);
+    }
+}
+
+typedef struct cambios_vistos {
+    size_t guardados;
+    size_t borrados;
+    size_t reinicios;
+    bool clave_b_guardada; /* con el ultimo dato */
+} cambios_vistos_t;
+
+static void contar_cambio(hash_cambio_t tipo, const char* clave, void* dato, void* extra)
+{
+    cambios_vistos_t* vistos = extra;
+    if (tipo == HASH_CAMBIO_REINICIO)
+        vistos->reinicios++;
+    else if (tipo == HASH_CAMBIO_BORRADO)
+        vistos->borrados++;
+    else
+        vistos->guardados++;
+    if (tipo == HASH_CAMBIO_GUARDADO && strcmp(clave, "b") == 0)
+        vistos->clave_b_guardada = *(int*)dato == 3;
+}
+
+static void prueba_hash_cambios()
+{
+    hash_t* hash = hash_crear(NULL);
+    int valores[] = {1, 2, 3};
+    char clave[24];
+
+    print_test("Prueba hash cambios activar", hash_cambios_activar(hash, 8));
+    hash_guardar(hash, "a", &valores[0]);
+    hash_guardar(hash, "b", &valores[1]);
+    uint64_t version = hash_version(hash);
+    print_test("Prueba hash version cuenta las modificaciones", version == 2);
+
+    hash_guardar(hash, "b", &valores[2]);
+    hash_guardar(hash, "c", &valores[0]);
+    hash_borrar(hash, "c");
+    hash_borrar(hash, "a");
+    cambios_vistos_t vistos = {0};
+    uint64_t actual = hash_cambios_desde(hash, version, contar_cambio, &vistos);
+    print_test("Prueba hash cambios desde devuelve la version", actual == hash_version(hash) && actual == 6);
+    print_test("Prueba hash cambios informa cada clave una vez", vistos.guardados == 1 && vistos.borrados == 2 && !vistos.reinicios);
+    print_test("Prueba hash cambios informa el dato actual", vistos.clave_b_guardada);
+
+    cambios_vistos_t nada = {0};
+    hash_cambios_desde(hash, actual, contar_cambio, &nada);
+    print_test("Prueba hash cambios sin cambios", !nada.guardados && !nada.borrados && !nada.reinicios);
+
+    /* El registro se llena y la version vieja ya no se puede cubrir */
+    for (size_t i = 0; i < 20; i++) {
+        sprintf(clave, "clave_%zu", i);
+        hash_guardar(hash, clave, &valores[0]);
+    }
+    cambios_vistos_t todo = {0};
+    hash_cambios_desde(hash, actual, contar_cambio, &todo);
+    print_test("Prueba hash cambios viejos envian la tabla", todo.reinicios == 1 && todo.guardados == hash_cantidad(hash) && !todo.borrados);
+    cambios_vistos_t recientes = {0};
+    hash_cambios_desde(hash, hash_version(hash) - 8, contar_cambio, &recientes);
+    print_test("Prueba hash cambios recientes siguen en el registro", recientes.guardados == 8 && !recientes.reinicios);
+
+    hash_cambios_desactivar(hash);
+    cambios_vistos_t sin_registro = {0};
+    hash_borrar(hash, "b");
+    hash_cambios_desde(hash, hash_version(hash) - 1, contar_cambio, &sin_registro);
+    print_test("Prueba hash cambios sin registro envian la tabla", sin_registro.reinicios == 1 && sin_registro.guardados == hash_cantidad(hash));
+
+    hash_destruir(hash);
+}
+
+static void prueba_hash_obtener_o_insertar_lote()
+{
+    const char* claves[] = {"a", "b", "a", "c", "b"};
+    void** datos[5];
+    bool insertados[5];
+    hash_t* hash = hash_crear(NULL);
+    int valor = 7;
+
+    hash_guardar(hash, "c", &valor);
+    size_t resueltos = hash_obtener_o_insertar_lote(hash, claves, 5, datos, insertados);
+    print_test("Prueba hash obtener o insertar lote resuelve todas", resueltos == 5 && hash_cantidad(hash) == 3);
+    print_test("Prueba hash obtener o insertar lote marca las nuevas", insertados[0] && insertados[1] && !insertados[2] && !insertados[3] && !insertados[4]);
+    print_test("Prueba hash obtener o insertar lote repetidas comparten dato", datos[0] == datos[2] && datos[1] == datos[4]);
+    print_test("Prueba hash obtener o insertar lote dato existente", *datos[3] == &valor);
+    *datos[0] = &valor;
+    print_test("Prueba hash obtener o insertar lote escribe en el lugar", hash_obtener(hash, "a") == &valor);
+
+    hash_destruir(hash);
+
+    /* Una cache mas chica que el lote desalojaria direcciones ya devueltas */
+    hash = hash_cache_crear(2, 0, HASH_POLITICA_LRU, NULL);
+    resueltos = hash_obtener_o_insertar_lote(hash, claves, 5, datos, insertados);
+    print_test("Prueba hash obtener o insertar lote en una cache no resuelve", resueltos == 0 && hash_cantidad(hash) == 0);
+    hash_destruir(hash);
+}
+
+static bool sumar_grupos(const char* clave, const agregado_t* agregado, void* extra)
+{
+    (void)clave;
+    *(int64_t*)extra += agregado->suma;
+    return true;
+}
+
+static void prueba_agregacion()
+{
+    size_t cantidad = 100000;
+    size_t grupos = 1000;
+    const char** claves = malloc(cantidad * sizeof(char*));
+    int64_t* valores = malloc(cantidad * sizeof(int64_t));
+    char* textos = malloc(grupos * 16);
+    agregacion_t* secuencial = agregacion_crear(1);
+    agregacion_t* paralela = agregacion_crear(8);
+    bool ok = claves && valores && textos && secuencial && paralela;
+
+    for (size_t g = 0; g < grupos && ok; g++)
+        sprintf(textos + g * 16, "grupo_%zu", g);
+    for (size_t i = 0; i < cantidad && ok; i++) {
+        claves[i] = textos + (i % grupos) * 16;
+        valores[i] = (int64_t)i;
+    }
+    print_test("Prueba agregacion agregar", ok && agregacion_agregar(secuencial, claves, valores, cantidad));
+    print_test("Prueba agregacion agregar paralelo", ok && agregacion_agregar_paralelo(paralela, claves, valores, cantidad, 4));
+    print_test("Prueba agregacion cantidad de grupos", ok && agregacion_grupos(secuencial) == grupos && agregacion_grupos(paralela) == grupos);
+
+    const agregado_t* uno = ok ? agregacion_buscar(secuencial, "grupo_7") : NULL;
+    const agregado_t* otro = ok ? agregacion_buscar(paralela, "grupo_7") : NULL;
+    /* grupo_7 recibe 7, 1007, ..., 99007 */
+    bool acumulado = uno && otro && uno->cuenta == 100 && uno->minimo == 7 && uno->maximo == 99007 && uno->suma == 100 * 7 + 1000 * 4950;
+    print_test("Prueba agregacion acumuladores", acumulado && otro->cuenta == uno->cuenta && otro->suma == uno->suma && otro->minimo == uno->minimo && otro->maximo == uno->maximo);
+    print_test("Prueba agregacion buscar grupo inexistente", ok && !agregacion_buscar(paralela, "grupo_1000"));
+
+    int64_t total = 0;
+    if (ok)
+        agregacion_iterar(paralela, sumar_grupos, &total);
+    print_test("Prueba agregacion iterar todos los grupos", total == (int64_t)(cantidad * (cantidad - 1) / 2));
+
+    if (secuencial)
+        agregacion_destruir(secuencial);
+    if (paralela)
+        agregacion_destruir(paralela);
+    free(claves);
+    free(valores);
+    free(textos);
+}
+
+typedef struct derrame_visto {
+    size_t encontradas;
+    size_t ausentes;
+    bool valores_ok;
+} derrame_visto_t;
+
+static void revisar_derrame(const char* clave, const void* valor, size_t largo, void* extra)
+{
+    derrame_visto_t* visto = extra;
+    if (!valor) {
+        visto->ausentes++;
+        return;
+    }
+    visto->encontradas++;
+    /* Cada valor es su propia clave */
+    if (largo != strlen(clave) || memcmp(valor, clave, largo) != 0)
+        visto->valores_ok = false;
+}
+
+static void prueba_derrame()
+{
+    size_t cantidad = 20000;
+    size_t presupuesto = 256 * 1024;
+    derrame_t* derrame = derrame_crear(NULL, presupuesto, 16);
+    const char** claves = malloc(cantidad * sizeof(char*));
+    const void** valores = malloc(cantidad * sizeof(void*));
+    size_t* largos = malloc(cantidad * sizeof(size_t));
+    char* textos = malloc(cantidad * 16);
+    bool ok = derrame && claves && valores && largos && textos;
+
+    for (size_t i = 0; i < cantidad && ok; i++) {
+        sprintf(textos + i * 16, "clave_%zu", i);
+        claves[i] = valores[i] = textos + i * 16;
+        largos[i] = strlen(claves[i]);
+    }
+    print_test("Prueba derrame guardar lote", ok && derrame_guardar_lote(derrame, claves, valores, largos, cantidad));
+    print_test("Prueba derrame respeta el presupuesto", ok && derrame_memoria(derrame) <= presupuesto);
+    print_test("Prueba derrame baja particiones a disco", ok && derrame_particiones_en_disco(derrame) > 0);
+
+    /* Escrituras sobre particiones en disco: reemplazo y borrado */
+    print_test("Prueba derrame reemplazar", ok && derrame_guardar(derrame, "clave_7", "otro", 4));
+    print_test("Prueba derrame borrar", ok && derrame_borrar(derrame, "clave_8"));
+    size_t largo = 0;
+    const char* valor = ok ? derrame_obtener(derrame, "clave_7", &largo) : NULL;
+    print_test("Prueba derrame obtener reemplazado", valor && largo == 4 && memcmp(valor, "otro", 4) == 0);
+    print_test("Prueba derrame obtener borrado", ok && !derrame_obtener(derrame, "clave_8", &largo));
+    print_test("Prueba derrame guardar de nuevo", ok && derrame_guardar(derrame, "clave_7", "clave_7", 7));
+
+    derrame_visto_t visto = { 0, 0, true };
+    claves[8] = "no esta";
+    print_test("Prueba derrame obtener lote", ok && derrame_obtener_lote(derrame, claves, cantidad, revisar_derrame, &visto));
+    print_test("Prueba derrame obtener lote encuentra todas", visto.encontradas == cantidad - 1 && visto.ausentes == 1 && visto.valores_ok);
+    print_test("Prueba derrame sigue en el presupuesto", ok && derrame_memoria(derrame) <= presupuesto);
+    claves[8] = textos + 8 * 16;
+
+    /* Lecturas sueltas al azar: van por el indice sin cargar ni derramar */
+    size_t memoria = ok ? derrame_memoria(derrame) : 0;
+    bool sueltas_ok = ok;
+    for (size_t i = 0; i < 500 && sueltas_ok; i++) {
+        size_t k = (i * 7919) % cantidad;
+        valor = k == 8 ? NULL : derrame_obtener(derrame, claves[k], &largo);
+        sueltas_ok = k == 8 || (valor && largo == strlen(claves[k]) && memcmp(valor, claves[k], largo) == 0);
+    }
+    print_test("Prueba derrame lecturas sueltas", sueltas_ok);
+    print_test("Prueba derrame lecturas sueltas no cargan particiones", ok && derrame_memoria(derrame) == memoria);
+
+    /* Reemplazos repetidos: los archivos se compactan y los valores siguen */
+    char reemplazo[32];
+    bool reemplazos_ok = ok;
+    for (size_t vuelta = 0; vuelta < 4 && reemplazos_ok; vuelta++) {
+        for (size_t i = 0; i < cantidad && reemplazos_ok; i++) {
+            int n = sprintf(reemplazo, "%zu_%s", vuelta, claves[i]);
+            reemplazos_ok = derrame_guardar(derrame, claves[i], reemplazo, (size_t)n);
+        }
+    }
+    print_test("Prueba derrame reemplazos repetidos", reemplazos_ok);
+    for (size_t i = 0; i < cantidad && reemplazos_ok; i += 97) {
+        int n = sprintf(reemplazo, "3_%s", claves[i]);
+        valor = derrame_obtener(derrame, claves[i], &largo);
+        reemplazos_ok = valor && largo == (size_t)n && memcmp(valor, reemplazo, largo) == 0;
+    }
+    print_test("Prueba derrame obtener tras compactar", reemplazos_ok);
+
+    /* Borra las pares y devuelve las impares a su valor original */
+    for (size_t i = 0; i < cantidad && reemplazos_ok; i++)
+        reemplazos_ok = i % 2 ? derrame_guardar(derrame, claves[i], claves[i], largos[i]) : derrame_borrar(derrame, claves[i]);
+    derrame_visto_t compactado = { 0, 0, true };
+    print_test("Prueba derrame obtener lote tras compactar", reemplazos_ok && derrame_obtener_lote(derrame, claves, cantidad, revisar_derrame, &compactado));
+    print_test("Prueba derrame lote sin las borradas", compactado.encontradas == cantidad / 2 && compactado.ausentes == cantidad / 2 && compactado.valores_ok);
+    print_test("Prueba derrame presupuesto tras compactar", ok && derrame_memoria(derrame) <= presupuesto);
+
+    if (derrame)
+        derrame_destruir(derrame);
+    free(claves);
+    free(valores);
+    free(largos);
+    free(textos);
+}
+
+static void prueba_compartido()
+{
+    char nombre[64];
+    char clave[24];
+    size_t cantidad = 10000;
+    snprintf(nombre, sizeof(nombre), "/hash_pruebas_%ld", (long)getpid());
+    compartido_t* escritor = compartido_crear(nombre, cantidad, cantidad * 64);
+    print_test("Prueba compartido crear", escritor);
+    print_test("Prueba compartido crear dos veces falla", !compartido_crear(nombre, 1, 64));
+    bool ok = escritor != NULL;
+
+    for (size_t i = 0; i < cantidad && ok; i++) {
+        sprintf(clave, "clave_%zu", i);
+        ok = compartido_guardar(escritor, clave, &i, sizeof(i));
+    }
+    print_test("Prueba compartido guardar muchos", ok && compartido_cantidad(escritor) == cantidad);
+    print_test("Prueba compartido lleno", ok && !compartido_guardar(escritor, "una mas", "x", 1));
+    print_test("Prueba compartido reemplazar", ok && compartido_guardar(escritor, "clave_1", "uno", 3));
+    print_test("Prueba compartido borrar", ok && compartido_borrar(escritor, "clave_2") && !compartido_borrar(escritor, "clave_2"));
+
+    /* Otro proceso se adjunta por nombre y ve lo mismo */
+    pid_t hijo = ok ? fork() : -1;
+    if (hijo == 0) {
+        compartido_t* lector = compartido_abrir(nombre);
+        size_t largo = 0;
+        bool visto = lector && compartido_cantidad(lector) == cantidad - 1 && !compartido_guardar(lector, "x", "x", 1);
+        const char* uno = lector ? compartido_obtener(lector, "clave_1", &largo) : NULL;
+        visto = visto && uno && largo == 3 && memcmp(uno, "uno", 3) == 0;
+        visto = visto && lector && !compartido_obtener(lector, "clave_2", &largo);
+        for (size_t i = 3; i < cantidad && visto; i++) {
+            sprintf(clave, "clave_%zu", i);
+            const size_t* valor = compartido_obtener(lector, clave, &largo);
+            visto = valor && largo == sizeof(size_t) && *valor == i;
+        }
+        _exit(visto ? 0 : 1);
+    }
+    int estado = 1;
+    if (hijo > 0)
+        waitpid(hijo, &estado, 0);
+    print_test("Prueba compartido otro proceso lee", hijo > 0 && WIFEXITED(estado) && WEXITSTATUS(estado) == 0);
+
+    print_test("Prueba compartido eliminar", compartido_eliminar(nombre));
+    print_test("Prueba compartido abrir eliminado falla", !compartido_abrir(nombre));
+    if (escritor)
+        compartido_cerrar(escritor);
+}
+
+static bool sumar_datos(void* dato, void* extra)
+{
+    *(size_t*) extra += *(size_t*) dato;
+    return true;
+}
+
+static void prueba_lista_arreglo()
+{
+    size_t cantidad = 1000;
+    size_t* valores = malloc(cantidad * sizeof(size_t));
+    lista_t* lista = lista_arreglo_crear();
+    bool ok = lista && valores;
+    print_test("Prueba lista arreglo crear vacia", ok && lista_esta_vacia(lista) && !lista_borrar_primero(lista) && !lista_ver_ultimo(lista));
+
+    /* Alterna los dos extremos para que los datos den la vuelta al crecer */
+    for (size_t i = 0; i < cantidad && ok; i++) {
+        valores[i] = i;
+        ok = i % 2 ? lista_insertar_ultimo(lista, &valores[i]) : lista_insertar_primero(lista, &valores[i]);
+    }
+    print_test("Prueba lista arreglo insertar en ambos extremos", ok && lista_largo(lista) == cantidad);
+    print_test("Prueba lista arreglo ver extremos", ok && lista_ver_primero(lista) == &valores[cantidad - 2] && lista_ver_ultimo(lista) == &valores[cantidad - 1]);
+
+    size_t suma = 0;
+    lista_iterar(lista, sumar_datos, &suma);
+    print_test("Prueba lista arreglo iterar", suma == cantidad * (cantidad - 1) / 2);
+
+    /* Pares de mayor a menor y despues impares de menor a mayor */
+    lista_iter_t* iter = lista_iter_crear(lista);
+    for (size_t i = 0; i < cantidad && ok; i++) {
+        size_t esperado = i < cantidad / 2 ? cantidad - 2 - 2 * i : 2 * (i - cantidad / 2) + 1;
+        ok = lista_iter_ver_actual(iter) == &valores[esperado] && lista_iter_avanzar(iter);
+    }
+    print_test("Prueba lista arreglo iterador recorre en orden", ok && lista_iter_al_final(iter) && !lista_iter_avanzar(iter));
+    lista_iter_destruir(iter);
+
+    /* Inserta y borra en el medio, al principio y al final */
+    char medio[] = "medio", primero[] = "primero", ultimo[] = "ultimo";
+    iter = lista_iter_crear(lista);
+    for (size_t i = 0; i < 10; i++)
+        lista_iter_avanzar(iter);
+    ok = lista_iter_insertar(iter, medio) && lista_iter_ver_actual(iter) == medio;
+    ok = ok && lista_iter_borrar(iter) == medio && lista_iter_ver_actual(iter) == &valores[cantidad - 22];
+    lista_iter_destruir(iter);
+    iter = lista_iter_crear(lista);
+    ok = ok && lista_iter_insertar(iter, primero) && lista_ver_primero(lista) == primero;
+    ok = ok && lista_iter_borrar(iter) == primero && lista_iter_ver_actual(iter) == &valores[cantidad - 2];
+    while (!lista_iter_al_final(iter))
+        lista_iter_avanzar(iter);
+    ok = ok && lista_iter_insertar(iter, ultimo) && lista_ver_ultimo(lista) == ultimo;
+    ok = ok && lista_iter_borrar(iter) == ultimo && lista_iter_al_final(iter);
+    lista_iter_destruir(iter);
+    print_test("Prueba lista arreglo iterador inserta y borra", ok && lista_largo(lista) == cantidad);
+
+    for (size_t i = 0; i < cantidad && ok; i++)
+        ok = lista_borrar_primero(lista) != NULL;
+    print_test("Prueba lista arreglo borrar todos", ok && lista_esta_vacia(lista) && !lista_ver_primero(lista));
+    lista_destruir(lista, NULL);
+
+    lista = lista_arreglo_crear();
+    for (size_t i = 0; i < 100 && lista; i++)
+        lista_insertar_ultimo(lista, malloc(8));
+    if (lista)
+        lista_destruir(lista, free);
+    print_test("Prueba lista arreglo destruir con datos", lista);
+    free(valores);
+}
+
+typedef struct productor {
+    lista_t* cola;
+    size_t* valores;
+    size_t cantidad;
+} productor_t;
+
+static void* producir(void* extra)
+{
+    productor_t* productor = extra;
+    for (size_t i = 0; i < productor->cantidad; i++) {
+        while (!lista_insertar_ultimo(productor->cola, &productor->valores[i]))
+            sched_yield();
+    }
+    return NULL;
+}
+
+static void prueba_lista_cola()
+{
+    lista_t* cola = lista_cola_crear(3);
+    char a[] = "a", b[] = "b", c[] = "c", d[] = "d", e[] = "e";
+    print_test("Prueba lista cola capacidad 0 es NULL", !lista_cola_crear(0));
+    bool ok = cola && lista_insertar_ultimo(cola, a) && lista_insertar_ultimo(cola, b) && lista_insertar_ultimo(cola, c) && lista_insertar_ultimo(cola, d);
+    print_test("Prueba lista cola llena devuelve false", ok && !lista_insertar_ultimo(cola, e) && lista_largo(cola) == 4);
+    print_test("Prueba lista cola no inserta primero", ok && !lista_insertar_primero(cola, e));
+    ok = ok && lista_ver_primero(cola) == a && lista_borrar_primero(cola) == a && lista_insertar_ultimo(cola, e);
+    print_test("Prueba lista cola da la vuelta", ok && lista_ver_ultimo(cola) == e);
+    ok = ok && lista_borrar_primero(cola) == b && lista_borrar_primero(cola) == c && lista_borrar_primero(cola) == d && lista_borrar_primero(cola) == e;
+    print_test("Prueba lista cola vaciar en orden", ok && lista_esta_vacia(cola) && !lista_borrar_primero(cola));
+    if (cola)
+        lista_destruir(cola, NULL);
+
+    /* El iterador no mueve el frente ni el fondo de una cola */
+    cola = lista_cola_crear(4);
+    ok = cola && lista_insertar_ultimo(cola, a) && lista_insertar_ultimo(cola, b) && lista_insertar_ultimo(cola, c);
+    ok = ok && lista_borrar_primero(cola) == a;
+    lista_iter_t* iter = ok ? lista_iter_crear(cola) : NULL;
+    if (iter) {
+        lista_iter_avanzar(iter);
+        ok = !lista_iter_borrar(iter) && !lista_iter_insertar(iter, d);
+        lista_iter_destruir(iter);
+    }
+    print_test("Prueba lista cola el iterador no inserta ni borra", iter && ok);
+    ok = ok && lista_borrar_primero(cola) == b && lista_borrar_primero(cola) == c;
+    print_test("Prueba lista cola sigue consistente", ok && !lista_borrar_primero(cola) && lista_largo(cola) == 0);
+    if (cola)
+        lista_destruir(cola, NULL);
+
+    /* Un hilo produce y este consume: llegan todos, en orden */
+    size_t cantidad = 200000;
+    productor_t productor = { lista_cola_crear(64), malloc(cantidad * sizeof(size_t)), cantidad };
+    ok = productor.cola && productor.valores;
+    for (size_t i = 0; i < cantidad && ok; i++)
+        productor.valores[i] = i;
+    pthread_t hilo;
+    bool lanzado = ok && pthread_create(&hilo, NULL, producir, &productor) == 0;
+    for (size_t i = 0; i < cantidad && lanzado; i++) {
+        size_t* valor;
+        while (!(valor = lista_borrar_primero(productor.cola)))
+            sched_yield();
+        ok = ok && *valor == i;
+    }
+    if (lanzado)
+        pthread_join(hilo, NULL);
+    print_test("Prueba lista cola entre hilos", lanzado && ok && lista_esta_vacia(productor.cola));
+    if (productor.cola)
+        lista_destruir(productor.cola, NULL);
+    free(productor.valores);
+}
+
+static void prueba_hash_congelar()
+{
+    size_t cantidad = 50000;
+    size_t* valores = malloc(cantidad * sizeof(size_t));
+    hash_t* hash = hash_crear(NULL);
+    char clave[24];
+    bool ok = valores != NULL;
+
+    for (size_t i = 0; i < cantidad && ok; i++) {
+        sprintf(clave, "clave_%zu", i);
+        valores[i] = i;
+        ok = hash_guardar(hash, clave, &valores[i]);
+    }
+    /* Deja huecos en las entradas: se congelan solo las presentes */
+    for (size_t i = 0; i < cantidad && ok; i += 10) {
+        sprintf(clave, "clave_%zu", i);
+        ok = hash_borrar(hash, clave) == &valores[i];
+    }
+    size_t memoria = hash_memoria(hash);
+    print_test("Prueba hash congelar", ok && hash_congelar(hash) && hash_congelado(hash));
+    print_test("Prueba hash congelar conserva la cantidad", hash_cantidad(hash) == cantidad - cantidad / 10);
+    print_test("Prueba hash congelar usa menos memoria", hash_memoria(hash) < memoria / 2);
+    print_test("Prueba hash congelar otra vez", hash_congelar(hash));
+
+    for (size_t i = 0; i < cantidad && ok; i++) {
+        sprintf(clave, "clave_%zu", i);
+        if (i % 10 == 0)
+            ok = !hash_pertenece(hash, clave) && !hash_obtener(hash, clave);
+        else
+            ok = hash_pertenece(hash, clave) && hash_obtener(hash, clave) == &valores[i];
+    }
+    print_test("Prueba hash congelado obtiene todas las claves", ok);
+    print_test("Prueba hash congelado no encuentra claves ausentes",
+               !hash_obtener(hash, "clave_") && !hash_pertenece(hash, "otra") && !hash_obtener(hash, ""));
+
+    print_test("Prueba hash congelado no guarda", !hash_guardar(hash, "clave_1", NULL) && !hash_guardar(hash, "nueva", NULL));
+    print_test("Prueba hash congelado no borra", !hash_borrar(hash, "clave_1") && hash_pertenece(hash, "clave_1"));
+    print_test("Prueba hash congelado no activa el filtro", !hash_filtro_activar(hash, 10));
+
+    hash_estadisticas_t estadisticas;
+    hash_estadisticas(hash, &estadisticas);
+    print_test("Prueba hash congelado sondea una sola posicion", estadisticas.cadena_maxima == 1);
+
+    hash_iter_t* iter = hash_iter_crear(hash);
+    size_t recorridos = 0;
+    while (ok && !hash_iter_al_final(iter)) {
+        ok = hash_pertenece(hash, hash_iter_ver_actual(iter));
+        recorridos++;
+        hash_iter_avanzar(iter);
+    }
+    hash_iter_destruir(iter);
+    print_test("Prueba hash congelado iterar", ok && recorridos == hash_cantidad(hash));
+
+    /* Los datos no se destruyen al congelar, si al destruir */
+    hash_t* chico = hash_crear(free);
+    ok = hash_guardar(chico, "uno", malloc(1)) && hash_guardar(chico, "dos", malloc(1)) && hash_congelar(chico);
+    print_test("Prueba hash congelar tabla chica", ok && hash_cantidad(chico) == 2 && hash_pertenece(chico, "dos"));
+    hash_destruir(chico);
+
+    hash_t* vacio = hash_crear(NULL);
+    print_test("Prueba hash congelar tabla vacia", hash_congelar(vacio) && !hash_pertenece(vacio, "A"));
+    hash_iter_t* iter_vacio = hash_iter_crear(vacio);
+    print_test("Prueba hash congelado vacio iter al final", hash_iter_al_final(iter_vacio));
+    hash_iter_destruir(iter_vacio);
+    hash_destruir(vacio);
+
+    hash_t* cache = hash_cache_crear(10, 0, HASH_POLITICA_LRU, NULL);
+    print_test("Prueba hash congelar cache falla", !hash_congelar(cache) && hash_guardar(cache, "A", NULL));
+    hash_destruir(cache);
+
+    hash_destruir(hash);
+    free(valores);
+}
+
+static void prueba_hash_orden_insercion()
+{
+    hash_t* hash = hash_crear(NULL);
+    char clave[16];
+    bool ok = true;
+
+    /* Inserta, borra los pares y reinserta algunos para forzar compactaciones */
+    for (size_t i = 0; i < 1000 && ok; i++) {
+        sprintf(clave, "%zu", i);
+        ok = hash_guardar(hash, clave, NULL);
+    }
+    for (size_t i = 0; i < 1000 && ok; i += 2) {
+        sprintf(clave, "%zu", i);
+        ok = !hash_borrar(hash, clave) && !hash_pertenece(hash, clave);
+    }
+    ok = ok && hash_guardar(hash, "1", "reemplazo") && hash_guardar(hash, "0", NULL);
+    print_test("Prueba hash orden insertar y borrar", ok && hash_cantidad(hash) == 501);
+
+    hash_iter_t* iter = hash_iter_crear(hash);
+    size_t esperado = 1;
+    size_t recorridos = 0;
+    while (ok && !hash_iter_al_final(iter)) {
+        sprintf(clave, "%zu", esperado);
+        ok = strcmp(hash_iter_ver_actual(iter), clave) == 0;
+        esperado = esperado == 999 ? 0 : esperado + 2;
+        recorridos++;
+        hash_iter_avanzar(iter);
+    }
+    print_test("Prueba hash iterar respeta el orden de insercion", ok && recorridos == 501);
+    print_test("Prueba hash el reemplazo conserva el dato nuevo", strcmp(hash_obtener(hash, "1"), "reemplazo") == 0);
+    hash_iter_destruir(iter);
+    hash_destruir(hash);
+}
+
+static bool sumar_largos(const char* clave, void* dato, void* extra)
+{
+    (void) clave;
+    *(size_t*) extra += strlen(dato);
+    return true;
+}
+
+static void prueba_hamt_instantanea()
+{
+    hamt_t* hamt = hamt_crear(free);
+    char clave[16];
+    bool ok = true;
+    for (size_t i = 0; i < 1000 && ok; i++) {
+        sprintf(clave, "clave%zu", i);
+        ok = hamt_guardar(hamt, clave, duplicar("v1"));
+    }
+    print_test("Prueba hamt guardar muchos elementos", ok && hamt_cantidad(hamt) == 1000);
+
+    hamt_t* instantanea = hamt_instantanea(hamt);
+    print_test("Prueba hamt instantanea tiene la misma cantidad", hamt_cantidad(instantanea) == 1000);
+
+    print_test("Prueba hamt reemplazar despues de la instantanea", hamt_guardar(hamt, "clave0", duplicar("v22")));
+    print_test("Prueba hamt borrar despues de la instantanea", hamt_borrar(hamt, "clave1"));
+    print_test("Prueba hamt guardar despues de la instantanea", hamt_guardar(hamt, "nueva", duplicar("v3")));
+    print_test("Prueba hamt borrar clave inexistente es false", !hamt_borrar(hamt, "no esta"));
+
+    print_test("Prueba hamt el original ve el dato nuevo", strcmp(hamt_obtener(hamt, "clave0"), "v22") == 0);
+    print_test("Prueba hamt la instantanea conserva el dato viejo", strcmp(hamt_obtener(instantanea, "clave0"), "v1") == 0);
+    print_test("Prueba hamt la instantanea conserva la clave borrada", hamt_pertenece(instantanea, "clave1"));
+    print_test("Prueba hamt el original no tiene la clave borrada", !hamt_pertenece(hamt, "clave1"));
+    print_test("Prueba hamt la instantanea no ve la clave nueva", !hamt_pertenece(instantanea, "nueva"));
+    print_test("Prueba hamt las cantidades son independientes",
+               hamt_cantidad(hamt) == 1000 && hamt_cantidad(instantanea) == 1000);
+
+    size_t largos = 0;
+    hamt_iterar(instantanea, sumar_largos, &largos);
+    print_test("Prueba hamt iterar la instantanea", largos == 2000);
+
+    /* Destruir el original no afecta a la instantanea */
+    hamt_destruir(hamt);
+    print_test("Prueba hamt la instantanea sobrevive al original", strcmp(hamt_obtener(instantanea, "clave999"), "v1") == 0);
+    hamt_destruir(instantanea);
+}
+
 static void prueba_hash_volumen(size_t largo, bool debug)
 {
     hash_t* hash = hash_crear(NULL);
@@ -329,6 +1847,64 @@ static void prueba_hash_iterar()
     hash_destruir(hash);
 }
 
+static void prueba_hash_iterar_fijado()
+{
+    size_t cantidad = 1000;
+    hash_t* hash = hash_crear(free);
+    char clave[32];
+    bool ok = hash != NULL;
+
+    for (size_t i = 0; i < cantidad && ok; i++) {
+        sprintf(clave, "clave_fijada_%06zu", i);
+        ok = hash_guardar(hash, clave, malloc(8));
+    }
+    hash_iter_t* iter = hash_iter_fijar(hash);
+    hash_iter_t* nuevo = NULL;
+    print_test("Prueba hash iterador fijado crear", ok && iter);
+    print_test("Prueba hash iterador fijado impide congelar", !hash_congelar(hash));
+
+    /* Borra la actual y la siguiente, y agrega tantas que la tabla crece */
+    size_t vistas = 0, agregadas = 0;
+    while (ok && !hash_iter_al_final(iter)) {
+        const char* actual = hash_iter_ver_actual(iter);
+        sprintf(clave, "clave_fijada_%06zu", vistas * 2);
+        ok = strcmp(actual, clave) == 0;
+        free(hash_borrar(hash, clave));
+        ok = ok && strcmp(actual, clave) == 0 && !hash_pertenece(hash, clave);
+        sprintf(clave, "clave_fijada_%06zu", vistas * 2 + 1);
+        free(hash_borrar(hash, clave));
+        for (size_t j = 0; j < 8 && ok; j++) {
+            sprintf(clave, "agregada_%06zu", agregadas++);
+            ok = hash_guardar(hash, clave, malloc(8));
+        }
+        if (++vistas == cantidad / 4)
+            nuevo = hash_iter_fijar(hash);
+        hash_iter_avanzar(iter);
+    }
+    print_test("Prueba hash iterador fijado ve las claves previas no borradas", ok && vistas == cantidad / 2);
+    print_test("Prueba hash iterador fijado no ve las agregadas", ok && hash_cantidad(hash) == agregadas);
+
+    for (size_t i = 0; i < agregadas && ok; i++) {
+        sprintf(clave, "agregada_%06zu", i);
+        ok = hash_pertenece(hash, clave);
+    }
+    print_test("Prueba hash iterador fijado la tabla sigue completa", ok);
+
+    /* El segundo iterador empezo a la mitad: ve desde la primera agregada */
+    sprintf(clave, "clave_fijada_%06zu", cantidad / 2);
+    ok = nuevo && hash_iter_ver_actual(nuevo) && strcmp(hash_iter_ver_actual(nuevo), clave) == 0;
+    size_t memoria = hash_memoria(hash);
+    hash_iter_destruir(iter);
+    size_t sin_viejo = hash_memoria(hash);
+    print_test("Prueba hash iterador fijado el nodo actual sigue valido", ok);
+    print_test("Prueba hash iterador fijado libera lo que solo veia el viejo", sin_viejo < memoria);
+    if (nuevo)
+        hash_iter_destruir(nuevo);
+    print_test("Prueba hash iterador fijado libera el resto al final", hash_memoria(hash) < sin_viejo);
+    print_test("Prueba hash iterador fijado despues se puede congelar", hash_congelar(hash));
+    hash_destruir(hash);
+}
+
 static void prueba_hash_iterar_volumen(size_t largo)
 {
     hash_t* hash = hash_crear(NULL);
@@ -408,8 +1984,34 @@ void pruebas_hash_catedra()
     prueba_hash_borrar();
     prueba_hash_clave_vacia();
     prueba_hash_valor_null();
+    prueba_hash_cache();
+    prueba_hash_ttl();
+    prueba_hash_filtro();
+    prueba_hash_persistente();
+    prueba_hash_guardar_lote();
+    prueba_hash_orden_insercion();
+    prueba_hash_destruir_diferido();
+    prueba_hash_allocador();
+    prueba_hash_fusionar();
+    prueba_hash_traza();
+    prueba_hash_congelar();
+    prueba_hash_claves_colisionan();
+    prueba_hash_cuckoo();
+    prueba_hash_obtener_o_insertar();
+    prueba_hash_paginas_grandes();
+    prueba_hash_cambios();
+    prueba_hash_obtener_o_insertar_lote();
+    prueba_agregacion();
+    prueba_derrame();
+    prueba_compartido();
+    prueba_hash_colisiones_cambian_funcion();
+    prueba_hash_redimension_paralela();
+    prueba_lista_arreglo();
+    prueba_lista_cola();
+    prueba_hamt_instantanea();
     prueba_hash_volumen(5000, true);
     prueba_hash_iterar();
+    prueba_hash_iterar_fijado();
     prueba_hash_iterar_volumen(5000);
 }
 
@@ -1,6 +1,11 @@
 #include "lista.h"
-#include <stdlib.h>
+#include <string.h>
+#include "allocador.h"
 
+// Definicion de constantes
+
+#define ARREGLO_CAPACIDAD_INICIAL 16 // siempre una potencia de 2
+#define LINEA_CACHE 64
 
 // Defincion de la estructura nodo_t
 
@@ -9,12 +14,39 @@ typedef struct nodo {
     void* dato;
 }nodo_t;
 
-// Definicion de la estructura lista
+// Definicion de la estructura cola_t: los extremos del modo concurrente,
+// pedidos aparte para que el relleno no agrande las demas listas. frente
+// solo lo escribe el consumidor y fondo solo el productor; cada uno esta en
+// su propia linea de cache, junto a la copia que su hilo tiene del otro.
+
+typedef struct cola {
+    char relleno_frente[LINEA_CACHE];
+    size_t frente;
+    size_t fondo_visto; // del consumidor
+    char relleno_fondo[LINEA_CACHE];
+    size_t fondo;
+    size_t frente_visto; // del productor
+    char relleno_final[LINEA_CACHE];
+} cola_t;
+
+// Definicion de la estructura lista. En los modos de arreglo, los datos
+// estan en un buffer circular de capacidad potencia de 2: frente y fondo
+// cuentan sin volver a cero y el elemento i esta en
+// datos[(frente + i) & (capacidad - 1)]. En el modo concurrente, frente y
+// fondo son los de la cola.
 
 struct lista {
     nodo_t* primero;
     nodo_t* ultimo;
     size_t largo;
+    allocador_t allocador;
+    bool arreglo;
+    bool concurrente; // un productor y un consumidor, capacidad fija
+    void** datos;
+    size_t capacidad;
+    size_t frente;
+    size_t fondo;
+    cola_t* cola; // solo en el modo concurrente
 };
 
 // Definicion de la estructura lista_iter
@@ -23,13 +55,14 @@ struct lista_iter {
     lista_t* lista;
     nodo_t* act;
     nodo_t* ant;
+    size_t pos; // contador del elemento actual, en los modos de arreglo
 };
 
 
 // Funciones auxiliares
 
-nodo_t* nodo_crear(void* dato) {
-    nodo_t* nodo = malloc(sizeof(nodo_t));
+nodo_t* nodo_crear(const lista_t* lista, void* dato) {
+    nodo_t* nodo = allocador_pedir(&lista->allocador, sizeof(nodo_t));
     if ( !nodo )
         return NULL;
 
@@ -38,25 +71,186 @@ nodo_t* nodo_crear(void* dato) {
     return nodo;
 }
 
-// Primitivas de la lista enlazada
+// Funciones auxiliares del arreglo circular
 
-lista_t* lista_crear(void) {
-    lista_t* lista = malloc(sizeof(lista_t));
+void** arreglo_celda(const lista_t* lista, size_t i) {
+    return &lista->datos[i & (lista->capacidad - 1)];
+}
+
+// En el modo concurrente se leen los de la cola, desde cualquier hilo
+size_t arreglo_frente(const lista_t* lista) {
+    return lista->cola ? __atomic_load_n(&lista->cola->frente, __ATOMIC_ACQUIRE) : lista->frente;
+}
+
+size_t arreglo_fondo(const lista_t* lista) {
+    return lista->cola ? __atomic_load_n(&lista->cola->fondo, __ATOMIC_ACQUIRE) : lista->fondo;
+}
+
+// El frente se lee antes que el fondo: desde cualquier hilo, el largo
+// nunca da negativo ni supera la capacidad
+size_t arreglo_largo(const lista_t* lista) {
+    size_t frente = arreglo_frente(lista);
+    return arreglo_fondo(lista) - frente;
+}
+
+// Duplica la capacidad con un realloc. Si los elementos daban la vuelta,
+// los del principio del buffer se copian a continuacion del final viejo, y
+// los contadores se renumeran para que sigan valiendo con la mascara nueva.
+bool arreglo_agrandar(lista_t* lista) {
+    size_t capacidad = lista->capacidad;
+    void** datos = allocador_redimensionar(&lista->allocador, lista->datos, 2 * capacidad * sizeof(void*));
+    if ( !datos )
+        return false;
+    size_t largo = lista->fondo - lista->frente;
+    size_t inicio = lista->frente & (capacidad - 1);
+    if ( inicio + largo > capacidad )
+        memcpy(datos + capacidad, datos, (inicio + largo - capacidad) * sizeof(void*));
+    lista->datos = datos;
+    lista->capacidad = 2 * capacidad;
+    lista->frente = inicio;
+    lista->fondo = inicio + largo;
+    return true;
+}
+
+bool arreglo_lleno(const lista_t* lista) {
+    return lista->fondo - lista->frente == lista->capacidad;
+}
+
+// Productor del modo concurrente: el dato se publica con el fondo. El
+// frente del consumidor solo se relee cuando la copia dice que esta llena.
+bool cola_encolar(lista_t* lista, void* dato) {
+    cola_t* cola = lista->cola;
+    size_t fondo = cola->fondo;
+    if ( fondo - cola->frente_visto == lista->capacidad ) {
+        cola->frente_visto = __atomic_load_n(&cola->frente, __ATOMIC_ACQUIRE);
+        if ( fondo - cola->frente_visto == lista->capacidad )
+            return false;
+    }
+    *arreglo_celda(lista, fondo) = dato;
+    __atomic_store_n(&cola->fondo, fondo + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Consumidor del modo concurrente: la celda se devuelve al productor con el
+// frente, despues de leerla
+void* cola_desencolar(lista_t* lista) {
+    cola_t* cola = lista->cola;
+    size_t frente = cola->frente;
+    if ( frente == cola->fondo_visto ) {
+        cola->fondo_visto = __atomic_load_n(&cola->fondo, __ATOMIC_ACQUIRE);
+        if ( frente == cola->fondo_visto )
+            return NULL;
+    }
+    void* dato = *arreglo_celda(lista, frente);
+    __atomic_store_n(&cola->frente, frente + 1, __ATOMIC_RELEASE);
+    return dato;
+}
+
+// Abre lugar en la posicion del iterador moviendo los elementos siguientes;
+// al principio alcanza con retroceder el frente
+bool arreglo_iter_insertar(lista_iter_t* iter, void* dato) {
+    lista_t* lista = iter->lista;
+    size_t indice = iter->pos - lista->frente;
+    if ( arreglo_lleno(lista) && !arreglo_agrandar(lista) )
+        return false;
+    if ( !indice ) {
+        iter->pos = --lista->frente;
+    } else {
+        iter->pos = lista->frente + indice;
+        for (size_t i = lista->fondo; i != iter->pos; i--)
+            *arreglo_celda(lista, i) = *arreglo_celda(lista, i - 1);
+        lista->fondo++;
+    }
+    *arreglo_celda(lista, iter->pos) = dato;
+    return true;
+}
+
+void* arreglo_iter_borrar(lista_iter_t* iter) {
+    lista_t* lista = iter->lista;
+    void* dato = *arreglo_celda(lista, iter->pos);
+    if ( iter->pos == lista->frente ) {
+        iter->pos = ++lista->frente;
+        return dato;
+    }
+    for (size_t i = iter->pos; i + 1 != lista->fondo; i++)
+        *arreglo_celda(lista, i) = *arreglo_celda(lista, i + 1);
+    lista->fondo--;
+    return dato;
+}
+
+// Crea una lista vacia; en los modos de arreglo, con su buffer, y en el
+// concurrente con su cola
+lista_t* lista_armar(const allocador_t* allocador, bool arreglo, bool concurrente, size_t capacidad) {
+    lista_t* lista = allocador_pedir(allocador, sizeof(lista_t));
     if ( !lista )
         return NULL;
 
     lista->primero = NULL;
     lista->ultimo = NULL;
     lista->largo = 0;
+    lista->allocador = *allocador;
+    lista->arreglo = arreglo;
+    lista->concurrente = concurrente;
+    lista->datos = NULL;
+    lista->capacidad = capacidad;
+    lista->frente = 0;
+    lista->fondo = 0;
+    lista->cola = NULL;
+    if ( arreglo )
+        lista->datos = allocador_pedir(allocador, capacidad * sizeof(void*));
+    if ( concurrente && lista->datos )
+        lista->cola = allocador_pedir(allocador, sizeof(cola_t));
+    if ( (arreglo && !lista->datos) || (concurrente && !lista->cola) ) {
+        if ( lista->datos )
+            allocador_liberar(allocador, lista->datos);
+        allocador_liberar(allocador, lista);
+        return NULL;
+    }
+    if ( lista->cola )
+        memset(lista->cola, 0, sizeof(cola_t));
     return lista;
 }
 
+// Primitivas de la lista enlazada
+
+lista_t* lista_crear(void) {
+    allocador_t estandar = { NULL, NULL, NULL, NULL };
+    return lista_crear_con_allocador(&estandar);
+}
+
+lista_t* lista_crear_con_allocador(const allocador_t* allocador) {
+    return lista_armar(allocador, false, false, 0);
+}
+
+lista_t* lista_arreglo_crear(void) {
+    allocador_t estandar = { NULL, NULL, NULL, NULL };
+    return lista_armar(&estandar, true, false, ARREGLO_CAPACIDAD_INICIAL);
+}
+
+lista_t* lista_cola_crear(size_t capacidad) {
+    if ( !capacidad )
+        return NULL;
+    size_t potencia = 1;
+    while ( potencia < capacidad )
+        potencia *= 2;
+    allocador_t estandar = { NULL, NULL, NULL, NULL };
+    return lista_armar(&estandar, true, true, potencia);
+}
+
 bool lista_esta_vacia(const lista_t* lista) {
+    if ( lista->arreglo )
+        return !arreglo_largo(lista);
     return !lista->largo;
 }
 
 bool lista_insertar_primero(lista_t* lista, void* dato) {
-    nodo_t* nodo = nodo_crear(dato);
+    if ( lista->arreglo ) {
+        if ( lista->concurrente || (arreglo_lleno(lista) && !arreglo_agrandar(lista)) )
+            return false;
+        *arreglo_celda(lista, --lista->frente) = dato;
+        return true;
+    }
+    nodo_t* nodo = nodo_crear(lista, dato);
     if ( !nodo )
         return false;
 
@@ -71,7 +265,15 @@ bool lista_insertar_primero(lista_t* lista, void* dato) {
 }
 
 bool lista_insertar_ultimo(lista_t* lista, void* dato) {
-    nodo_t* nodo = nodo_crear(dato);
+    if ( lista->concurrente )
+        return cola_encolar(lista, dato);
+    if ( lista->arreglo ) {
+        if ( arreglo_lleno(lista) && !arreglo_agrandar(lista) )
+            return false;
+        *arreglo_celda(lista, lista->fondo++) = dato;
+        return true;
+    }
+    nodo_t* nodo = nodo_crear(lista, dato);
     if ( !nodo )
         return false;
 
@@ -86,8 +288,12 @@ bool lista_insertar_ultimo(lista_t* lista, void* dato) {
 }
 
 void* lista_borrar_primero(lista_t* lista) {
+    if ( lista->concurrente )
+        return cola_desencolar(lista);
     if ( lista_esta_vacia(lista) )
         return NULL;
+    if ( lista->arreglo )
+        return *arreglo_celda(lista, lista->frente++);
 
     void* dato = lista->primero->dato;
     nodo_t* nodo = lista->primero;
@@ -96,7 +302,7 @@ void* lista_borrar_primero(lista_t* lista) {
     if ( lista_esta_vacia(lista) )
         lista->ultimo = NULL;
 
-    free(nodo);
+    allocador_liberar(&lista->allocador, nodo);
     lista->largo--;
     return dato;
 }
@@ -104,48 +310,70 @@ void* lista_borrar_primero(lista_t* lista) {
 void* lista_ver_primero(const lista_t* lista) {
     if ( lista_esta_vacia(lista) )
         return NULL;
+    if ( lista->arreglo )
+        return *arreglo_celda(lista, arreglo_frente(lista));
     return lista->primero->dato;
 }
 
 void* lista_ver_ultimo(const lista_t* lista) {
     if ( lista_esta_vacia(lista) )
         return NULL;
+    if ( lista->arreglo )
+        return *arreglo_celda(lista, arreglo_fondo(lista) - 1);
     return lista->ultimo->dato;
 }
 
 size_t lista_largo(const lista_t* lista) {
+    if ( lista->arreglo )
+        return arreglo_largo(lista);
     return lista->largo;
 }
 
 void lista_destruir(lista_t* lista, void destruir(void*)) {
+    if ( lista->arreglo ) {
+        for (size_t i = arreglo_frente(lista); destruir && i != arreglo_fondo(lista); i++)
+            destruir(*arreglo_celda(lista, i));
+        allocador_liberar(&lista->allocador, lista->datos);
+        if ( lista->cola )
+            allocador_liberar(&lista->allocador, lista->cola);
+        allocador_liberar(&lista->allocador, lista);
+        return;
+    }
     while ( !lista_esta_vacia(lista) ) {
         if ( destruir )
             destruir(lista_borrar_primero(lista));
         else
             lista_borrar_primero(lista);
     }
-    free(lista);
+    allocador_liberar(&lista->allocador, lista);
 }
 
 // Primitivas del iterador externo
 
 lista_iter_t* lista_iter_crear(lista_t* lista) {
-    lista_iter_t* iter = malloc(sizeof(lista_iter_t));
+    lista_iter_t* iter = allocador_pedir(&lista->allocador, sizeof(lista_iter_t));
     if ( !iter )
         return NULL;
     iter->lista = lista;
     iter->ant = NULL;
     iter->act = lista->primero;
+    iter->pos = arreglo_frente(lista);
     return iter;
 }
 
 bool lista_iter_al_final(const lista_iter_t* iter) {
+    if ( iter->lista->arreglo )
+        return iter->pos == arreglo_fondo(iter->lista);
     return !iter->act;
 }
 
 bool lista_iter_avanzar(lista_iter_t* iter) {
     if ( lista_iter_al_final(iter) )
         return false;
+    if ( iter->lista->arreglo ) {
+        iter->pos++;
+        return true;
+    }
     iter->ant = iter->act;
     iter->act = iter->act->prox;
     return true;
@@ -154,14 +382,21 @@ bool lista_iter_avanzar(lista_iter_t* iter) {
 void* lista_iter_ver_actual(const lista_iter_t* iter) {
     if ( lista_iter_al_final(iter) )
         return NULL;
+    if ( iter->lista->arreglo )
+        return *arreglo_celda(iter->lista, iter->pos);
     return iter->act->dato;
 }
 
 void lista_iter_destruir(lista_iter_t* iter) {
-    free(iter);
+    allocador_liberar(&iter->lista->allocador, iter);
 }
 
 bool lista_iter_insertar(lista_iter_t* iter, void* dato) {
+    // Moveria el frente o el fondo sin las copias que guarda cada hilo
+    if ( iter->lista->concurrente )
+        return false;
+    if ( iter->lista->arreglo )
+        return arreglo_iter_insertar(iter, dato);
     bool ok;
     if ( !iter->ant ) {
         ok = lista_insertar_primero(iter->lista, dato);
@@ -174,7 +409,7 @@ bool lista_iter_insertar(lista_iter_t* iter, void* dato) {
         iter->ant->prox = iter->act;
         return ok;
     }
-    nodo_t* nodo = nodo_crear(dato);
+    nodo_t* nodo = nodo_crear(iter->lista, dato);
     if ( !nodo )
         return false;
     nodo->prox = iter->act;
@@ -185,8 +420,10 @@ bool lista_iter_insertar(lista_iter_t* iter, void* dato) {
 }
 
 void* lista_iter_borrar(lista_iter_t* iter) {
-    if ( lista_iter_al_final(iter) )
+    if ( iter->lista->concurrente || lista_iter_al_final(iter) )
         return NULL;
+    if ( iter->lista->arreglo )
+        return arreglo_iter_borrar(iter);
     void* dato = iter->act->dato;
     nodo_t* nodo = iter->act;
     iter->act = iter->act->prox;
@@ -199,13 +436,20 @@ void* lista_iter_borrar(lista_iter_t* iter) {
     if ( lista_iter_al_final(iter) )
         iter->lista->ultimo = iter->ant;
     iter->lista->largo--;
-    free(nodo);
+    allocador_liberar(&iter->lista->allocador, nodo);
     return dato;
 }
 
 // Primitivas del iterador interno
 
 void lista_iterar(lista_t* lista, bool visitar(void* dato, void* extra), void* extra) {
+    if ( lista->arreglo ) {
+        for (size_t i = arreglo_frente(lista); i != arreglo_fondo(lista); i++) {
+            if ( !visitar(*arreglo_celda(lista, i), extra) )
+                break;
+        }
+        return;
+    }
     nodo_t* actual = lista->primero;
     while ( actual ) {
         if ( !visitar(actual->dato, extra) )
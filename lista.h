@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include "allocador.h"
 
 /* ******************************************************************
  *                DEFINICION DE LOS TIPOS DE DATOS
@@ -20,6 +21,31 @@ typedef struct lista_iter lista_iter_t;
 // Post: Devuelve una nueva lista enlazada vacia.
 lista_t* lista_crear(void);
 
+// Crea una lista enlazada que pide y libera su memoria (la lista, sus nodos
+// y sus iteradores) con el allocador recibido, que se copia.
+// Post: Devuelve una nueva lista enlazada vacia, o NULL si no hay memoria.
+lista_t* lista_crear_con_allocador(const allocador_t* allocador);
+
+// Crea una lista sobre un arreglo circular que se duplica al llenarse, con
+// las mismas primitivas: no pide memoria por elemento y agregar o quitar en
+// cualquiera de los dos extremos es O(1) amortizado. Insertar o borrar con
+// el iterador en el medio mueve los elementos siguientes.
+// Post: Devuelve una nueva lista vacia, o NULL si no hay memoria.
+lista_t* lista_arreglo_crear(void);
+
+// Crea una cola de capacidad fija (redondeada a una potencia de 2) para
+// pasar datos de un hilo productor a un hilo consumidor sin bloqueos. El
+// productor solo llama a lista_insertar_ultimo, que devuelve false si la
+// cola esta llena; el consumidor, a lista_borrar_primero y
+// lista_ver_primero, que devuelven NULL si esta vacia. lista_largo y
+// lista_esta_vacia se pueden llamar desde cualquier hilo. El resto de las
+// primitivas solo se usan cuando un unico hilo tiene la cola;
+// lista_insertar_primero y lista_iter_insertar siempre devuelven false y
+// lista_iter_borrar, NULL.
+// Post: Devuelve una nueva cola vacia, o NULL si no hay memoria o la
+// capacidad es 0.
+lista_t* lista_cola_crear(size_t capacidad);
+
 // Devuelve verdadero si la lista enlazada no tiene elementos (si el largo es igual a 0) false en caso contrario.
 // Pre: la lista enlazada fue creada.
 bool lista_esta_vacia(const lista_t* lista);
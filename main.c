@@ -1,6 +1,239 @@
+#define _POSIX_C_SOURCE 200809L
+#include "hash.h"
+#include "lista.h"
 #include "testing.h"
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* ******************************************************************
+ *                     CARGA MASIVA DE CLAVE\tVALOR
+ * *****************************************************************/
+
+#define LARGO_LOTE 4096
+#define TAMANIO_ARENA (1 << 20)
+#define TAMANIO_BLOQUE (8 << 20)
+
+// Lote de claves pendientes de guardar. Las claves se copian, terminadas en
+// '\0', a una arena que se reutiliza entre lotes: no se pide memoria por
+// linea. Con un archivo mapeado los datos apuntan al valor dentro del mapa;
+// al leer de a bloques el bloque se reutiliza, asi que los valores se
+// copian, terminados en '\0', a arenas que se conservan hasta el final.
+typedef struct carga {
+    hash_t* hash;
+    const char* claves[LARGO_LOTE];
+    void* datos[LARGO_LOTE];
+    size_t en_lote;
+    char* arena;
+    size_t arena_usada;
+    bool copiar_valores;
+    lista_t* arenas_valores;
+    char* arena_valores;
+    size_t valores_usados;
+    size_t tamanio_valores;
+    size_t registros;
+    size_t descartados;
+    size_t bytes;
+    bool ok;
+} carga_t;
+
+static void carga_vaciar_lote(carga_t* carga)
+{
+    size_t guardados = hash_guardar_lote(carga->hash, carga->claves, carga->datos, carga->en_lote);
+    if (guardados != carga->en_lote) carga->ok = false;
+    carga->registros += guardados;
+    carga->en_lote = 0;
+    carga->arena_usada = 0;
+}
+
+// Copia el valor a la arena de valores actual, o a una nueva si no entra
+static char* carga_copiar_valor(carga_t* carga, const char* valor, size_t largo)
+{
+    if (!carga->arena_valores || carga->valores_usados + largo + 1 > carga->tamanio_valores) {
+        size_t tamanio = largo + 1 > TAMANIO_ARENA ? largo + 1 : TAMANIO_ARENA;
+        char* arena = malloc(tamanio);
+        if (!arena || !lista_insertar_ultimo(carga->arenas_valores, arena)) {
+            free(arena);
+            return NULL;
+        }
+        carga->arena_valores = arena;
+        carga->valores_usados = 0;
+        carga->tamanio_valores = tamanio;
+    }
+    char* copia = carga->arena_valores + carga->valores_usados;
+    memcpy(copia, valor, largo);
+    copia[largo] = '\0';
+    carga->valores_usados += largo + 1;
+    return copia;
+}
+
+// Procesa las lineas completas de [inicio, fin) y devuelve donde empieza
+// la linea incompleta, si la hay. Si final es true, la ultima linea no
+// necesita '\n'.
+static const char* carga_procesar(carga_t* carga, const char* inicio, const char* fin, bool final)
+{
+    while (inicio < fin && carga->ok) {
+        const char* salto = memchr(inicio, '\n', (size_t) (fin - inicio));
+        if (!salto && !final) break;
+        const char* fin_linea = salto ? salto : fin;
+
+        const char* tab = memchr(inicio, '\t', (size_t) (fin_linea - inicio));
+        size_t largo_clave = tab ? (size_t) (tab - inicio) : 0;
+        if (!tab || largo_clave >= TAMANIO_ARENA) {
+            if (fin_linea > inicio) carga->descartados++;
+        } else {
+            void* dato = (void*) (tab + 1);
+            if (carga->copiar_valores) {
+                dato = carga_copiar_valor(carga, tab + 1, (size_t) (fin_linea - tab - 1));
+                if (!dato) {
+                    carga->ok = false;
+                    break;
+                }
+            }
+            if (carga->arena_usada + largo_clave + 1 > TAMANIO_ARENA || carga->en_lote == LARGO_LOTE)
+                carga_vaciar_lote(carga);
+            char* clave = carga->arena + carga->arena_usada;
+            memcpy(clave, inicio, largo_clave);
+            clave[largo_clave] = '\0';
+            carga->arena_usada += largo_clave + 1;
+            carga->claves[carga->en_lote] = clave;
+            carga->datos[carga->en_lote] = dato;
+            carga->en_lote++;
+        }
+        inicio = fin_linea + 1;
+    }
+    return inicio < fin ? inicio : fin;
+}
+
+// Archivo regular: se mapea completo y se recorre en orden
+static bool carga_mapear(carga_t* carga, int fd, size_t largo, void** mapa)
+{
+    *mapa = NULL;
+    if (!largo) return true;
+    *mapa = mmap(NULL, largo, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (*mapa == MAP_FAILED) {
+        *mapa = NULL;
+        return false;
+    }
+    posix_madvise(*mapa, largo, POSIX_MADV_SEQUENTIAL);
+    carga_procesar(carga, *mapa, (const char*) *mapa + largo, true);
+    carga->bytes = largo;
+    return true;
+}
+
+// Entrada estandar o tuberia: se lee en bloques grandes sobre un mismo
+// buffer. Los valores ya se copiaron, asi que de un bloque procesado solo
+// se conserva la linea incompleta del final, que pasa al principio.
+static bool carga_leer(carga_t* carga, int fd)
+{
+    size_t tamanio = TAMANIO_BLOQUE;
+    size_t largo_resto = 0;
+    char* bloque = malloc(tamanio);
+    if (!bloque) return false;
+
+    bool ok = true;
+    while (ok && carga->ok) {
+        size_t usado = largo_resto;
+        ssize_t leido = 0;
+        while (usado < tamanio && (leido = read(fd, bloque + usado, tamanio - usado)) > 0)
+            usado += (size_t) leido;
+        if (leido < 0) {
+            ok = false;
+            break;
+        }
+        carga->bytes += usado - largo_resto;
+
+        bool final = usado < tamanio;
+        const char* resto = carga_procesar(carga, bloque, bloque + usado, final);
+        largo_resto = (size_t) (bloque + usado - resto);
+        if (final) break;
+        memmove(bloque, resto, largo_resto);
+        // Una linea que ocupa todo el bloque necesita un bloque mas grande
+        if (largo_resto == tamanio) {
+            char* mayor = realloc(bloque, 2 * tamanio);
+            if (!mayor) {
+                ok = false;
+                break;
+            }
+            bloque = mayor;
+            tamanio *= 2;
+        }
+    }
+    free(bloque);
+    return ok && carga->ok;
+}
+
+static double segundos_desde(const struct timespec* inicio)
+{
+    struct timespec ahora;
+    clock_gettime(CLOCK_MONOTONIC, &ahora);
+    return (double) (ahora.tv_sec - inicio->tv_sec) + (double) (ahora.tv_nsec - inicio->tv_nsec) / 1e9;
+}
+
+static int carga_masiva(const char* ruta)
+{
+    bool entrada_estandar = strcmp(ruta, "-") == 0;
+    int fd = entrada_estandar ? STDIN_FILENO : open(ruta, O_RDONLY);
+    if (fd < 0) {
+        perror(ruta);
+        return 1;
+    }
+
+    carga_t carga = { .hash = hash_crear(NULL), .arena = malloc(TAMANIO_ARENA),
+                      .arenas_valores = lista_arreglo_crear(), .ok = true };
+    if (!carga.hash || !carga.arena || !carga.arenas_valores) {
+        fprintf(stderr, "Sin memoria\n");
+        return 1;
+    }
+
+    struct timespec inicio;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+
+    struct stat info;
+    void* mapa = NULL;
+    size_t largo_mapa = 0;
+    bool ok;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        largo_mapa = (size_t) info.st_size;
+        ok = carga_mapear(&carga, fd, largo_mapa, &mapa);
+    } else {
+        carga.copiar_valores = true;
+        ok = carga_leer(&carga, fd);
+    }
+    if (ok && carga.en_lote) carga_vaciar_lote(&carga);
+    ok = ok && carga.ok;
+
+    double segundos = segundos_desde(&inicio);
+    struct rusage uso;
+    getrusage(RUSAGE_SELF, &uso);
+    hash_estadisticas_t estadisticas;
+    hash_estadisticas(carga.hash, &estadisticas);
+
+    double mb = (double) carga.bytes / (1024.0 * 1024.0);
+    printf("Registros guardados: %zu (descartados: %zu)\n", carga.registros, carga.descartados);
+    printf("Bytes leidos: %.1f MB en %.3f s\n", mb, segundos);
+    printf("Rendimiento: %.1f MB/s, %.0f claves/s\n",
+           segundos > 0 ? mb / segundos : 0, segundos > 0 ? (double) carga.registros / segundos : 0);
+    printf("Pico de RSS: %ld KB\n", uso.ru_maxrss);
+    printf("Tabla: %zu claves, capacidad %zu, %zu baldes ocupados, cadena maxima %zu, factor de carga %.2f\n",
+           estadisticas.cantidad, estadisticas.capacidad, estadisticas.baldes_ocupados,
+           estadisticas.cadena_maxima, estadisticas.factor_carga);
+    printf("Memoria de la tabla: %zu KB\n", hash_memoria(carga.hash) / 1024);
+    if (!ok) fprintf(stderr, "%s: la carga no se completo\n", ruta);
+
+    hash_destruir(carga.hash);
+    if (mapa) munmap(mapa, largo_mapa);
+    lista_destruir(carga.arenas_valores, free);
+    free(carga.arena);
+    if (!entrada_estandar) close(fd);
+    return !ok;
+}
 
 /* ******************************************************************
  *                        PROGRAMA PRINCIPAL
@@ -11,6 +244,11 @@ void pruebas_volumen_catedra(size_t);
 
 int main(int argc, char *argv[])
 {
+    if (argc > 2 && strcmp(argv[1], "--cargar") == 0) {
+        // Carga masiva desde un archivo clave\tvalor, o "-" para stdin.
+        return carga_masiva(argv[2]);
+    }
+
     if (argc > 1) {
         // Asumimos que nos están pidiendo pruebas de volumen.
         long largo = strtol(argv[1], NULL, 10);
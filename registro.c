@@ -0,0 +1,500 @@
+#define _POSIX_C_SOURCE 200809L
+#include "registro.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Definicion de constantes
+
+#define LARGO_RUTA 4096
+#define TAMANIO_BUFFER_INICIAL (1 << 20)
+#define LARGO_ENCABEZADO 9 // operacion (1) + largo clave (4) + largo dato (4)
+#define MAGIA_INSTANTANEA "HSNAP001"
+#define LARGO_MAGIA 8
+
+// Definicion de la estructura registro. Con ms_por_fsync, un hilo propio
+// sincroniza lo pendiente aunque no lleguen mas operaciones; el mutex
+// protege el buffer y el descriptor entre ese hilo y el que anota.
+
+struct registro {
+    char* ruta;
+    int fd;
+    uint64_t segmento;
+    char* buffer;
+    size_t tamanio_buffer;
+    size_t usado;
+    size_t operaciones_por_fsync;
+    size_t pendientes;
+    uint64_t ms_por_fsync;
+    uint64_t ultimo_fsync;
+    bool error;
+    pid_t hijo;
+    uint64_t segmento_hijo;
+    pthread_mutex_t mutex;
+    pthread_cond_t despertar;
+    pthread_t hilo;
+    bool con_hilo;
+    bool cerrando;
+};
+
+// Funciones auxiliares
+
+uint64_t registro_reloj(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// FNV-1a, para detectar registros cortados o corruptos
+uint32_t registro_suma(uint32_t suma, const void* datos, size_t largo) {
+    const unsigned char* bytes = datos;
+    for (size_t i = 0; i < largo; i++) {
+        suma ^= bytes[i];
+        suma *= 16777619U;
+    }
+    return suma;
+}
+
+#define SUMA_INICIAL 2166136261U
+
+void ruta_segmento(char* destino, const char* ruta, uint64_t segmento) {
+    snprintf(destino, LARGO_RUTA, "%s.log.%llu", ruta, (unsigned long long)segmento);
+}
+
+void ruta_instantanea(char* destino, const char* ruta, bool temporal) {
+    snprintf(destino, LARGO_RUTA, temporal ? "%s.snap.tmp" : "%s.snap", ruta);
+}
+
+// Hace fsync del directorio que contiene a ruta, para que persistan
+// las creaciones y los renombres
+void sincronizar_directorio(const char* ruta) {
+    char directorio[LARGO_RUTA];
+    snprintf(directorio, LARGO_RUTA, "%s", ruta);
+    char* barra = strrchr(directorio, '/');
+    if ( barra )
+        *(barra == directorio ? barra + 1 : barra) = '\0';
+    else
+        strcpy(directorio, ".");
+
+    int fd = open(directorio, O_RDONLY);
+    if ( fd < 0 )
+        return;
+    fsync(fd);
+    close(fd);
+}
+
+bool escribir_todo(int fd, const char* datos, size_t largo) {
+    while ( largo ) {
+        ssize_t escrito = write(fd, datos, largo);
+        if ( escrito < 0 )
+            return false;
+        datos += escrito;
+        largo -= (size_t)escrito;
+    }
+    return true;
+}
+
+bool registro_vaciar_buffer(registro_t* registro) {
+    if ( registro->usado && !escribir_todo(registro->fd, registro->buffer, registro->usado) )
+        registro->error = true;
+    registro->usado = 0;
+    return !registro->error;
+}
+
+// Copia al buffer, escribiendo cada vez que se llena
+void registro_copiar(registro_t* registro, const void* datos, size_t largo) {
+    const char* bytes = datos;
+    while ( largo ) {
+        if ( registro->usado == registro->tamanio_buffer )
+            registro_vaciar_buffer(registro);
+        size_t libre = registro->tamanio_buffer - registro->usado;
+        size_t copiar = largo < libre ? largo : libre;
+        memcpy(registro->buffer + registro->usado, bytes, copiar);
+        registro->usado += copiar;
+        bytes += copiar;
+        largo -= copiar;
+    }
+}
+
+registro_t* registro_crear(const char* ruta, int fd, size_t tamanio_buffer) {
+    registro_t* registro = calloc(1, sizeof(registro_t));
+    if ( !registro )
+        return NULL;
+    registro->tamanio_buffer = tamanio_buffer ? tamanio_buffer : TAMANIO_BUFFER_INICIAL;
+    registro->buffer = malloc(registro->tamanio_buffer);
+    registro->ruta = malloc(strlen(ruta) + 1);
+    if ( !registro->buffer || !registro->ruta ) {
+        free(registro->buffer);
+        free(registro->ruta);
+        free(registro);
+        return NULL;
+    }
+    strcpy(registro->ruta, ruta);
+    registro->fd = fd;
+    registro->ultimo_fsync = registro_reloj();
+    // La espera del hilo usa el mismo reloj que registro_reloj
+    pthread_condattr_t atributos;
+    pthread_condattr_init(&atributos);
+    pthread_condattr_setclock(&atributos, CLOCK_MONOTONIC);
+    pthread_cond_init(&registro->despertar, &atributos);
+    pthread_condattr_destroy(&atributos);
+    pthread_mutex_init(&registro->mutex, NULL);
+    return registro;
+}
+
+void registro_liberar(registro_t* registro) {
+    pthread_mutex_destroy(&registro->mutex);
+    pthread_cond_destroy(&registro->despertar);
+    if ( registro->fd >= 0 )
+        close(registro->fd);
+    free(registro->buffer);
+    free(registro->ruta);
+    free(registro);
+}
+
+// Lee un registro del archivo. Devuelve false al final del archivo o si el
+// registro esta incompleto o corrupto.
+bool leer_operacion(FILE* archivo, char** memoria, size_t* capacidad,
+                    registro_operacion_t* operacion, size_t* largo_clave, size_t* largo_dato) {
+    unsigned char encabezado[LARGO_ENCABEZADO];
+    if ( fread(encabezado, 1, LARGO_ENCABEZADO, archivo) != LARGO_ENCABEZADO )
+        return false;
+
+    uint32_t lc, ld;
+    memcpy(&lc, encabezado + 1, sizeof(uint32_t));
+    memcpy(&ld, encabezado + 5, sizeof(uint32_t));
+    *operacion = encabezado[0];
+    if ( *operacion != REGISTRO_GUARDAR && *operacion != REGISTRO_BORRAR && *operacion != REGISTRO_GUARDAR_TTL )
+        return false;
+
+    // La clave se termina con '\0' en memoria
+    size_t necesario = (size_t)lc + 1 + ld;
+    if ( necesario > *capacidad ) {
+        char* nueva = realloc(*memoria, necesario);
+        if ( !nueva )
+            return false;
+        *memoria = nueva;
+        *capacidad = necesario;
+    }
+    if ( fread(*memoria, 1, lc, archivo) != lc )
+        return false;
+    if ( fread(*memoria + lc + 1, 1, ld, archivo) != ld )
+        return false;
+
+    uint32_t suma_guardada;
+    if ( fread(&suma_guardada, 1, sizeof(uint32_t), archivo) != sizeof(uint32_t) )
+        return false;
+    uint32_t suma = registro_suma(SUMA_INICIAL, encabezado, LARGO_ENCABEZADO);
+    suma = registro_suma(suma, *memoria, lc);
+    suma = registro_suma(suma, *memoria + lc + 1, ld);
+    if ( suma != suma_guardada )
+        return false;
+
+    (*memoria)[lc] = '\0';
+    *largo_clave = lc;
+    *largo_dato = ld;
+    return true;
+}
+
+// Reproduce las operaciones de un archivo a partir de su posicion actual.
+// Deja en largo_valido el largo del prefijo sano del archivo.
+bool reproducir_archivo(FILE* archivo, registro_aplicar_t aplicar, void* extra, long* largo_valido) {
+    char* memoria = NULL;
+    size_t capacidad = 0;
+    registro_operacion_t operacion;
+    size_t largo_clave, largo_dato;
+    bool ok = true;
+
+    *largo_valido = ftell(archivo);
+    while ( ok && leer_operacion(archivo, &memoria, &capacidad, &operacion, &largo_clave, &largo_dato) ) {
+        ok = aplicar(operacion, memoria, memoria + largo_clave + 1, largo_dato, extra);
+        *largo_valido = ftell(archivo);
+    }
+    free(memoria);
+    return ok;
+}
+
+// Borra los segmentos anteriores a segmento, que ya estan en la instantanea
+void borrar_segmentos_anteriores(const char* ruta, uint64_t segmento) {
+    char nombre[LARGO_RUTA];
+    while ( segmento-- > 0 ) {
+        ruta_segmento(nombre, ruta, segmento);
+        if ( unlink(nombre) )
+            break;
+    }
+}
+
+// Si la compactacion termino, borra los segmentos que ya estan en la
+// instantanea. Devuelve true mientras siga en curso.
+// Pre: se tiene el mutex del registro
+bool registro_revisar_hijo(registro_t* registro) {
+    if ( !registro->hijo )
+        return false;
+
+    int estado;
+    pid_t terminado = waitpid(registro->hijo, &estado, WNOHANG);
+    if ( terminado == 0 )
+        return true;
+
+    if ( terminado == registro->hijo && WIFEXITED(estado) && WEXITSTATUS(estado) == 0 )
+        borrar_segmentos_anteriores(registro->ruta, registro->segmento_hijo);
+    registro->hijo = 0;
+    return false;
+}
+
+// Pre: se tiene el mutex del registro
+bool registro_sincronizar_pendiente(registro_t* registro) {
+    registro_revisar_hijo(registro);
+    if ( registro_vaciar_buffer(registro) && fsync(registro->fd) )
+        registro->error = true;
+    registro->pendientes = 0;
+    registro->ultimo_fsync = registro_reloj();
+    return !registro->error;
+}
+
+// Hilo del commit agrupado por tiempo: sincroniza las operaciones
+// pendientes a lo sumo ms_por_fsync despues de anotadas, aunque la tabla
+// quede quieta
+void* registro_vigilar(void* extra) {
+    registro_t* registro = extra;
+    pthread_mutex_lock(&registro->mutex);
+    while ( !registro->cerrando ) {
+        uint64_t ahora = registro_reloj();
+        uint64_t limite = registro->ultimo_fsync + registro->ms_por_fsync;
+        if ( registro->pendientes && ahora >= limite ) {
+            registro_sincronizar_pendiente(registro);
+            continue;
+        }
+        if ( ahora >= limite )
+            limite = ahora + registro->ms_por_fsync;
+        struct timespec hasta = { (time_t)(limite / 1000), (long)(limite % 1000) * 1000000 };
+        pthread_cond_timedwait(&registro->despertar, &registro->mutex, &hasta);
+    }
+    pthread_mutex_unlock(&registro->mutex);
+    return NULL;
+}
+
+// El dato se escribe a continuacion del prefijo, sin juntarlos en memoria
+// Pre: se tiene el mutex del registro
+bool registro_agregar(registro_t* registro, registro_operacion_t operacion, const char* clave,
+                      const void* prefijo, size_t largo_prefijo, const void* dato, size_t largo_dato) {
+
+    unsigned char encabezado[LARGO_ENCABEZADO];
+    uint32_t lc = (uint32_t)strlen(clave);
+    uint32_t lp = (uint32_t)largo_prefijo;
+    uint32_t ld = (uint32_t)largo_dato;
+    uint32_t total = lp + ld;
+    encabezado[0] = (unsigned char)operacion;
+    memcpy(encabezado + 1, &lc, sizeof(uint32_t));
+    memcpy(encabezado + 5, &total, sizeof(uint32_t));
+
+    uint32_t suma = registro_suma(SUMA_INICIAL, encabezado, LARGO_ENCABEZADO);
+    suma = registro_suma(suma, clave, lc);
+    suma = registro_suma(suma, prefijo, lp);
+    suma = registro_suma(suma, dato, ld);
+
+    registro_copiar(registro, encabezado, LARGO_ENCABEZADO);
+    registro_copiar(registro, clave, lc);
+    registro_copiar(registro, prefijo, lp);
+    registro_copiar(registro, dato, ld);
+    registro_copiar(registro, &suma, sizeof(uint32_t));
+    registro->pendientes++;
+
+    // Commit agrupado: un fsync cubre todas las operaciones pendientes
+    if ( registro->operaciones_por_fsync && registro->pendientes >= registro->operaciones_por_fsync )
+        return registro_sincronizar_pendiente(registro);
+    if ( registro->ms_por_fsync && registro_reloj() - registro->ultimo_fsync >= registro->ms_por_fsync )
+        return registro_sincronizar_pendiente(registro);
+    return !registro->error;
+}
+
+// Pre: se tiene el mutex del registro
+bool registro_iniciar_compactacion(registro_t* registro, registro_volcar_t volcar, void* extra) {
+    if ( registro_revisar_hijo(registro) || !registro_sincronizar_pendiente(registro) )
+        return false;
+
+    char nombre[LARGO_RUTA];
+    char temporal[LARGO_RUTA];
+    ruta_instantanea(nombre, registro->ruta, false);
+    ruta_instantanea(temporal, registro->ruta, true);
+
+    // Todo lo que use el hijo se pide antes del fork
+    int fd_instantanea = open(temporal, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if ( fd_instantanea < 0 )
+        return false;
+    registro_t* instantanea = registro_crear(registro->ruta, fd_instantanea, registro->tamanio_buffer);
+    if ( !instantanea ) {
+        close(fd_instantanea);
+        return false;
+    }
+
+    uint64_t segmento_nuevo = registro->segmento + 1;
+    ruta_segmento(temporal, registro->ruta, segmento_nuevo);
+    int fd_segmento = open(temporal, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if ( fd_segmento < 0 ) {
+        registro_liberar(instantanea);
+        return false;
+    }
+    sincronizar_directorio(registro->ruta);
+
+    pid_t hijo = fork();
+    if ( hijo < 0 ) {
+        close(fd_segmento);
+        unlink(temporal);
+        registro_liberar(instantanea);
+        return false;
+    }
+
+    if ( hijo == 0 ) {
+        close(fd_segmento);
+        registro_copiar(instantanea, MAGIA_INSTANTANEA, LARGO_MAGIA);
+        registro_copiar(instantanea, &segmento_nuevo, sizeof(uint64_t));
+        bool ok = volcar(instantanea, extra) && registro_sincronizar(instantanea);
+        ruta_instantanea(temporal, registro->ruta, true);
+        ok = ok && !rename(temporal, nombre);
+        if ( ok )
+            sincronizar_directorio(registro->ruta);
+        _exit(ok ? 0 : 1);
+    }
+
+    registro_liberar(instantanea);
+    close(registro->fd);
+    registro->fd = fd_segmento;
+    registro->segmento = segmento_nuevo;
+    registro->hijo = hijo;
+    registro->segmento_hijo = segmento_nuevo;
+    return true;
+}
+
+// Primitivas del registro
+
+registro_t* registro_abrir(const char* ruta, size_t tamanio_buffer,
+                           size_t operaciones_por_fsync, uint64_t ms_por_fsync,
+                           registro_aplicar_t aplicar, void* extra) {
+    char nombre[LARGO_RUTA];
+    long largo_valido = 0;
+    uint64_t segmento = 0;
+
+    ruta_instantanea(nombre, ruta, false);
+    FILE* archivo = fopen(nombre, "rb");
+    if ( archivo ) {
+        char magia[LARGO_MAGIA];
+        bool ok = fread(magia, 1, LARGO_MAGIA, archivo) == LARGO_MAGIA
+               && memcmp(magia, MAGIA_INSTANTANEA, LARGO_MAGIA) == 0
+               && fread(&segmento, 1, sizeof(uint64_t), archivo) == sizeof(uint64_t)
+               && reproducir_archivo(archivo, aplicar, extra, &largo_valido);
+        ok = ok && fgetc(archivo) == EOF;
+        fclose(archivo);
+        if ( !ok )
+            return NULL;
+    }
+    borrar_segmentos_anteriores(ruta, segmento);
+
+    // Solo el ultimo segmento puede tener una cola incompleta: en uno
+    // anterior, lo que sigue al prefijo sano son operaciones perdidas
+    uint64_t ultimo = segmento;
+    bool cola_cortada = false;
+    largo_valido = 0;
+    for (uint64_t n = segmento; ; n++) {
+        ruta_segmento(nombre, ruta, n);
+        archivo = fopen(nombre, "rb");
+        if ( !archivo )
+            break;
+        bool ok = !cola_cortada && reproducir_archivo(archivo, aplicar, extra, &largo_valido)
+                  && fseek(archivo, 0, SEEK_END) == 0;
+        cola_cortada = ftell(archivo) != largo_valido;
+        fclose(archivo);
+        if ( !ok )
+            return NULL;
+        ultimo = n;
+    }
+
+    ruta_segmento(nombre, ruta, ultimo);
+    int fd = open(nombre, O_WRONLY | O_CREAT, 0644);
+    if ( fd < 0 )
+        return NULL;
+    if ( ftruncate(fd, largo_valido) || lseek(fd, 0, SEEK_END) < 0 ) {
+        close(fd);
+        return NULL;
+    }
+    sincronizar_directorio(ruta);
+
+    registro_t* registro = registro_crear(ruta, fd, tamanio_buffer);
+    if ( !registro ) {
+        close(fd);
+        return NULL;
+    }
+    registro->segmento = ultimo;
+    registro->operaciones_por_fsync = operaciones_por_fsync;
+    registro->ms_por_fsync = ms_por_fsync;
+    // Sin el hilo, el tiempo solo se revisa al anotar
+    if ( ms_por_fsync )
+        registro->con_hilo = pthread_create(&registro->hilo, NULL, registro_vigilar, registro) == 0;
+    return registro;
+}
+
+bool registro_anotar(registro_t* registro, registro_operacion_t operacion,
+                     const char* clave, const void* dato, size_t largo_dato) {
+    pthread_mutex_lock(&registro->mutex);
+    bool ok = !registro->error;
+    if ( ok )
+        ok = registro_agregar(registro, operacion, clave, NULL, 0, dato, largo_dato);
+    pthread_mutex_unlock(&registro->mutex);
+    return ok;
+}
+
+bool registro_anotar_con_vencimiento(registro_t* registro, const char* clave, uint64_t vence,
+                                     const void* dato, size_t largo_dato) {
+    pthread_mutex_lock(&registro->mutex);
+    bool ok = !registro->error;
+    if ( ok )
+        ok = registro_agregar(registro, REGISTRO_GUARDAR_TTL, clave, &vence, sizeof(uint64_t), dato, largo_dato);
+    pthread_mutex_unlock(&registro->mutex);
+    return ok;
+}
+
+bool registro_sincronizar(registro_t* registro) {
+    pthread_mutex_lock(&registro->mutex);
+    bool ok = registro_sincronizar_pendiente(registro);
+    pthread_mutex_unlock(&registro->mutex);
+    return ok;
+}
+
+bool registro_compactar(registro_t* registro, registro_volcar_t volcar, void* extra) {
+    // Con el mutex tomado, el hilo no esta escribiendo cuando se hace el fork
+    pthread_mutex_lock(&registro->mutex);
+    bool ok = registro_iniciar_compactacion(registro, volcar, extra);
+    pthread_mutex_unlock(&registro->mutex);
+    return ok;
+}
+
+bool registro_compactando(registro_t* registro) {
+    pthread_mutex_lock(&registro->mutex);
+    bool en_curso = registro_revisar_hijo(registro);
+    pthread_mutex_unlock(&registro->mutex);
+    return en_curso;
+}
+
+void registro_cerrar(registro_t* registro) {
+    if ( registro->con_hilo ) {
+        pthread_mutex_lock(&registro->mutex);
+        registro->cerrando = true;
+        pthread_cond_signal(&registro->despertar);
+        pthread_mutex_unlock(&registro->mutex);
+        pthread_join(registro->hilo, NULL);
+    }
+    registro_sincronizar(registro);
+    if ( registro->hijo ) {
+        int estado;
+        if ( waitpid(registro->hijo, &estado, 0) == registro->hijo && WIFEXITED(estado) && WEXITSTATUS(estado) == 0 )
+            borrar_segmentos_anteriores(registro->ruta, registro->segmento_hijo);
+        registro->hijo = 0;
+    }
+    registro_liberar(registro);
+}
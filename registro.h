@@ -0,0 +1,82 @@
+#ifndef REGISTRO_H
+#define REGISTRO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ******************************************************************
+ *                DEFINICION DE LOS TIPOS DE DATOS
+ * ******************************************************************/
+
+// Registro de operaciones de solo agregado (write-ahead log) con commit
+// agrupado. En disco se compone de una instantanea "<ruta>.snap" y de
+// segmentos "<ruta>.log.<n>"; la instantanea indica desde que segmento
+// hay que reproducir.
+typedef struct registro registro_t;
+
+// El dato de REGISTRO_GUARDAR_TTL empieza con el vencimiento (uint64_t,
+// milisegundos de CLOCK_REALTIME) seguido de los bytes del valor.
+typedef enum {
+    REGISTRO_GUARDAR = 1,
+    REGISTRO_BORRAR = 2,
+    REGISTRO_GUARDAR_TTL = 3
+} registro_operacion_t;
+
+// Aplica una operacion durante la recuperacion. Devuelve false para abortarla.
+typedef bool (*registro_aplicar_t)(registro_operacion_t operacion,
+                                   const char* clave, const void* dato,
+                                   size_t largo_dato, void* extra);
+
+// Escribe en el registro recibido todas las entradas vigentes, con
+// REGISTRO_GUARDAR. Se usa para generar la instantanea.
+typedef bool (*registro_volcar_t)(registro_t* instantanea, void* extra);
+
+/* ******************************************************************
+ *                    PRIMITIVAS DEL REGISTRO
+ * ******************************************************************/
+
+// Reproduce la ultima instantanea y los segmentos posteriores llamando a
+// aplicar por cada operacion, descarta una cola incompleta del ultimo
+// segmento y deja el registro abierto para agregar. Un registro vacio o
+// inexistente se crea. Devuelve NULL si hubo un error de E/S, si aplicar
+// fallo o si un segmento anterior al ultimo termina en una cola cortada.
+// tamanio_buffer: bytes que se acumulan antes de escribir.
+// operaciones_por_fsync, ms_por_fsync: se hace fsync al alcanzar cualquiera
+// de los dos (0 desactiva ese criterio). Con ms_por_fsync se lanza un hilo
+// que sincroniza lo pendiente a lo sumo ms_por_fsync despues de anotado,
+// aunque no se anote nada mas.
+registro_t* registro_abrir(const char* ruta, size_t tamanio_buffer,
+                           size_t operaciones_por_fsync, uint64_t ms_por_fsync,
+                           registro_aplicar_t aplicar, void* extra);
+
+// Agrega una operacion al buffer. Solo escribe y hace fsync cuando se
+// llena el buffer o se cumple el criterio de agrupamiento. Puede llamarse
+// mientras el hilo de sincronizacion trabaja.
+// Devuelve false si no pudo escribir en disco.
+bool registro_anotar(registro_t* registro, registro_operacion_t operacion,
+                     const char* clave, const void* dato, size_t largo_dato);
+
+// Agrega un REGISTRO_GUARDAR_TTL con el vencimiento absoluto vence delante
+// del dato, sin pedir memoria. Devuelve false si no pudo escribir en disco.
+bool registro_anotar_con_vencimiento(registro_t* registro, const char* clave, uint64_t vence,
+                                     const void* dato, size_t largo_dato);
+
+// Escribe lo pendiente y hace fsync. Devuelve false si alguna escritura
+// anterior o esta fallo.
+bool registro_sincronizar(registro_t* registro);
+
+// Compacta en segundo plano: cierra el segmento actual, abre uno nuevo y
+// un proceso hijo (fork, con copia de la tabla por copy-on-write) escribe
+// la instantanea llamando a volcar. Los segmentos viejos se borran cuando
+// el hijo termina bien. Devuelve false si ya habia una compactacion en
+// curso o no pudo iniciarla.
+bool registro_compactar(registro_t* registro, registro_volcar_t volcar, void* extra);
+
+// Devuelve true mientras haya una compactacion en curso.
+bool registro_compactando(registro_t* registro);
+
+// Sincroniza, espera una compactacion en curso y libera el registro.
+void registro_cerrar(registro_t* registro);
+
+#endif // REGISTRO_H
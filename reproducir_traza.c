@@ -0,0 +1,429 @@
+/*
+ * reproducir_traza.c
+ * Reproduce una traza grabada con hash_traza_iniciar contra un backend y
+ * una configuracion a eleccion, lo mas rapido posible, e informa el
+ * rendimiento, los percentiles de latencia por operacion y la memoria al
+ * final, junto con los fallos de pagina y de TLB de datos de la
+ * reproduccion (estos ultimos solo en Linux, si perf_event_open esta
+ * permitido). Sirve para comparar cambios contra trafico real sin tocar
+ * produccion.
+ *
+ * Si la traza no tiene claves, cada clave se reemplaza por su hash en
+ * hexadecimal: se conservan la distribucion y el patron de acceso, no el
+ * largo de las claves.
+ *
+ * Compilar: gcc -std=c99 -O2 -pthread reproducir_traza.c hash.c hamt.c lista.c registro.c allocador.c traza.c congelado.c
+ * Uso: ./reproducir_traza traza.bin [backend] [max_entradas]
+ *      backends: hash (por defecto), filtro, cuckoo, grandes, lru, clock, hamt
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // syscall
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#include "hash.h"
+#include "hamt.h"
+#include "traza.h"
+
+#define MAX_ENTRADAS_CACHE 65536
+#define BITS_FILTRO 10
+// Histograma log-lineal: 16 sub-baldes por potencia de 2 de nanosegundos
+#define SUB_BALDES 16
+#define BALDES_LATENCIA (64 * SUB_BALDES)
+
+/* ******************************************************************
+ *                          BACKENDS
+ * *****************************************************************/
+
+typedef struct backend {
+    const char *nombre;
+    void *(*crear)(size_t max_entradas);
+    bool (*guardar)(void *tabla, const char *clave, void *dato);
+    void *(*obtener)(void *tabla, const char *clave);
+    void (*borrar)(void *tabla, const char *clave);
+    bool (*pertenece)(void *tabla, const char *clave);
+    size_t (*memoria)(void *tabla); // 0 si el backend no la informa
+    void (*destruir)(void *tabla);
+} backend_t;
+
+static void *hash_nuevo(size_t max_entradas)
+{
+    (void) max_entradas;
+    return hash_crear(NULL);
+}
+
+static void *hash_con_filtro_nuevo(size_t max_entradas)
+{
+    (void) max_entradas;
+    hash_t *hash = hash_crear(NULL);
+    if (hash && !hash_filtro_activar(hash, BITS_FILTRO)) {
+        hash_destruir(hash);
+        return NULL;
+    }
+    return hash;
+}
+
+static void *hash_cuckoo_nuevo(size_t max_entradas)
+{
+    (void) max_entradas;
+    return hash_cuckoo_crear(NULL);
+}
+
+// Paginas grandes y prefault: los fallos de pagina quedan al crecer
+static void *hash_paginas_grandes_nuevo(size_t max_entradas)
+{
+    (void) max_entradas;
+    hash_t *hash = hash_crear(NULL);
+    if (hash) hash_configurar_paginas(hash, true, true);
+    return hash;
+}
+
+static void *hash_lru_nuevo(size_t max_entradas)
+{
+    return hash_cache_crear(max_entradas, 0, HASH_POLITICA_LRU, NULL);
+}
+
+static void *hash_clock_nuevo(size_t max_entradas)
+{
+    return hash_cache_crear(max_entradas, 0, HASH_POLITICA_CLOCK, NULL);
+}
+
+static bool hash_guardar_backend(void *tabla, const char *clave, void *dato)
+{
+    return hash_guardar(tabla, clave, dato);
+}
+
+static void *hash_obtener_backend(void *tabla, const char *clave)
+{
+    return hash_obtener(tabla, clave);
+}
+
+static void hash_borrar_backend(void *tabla, const char *clave)
+{
+    hash_borrar(tabla, clave);
+}
+
+static bool hash_pertenece_backend(void *tabla, const char *clave)
+{
+    return hash_pertenece(tabla, clave);
+}
+
+static size_t hash_memoria_backend(void *tabla)
+{
+    return hash_memoria(tabla);
+}
+
+static void hash_destruir_backend(void *tabla)
+{
+    hash_destruir(tabla);
+}
+
+static void *hamt_nuevo(size_t max_entradas)
+{
+    (void) max_entradas;
+    return hamt_crear(NULL);
+}
+
+static bool hamt_guardar_backend(void *tabla, const char *clave, void *dato)
+{
+    return hamt_guardar(tabla, clave, dato);
+}
+
+static void *hamt_obtener_backend(void *tabla, const char *clave)
+{
+    return hamt_obtener(tabla, clave);
+}
+
+static void hamt_borrar_backend(void *tabla, const char *clave)
+{
+    hamt_borrar(tabla, clave);
+}
+
+static bool hamt_pertenece_backend(void *tabla, const char *clave)
+{
+    return hamt_pertenece(tabla, clave);
+}
+
+static size_t sin_memoria(void *tabla)
+{
+    (void) tabla;
+    return 0;
+}
+
+static void hamt_destruir_backend(void *tabla)
+{
+    hamt_destruir(tabla);
+}
+
+#define BACKEND_HASH(nombre, crear) \
+    { nombre, crear, hash_guardar_backend, hash_obtener_backend, hash_borrar_backend, \
+      hash_pertenece_backend, hash_memoria_backend, hash_destruir_backend }
+
+static const backend_t BACKENDS[] = {
+    BACKEND_HASH("hash", hash_nuevo),
+    BACKEND_HASH("filtro", hash_con_filtro_nuevo),
+    BACKEND_HASH("cuckoo", hash_cuckoo_nuevo),
+    BACKEND_HASH("grandes", hash_paginas_grandes_nuevo),
+    BACKEND_HASH("lru", hash_lru_nuevo),
+    BACKEND_HASH("clock", hash_clock_nuevo),
+    { "hamt", hamt_nuevo, hamt_guardar_backend, hamt_obtener_backend, hamt_borrar_backend,
+      hamt_pertenece_backend, sin_memoria, hamt_destruir_backend },
+};
+
+/* ******************************************************************
+ *                      CARGA DE LA TRAZA
+ * *****************************************************************/
+
+typedef struct operacion {
+    traza_operacion_t tipo;
+    size_t clave; // desplazamiento en el texto de claves
+} operacion_t;
+
+typedef struct carga {
+    operacion_t *operaciones;
+    size_t cantidad;
+    size_t capacidad;
+    char *claves;
+    size_t largo_claves;
+    size_t capacidad_claves;
+    uint64_t duracion;
+} carga_t;
+
+static bool carga_agregar(traza_operacion_t tipo, const char *clave, size_t largo, uint64_t hash,
+                          uint64_t instante, void *extra)
+{
+    carga_t *carga = extra;
+    char sintetica[2 * sizeof(uint64_t) + 2];
+    if (!clave) {
+        snprintf(sintetica, sizeof(sintetica), "h%016llx", (unsigned long long) hash);
+        clave = sintetica;
+        largo = strlen(sintetica);
+    }
+
+    if (carga->cantidad == carga->capacidad) {
+        size_t capacidad = carga->capacidad ? 2 * carga->capacidad : 4096;
+        operacion_t *operaciones = realloc(carga->operaciones, capacidad * sizeof(operacion_t));
+        if (!operaciones) return false;
+        carga->operaciones = operaciones;
+        carga->capacidad = capacidad;
+    }
+    while (carga->largo_claves + largo + 1 > carga->capacidad_claves) {
+        size_t capacidad = carga->capacidad_claves ? 2 * carga->capacidad_claves : 1 << 16;
+        char *claves = realloc(carga->claves, capacidad);
+        if (!claves) return false;
+        carga->claves = claves;
+        carga->capacidad_claves = capacidad;
+    }
+
+    memcpy(carga->claves + carga->largo_claves, clave, largo + 1);
+    carga->operaciones[carga->cantidad].tipo = tipo;
+    carga->operaciones[carga->cantidad].clave = carga->largo_claves;
+    carga->cantidad++;
+    carga->largo_claves += largo + 1;
+    carga->duracion = instante;
+    return true;
+}
+
+/* ******************************************************************
+ *                         MEDICIONES
+ * *****************************************************************/
+
+static const char *NOMBRES_OPERACION[] = { "", "guardar", "obtener", "borrar", "pertenece" };
+#define TIPOS_OPERACION (sizeof(NOMBRES_OPERACION) / sizeof(NOMBRES_OPERACION[0]))
+
+typedef struct histograma {
+    size_t baldes[BALDES_LATENCIA];
+    size_t cantidad;
+    uint64_t maximo;
+} histograma_t;
+
+static uint64_t nanosegundos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+// Los valores menores a SUB_BALDES van exactos; los demas, con un error
+// relativo de a lo sumo 1/SUB_BALDES
+static size_t balde_latencia(uint64_t ns)
+{
+    if (ns < SUB_BALDES) return (size_t) ns;
+    size_t potencia = 63 - (size_t) __builtin_clzll(ns);
+    size_t sub = (size_t) (ns >> (potencia - 4)) & (SUB_BALDES - 1);
+    return (potencia - 3) * SUB_BALDES + sub;
+}
+
+static uint64_t limite_balde(size_t balde)
+{
+    if (balde < SUB_BALDES) return balde;
+    size_t potencia = balde / SUB_BALDES + 3;
+    uint64_t sub = balde % SUB_BALDES;
+    return ((uint64_t) SUB_BALDES + sub + 1) << (potencia - 4);
+}
+
+static void histograma_agregar(histograma_t *histograma, uint64_t ns)
+{
+    histograma->baldes[balde_latencia(ns)]++;
+    histograma->cantidad++;
+    if (ns > histograma->maximo) histograma->maximo = ns;
+}
+
+static uint64_t histograma_percentil(const histograma_t *histograma, double percentil)
+{
+    size_t objetivo = (size_t) ((double) histograma->cantidad * percentil / 100.0);
+    size_t acumulado = 0;
+    for (size_t i = 0; i < BALDES_LATENCIA; i++) {
+        acumulado += histograma->baldes[i];
+        if (acumulado > objetivo) return limite_balde(i);
+    }
+    return histograma->maximo;
+}
+
+static void histograma_imprimir(const char *nombre, const histograma_t *histograma)
+{
+    if (!histograma->cantidad) return;
+    printf("  %-10s %10zu ops  p50 %6llu  p90 %6llu  p99 %6llu  p99.9 %7llu  max %9llu ns\n",
+           nombre, histograma->cantidad,
+           (unsigned long long) histograma_percentil(histograma, 50),
+           (unsigned long long) histograma_percentil(histograma, 90),
+           (unsigned long long) histograma_percentil(histograma, 99),
+           (unsigned long long) histograma_percentil(histograma, 99.9),
+           (unsigned long long) histograma->maximo);
+}
+
+// Contador de fallos de TLB de datos del proceso, o -1 si no hay
+static int tlb_abrir(void)
+{
+#ifdef __linux__
+    struct perf_event_attr atributos;
+    memset(&atributos, 0, sizeof(atributos));
+    atributos.type = PERF_TYPE_HW_CACHE;
+    atributos.size = sizeof(atributos);
+    atributos.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    atributos.disabled = 1;
+    atributos.exclude_kernel = 1;
+    atributos.exclude_hv = 1;
+    int fd = (int) syscall(SYS_perf_event_open, &atributos, 0, -1, -1, 0);
+    if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+static bool tlb_leer(int fd, uint64_t *fallos)
+{
+    return fd >= 0 && read(fd, fallos, sizeof(*fallos)) == (ssize_t) sizeof(*fallos);
+}
+
+/* ******************************************************************
+ *                     PROGRAMA PRINCIPAL
+ * *****************************************************************/
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Uso: %s traza.bin [backend] [max_entradas]\n", argv[0]);
+        return 1;
+    }
+
+    const backend_t *backend = &BACKENDS[0];
+    if (argc > 2) {
+        backend = NULL;
+        for (size_t i = 0; i < sizeof(BACKENDS) / sizeof(BACKENDS[0]); i++) {
+            if (strcmp(argv[2], BACKENDS[i].nombre) == 0) backend = &BACKENDS[i];
+        }
+        if (!backend) {
+            fprintf(stderr, "%s: backend desconocido\n", argv[2]);
+            return 1;
+        }
+    }
+    size_t max_entradas = argc > 3 ? (size_t) strtoull(argv[3], NULL, 10) : MAX_ENTRADAS_CACHE;
+
+    carga_t carga = {0};
+    bool con_claves = false;
+    if (!traza_leer(argv[1], &con_claves, carga_agregar, &carga)) {
+        fprintf(stderr, "%s: no se pudo leer la traza\n", argv[1]);
+        return 1;
+    }
+
+    void *tabla = backend->crear(max_entradas);
+    histograma_t *histogramas = calloc(TIPOS_OPERACION, sizeof(histograma_t));
+    if (!tabla || !histogramas) {
+        fprintf(stderr, "Sin memoria\n");
+        return 1;
+    }
+
+    // El dato no importa: ningun backend lo libera
+    static char dato;
+    size_t fallidas = 0;
+    struct rusage uso_inicial;
+    getrusage(RUSAGE_SELF, &uso_inicial);
+    int tlb = tlb_abrir();
+    uint64_t tlb_inicial = 0;
+    bool con_tlb = tlb_leer(tlb, &tlb_inicial);
+    uint64_t inicio = nanosegundos();
+    for (size_t i = 0; i < carga.cantidad; i++) {
+        const operacion_t *operacion = &carga.operaciones[i];
+        const char *clave = carga.claves + operacion->clave;
+        uint64_t antes = nanosegundos();
+        switch (operacion->tipo) {
+        case TRAZA_GUARDAR:
+            fallidas += !backend->guardar(tabla, clave, &dato);
+            break;
+        case TRAZA_OBTENER:
+            backend->obtener(tabla, clave);
+            break;
+        case TRAZA_BORRAR:
+            backend->borrar(tabla, clave);
+            break;
+        case TRAZA_PERTENECE:
+            backend->pertenece(tabla, clave);
+            break;
+        }
+        histograma_agregar(&histogramas[operacion->tipo], nanosegundos() - antes);
+    }
+    double segundos = (double) (nanosegundos() - inicio) / 1e9;
+    uint64_t tlb_final = 0;
+    con_tlb = con_tlb && tlb_leer(tlb, &tlb_final);
+    if (tlb >= 0) close(tlb);
+
+    struct rusage uso;
+    getrusage(RUSAGE_SELF, &uso);
+    printf("traza %s: %zu operaciones, %s, %.3f s grabados\n", argv[1], carga.cantidad,
+           con_claves ? "con claves" : "solo hashes", (double) carga.duracion / 1e9);
+    printf("backend %s: %.3f s, %.0f ops/s", backend->nombre, segundos,
+           segundos > 0 ? (double) carga.cantidad / segundos : 0);
+    if (fallidas) printf(", %zu guardados fallidos", fallidas);
+    printf("\n");
+    for (size_t t = 1; t < TIPOS_OPERACION; t++)
+        histograma_imprimir(NOMBRES_OPERACION[t], &histogramas[t]);
+    size_t memoria = backend->memoria(tabla);
+    if (memoria) printf("memoria de la tabla al final: %zu KB\n", memoria / 1024);
+    printf("pico de RSS: %ld KB\n", uso.ru_maxrss);
+    printf("fallos de pagina: %ld menores, %ld mayores\n", uso.ru_minflt - uso_inicial.ru_minflt,
+           uso.ru_majflt - uso_inicial.ru_majflt);
+    if (con_tlb)
+        printf("fallos de TLB de datos: %llu\n", (unsigned long long) (tlb_final - tlb_inicial));
+    else
+        printf("fallos de TLB de datos: no disponible\n");
+
+    backend->destruir(tabla);
+    free(histogramas);
+    free(carga.operaciones);
+    free(carga.claves);
+    return 0;
+}
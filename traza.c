@@ -0,0 +1,167 @@
+#define _POSIX_C_SOURCE 200809L
+#include "traza.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Definicion de constantes
+
+#define MAGIA_TRAZA "HTRAZA01"
+#define LARGO_MAGIA 8
+#define OPCION_CON_CLAVES 1
+#define TAMANIO_BUFFER (1 << 16)
+#define LARGO_VARINT_MAXIMO 10
+
+// Definicion de la estructura traza
+
+struct traza {
+    FILE* archivo;
+    bool con_claves;
+    uint64_t anterior; // instante de la ultima operacion
+    bool error;
+};
+
+// Funciones auxiliares
+
+uint64_t traza_reloj(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+// Entero sin signo de 7 bits por byte, el bit alto indica que sigue
+size_t traza_codificar_varint(unsigned char* destino, uint64_t valor) {
+    size_t largo = 0;
+    while ( valor >= 0x80 ) {
+        destino[largo++] = (unsigned char)(valor | 0x80);
+        valor >>= 7;
+    }
+    destino[largo++] = (unsigned char)valor;
+    return largo;
+}
+
+bool traza_leer_varint(FILE* archivo, uint64_t* valor) {
+    *valor = 0;
+    for (unsigned desplazamiento = 0; desplazamiento < 64; desplazamiento += 7) {
+        int byte = getc(archivo);
+        if ( byte == EOF )
+            return false;
+        *valor |= (uint64_t)(byte & 0x7f) << desplazamiento;
+        if ( !(byte & 0x80) )
+            return true;
+    }
+    return false;
+}
+
+void traza_escribir(traza_t* traza, const void* datos, size_t largo) {
+    if ( fwrite(datos, 1, largo, traza->archivo) != largo )
+        traza->error = true;
+}
+
+// Primitivas de la traza
+
+traza_t* traza_crear(const char* ruta, bool con_claves) {
+    traza_t* traza = malloc(sizeof(traza_t));
+    if ( !traza )
+        return NULL;
+    traza->archivo = fopen(ruta, "wb");
+    if ( !traza->archivo ) {
+        free(traza);
+        return NULL;
+    }
+    setvbuf(traza->archivo, NULL, _IOFBF, TAMANIO_BUFFER);
+    traza->con_claves = con_claves;
+    traza->anterior = traza_reloj();
+    traza->error = false;
+
+    unsigned char opciones = con_claves ? OPCION_CON_CLAVES : 0;
+    traza_escribir(traza, MAGIA_TRAZA, LARGO_MAGIA);
+    traza_escribir(traza, &opciones, 1);
+    return traza;
+}
+
+void traza_anotar(traza_t* traza, traza_operacion_t operacion, const char* clave, uint64_t hash) {
+    unsigned char encabezado[1 + 2 * LARGO_VARINT_MAXIMO];
+    uint64_t ahora = traza_reloj();
+    size_t largo = 0;
+    encabezado[largo++] = (unsigned char)operacion;
+    largo += traza_codificar_varint(encabezado + largo, ahora - traza->anterior);
+    traza->anterior = ahora;
+
+    if ( !traza->con_claves ) {
+        unsigned char bytes[sizeof(uint64_t)];
+        for (size_t i = 0; i < sizeof(bytes); i++)
+            bytes[i] = (unsigned char)(hash >> (8 * i));
+        traza_escribir(traza, encabezado, largo);
+        traza_escribir(traza, bytes, sizeof(bytes));
+        return;
+    }
+    size_t largo_clave = strlen(clave);
+    largo += traza_codificar_varint(encabezado + largo, largo_clave);
+    traza_escribir(traza, encabezado, largo);
+    traza_escribir(traza, clave, largo_clave);
+}
+
+bool traza_cerrar(traza_t* traza) {
+    bool ok = !traza->error;
+    if ( fclose(traza->archivo) )
+        ok = false;
+    free(traza);
+    return ok;
+}
+
+bool traza_leer(const char* ruta, bool* con_claves, traza_visitar_t visitar, void* extra) {
+    FILE* archivo = fopen(ruta, "rb");
+    if ( !archivo )
+        return false;
+
+    char magia[LARGO_MAGIA];
+    int opciones = EOF;
+    if ( fread(magia, 1, LARGO_MAGIA, archivo) == LARGO_MAGIA && memcmp(magia, MAGIA_TRAZA, LARGO_MAGIA) == 0 )
+        opciones = getc(archivo);
+    if ( opciones == EOF ) {
+        fclose(archivo);
+        return false;
+    }
+    bool claves = opciones & OPCION_CON_CLAVES;
+    if ( con_claves )
+        *con_claves = claves;
+
+    char* clave = NULL;
+    size_t capacidad_clave = 0;
+    uint64_t instante = 0;
+    bool ok = true;
+    int operacion;
+    while ( ok && (operacion = getc(archivo)) != EOF ) {
+        uint64_t delta, hash = 0, largo = 0;
+        ok = operacion >= TRAZA_GUARDAR && operacion <= TRAZA_PERTENECE && traza_leer_varint(archivo, &delta);
+        if ( !ok )
+            break;
+        instante += delta;
+
+        if ( !claves ) {
+            unsigned char bytes[sizeof(uint64_t)];
+            ok = fread(bytes, 1, sizeof(bytes), archivo) == sizeof(bytes);
+            for (size_t i = 0; i < sizeof(bytes) && ok; i++)
+                hash |= (uint64_t)bytes[i] << (8 * i);
+        } else {
+            ok = traza_leer_varint(archivo, &largo);
+            if ( ok && largo + 1 > capacidad_clave ) {
+                char* nueva = realloc(clave, largo + 1);
+                ok = nueva;
+                if ( nueva ) {
+                    clave = nueva;
+                    capacidad_clave = largo + 1;
+                }
+            }
+            ok = ok && fread(clave, 1, largo, archivo) == largo;
+            if ( ok )
+                clave[largo] = '\0';
+        }
+        ok = ok && visitar((traza_operacion_t)operacion, claves ? clave : NULL, largo, hash, instante, extra);
+    }
+    free(clave);
+    fclose(archivo);
+    return ok;
+}
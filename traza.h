@@ -0,0 +1,57 @@
+#ifndef TRAZA_H
+#define TRAZA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ******************************************************************
+ *                DEFINICION DE LOS TIPOS DE DATOS
+ * ******************************************************************/
+
+// Traza binaria de operaciones sobre un hash, para reproducirlas despues.
+// El archivo empieza con "HTRAZA01" y un byte de opciones; cada operacion
+// ocupa un byte de tipo, los nanosegundos desde la anterior (varint) y la
+// clave (largo varint + bytes) o, si no se graban claves, su hash (8 bytes).
+typedef struct traza traza_t;
+
+typedef enum {
+    TRAZA_GUARDAR = 1,
+    TRAZA_OBTENER = 2,
+    TRAZA_BORRAR = 3,
+    TRAZA_PERTENECE = 4
+} traza_operacion_t;
+
+// Recibe cada operacion al leer una traza. Si la traza no tiene claves,
+// clave es NULL y largo 0. instante es el tiempo en nanosegundos desde la
+// primera operacion. Devuelve false para cortar la lectura.
+typedef bool (*traza_visitar_t)(traza_operacion_t operacion, const char* clave,
+                                size_t largo, uint64_t hash, uint64_t instante,
+                                void* extra);
+
+/* ******************************************************************
+ *                    PRIMITIVAS DE LA TRAZA
+ * ******************************************************************/
+
+// Crea (o trunca) el archivo de la traza. Si con_claves es false solo se
+// graba el hash de cada clave: la traza es mas chica y no expone claves.
+// Post: devuelve la traza abierta, o NULL si hubo un error de E/S.
+traza_t* traza_crear(const char* ruta, bool con_claves);
+
+// Agrega una operacion. Un error de escritura queda registrado y lo
+// informa traza_cerrar.
+// Pre: la traza fue creada.
+void traza_anotar(traza_t* traza, traza_operacion_t operacion, const char* clave, uint64_t hash);
+
+// Escribe lo pendiente y cierra el archivo. Devuelve false si alguna
+// escritura fallo.
+// Pre: la traza fue creada.
+// Post: la traza fue liberada.
+bool traza_cerrar(traza_t* traza);
+
+// Llama a visitar por cada operacion del archivo, en orden. Devuelve false
+// si el archivo no es una traza, si esta cortado o si visitar corto.
+// con_claves, si no es NULL, indica si la traza tiene claves.
+bool traza_leer(const char* ruta, bool* con_claves, traza_visitar_t visitar, void* extra);
+
+#endif // TRAZA_H